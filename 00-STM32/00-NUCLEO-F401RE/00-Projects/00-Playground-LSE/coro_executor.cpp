@@ -0,0 +1,177 @@
+/*Cooperative executor. The tasks are lists of suspended coroutines: a FIFO of ready tasks, a list of sleeping tasks
+sorted by deadline, and the waiters of each awaitable. The executor thread resumes the ready tasks one after the
+other; when none is left it sleeps on its thread flag until the next deadline, so an idle executor costs no CPU.
+
+Interrupts never touch the lists: wake_from_isr() puts the task in a small ring, stamps the cycle counter and sets
+the thread flag. The executor moves the ring into the ready list before each resume, and the time from the stamp to
+the resume is the wake-up latency of the report.
+
+The frames come from a bump allocator over a static arena: the tasks of this program live forever, so a frame is
+never given back. Each frame has an 8-byte header with its size, for the RAM report. */
+
+#include "coro_executor.h"
+#include "report_line.h"
+
+#ifdef __cpp_impl_coroutine
+
+#define FRAME_HEADER 8        //size of the frame, keeps the frame 8-byte aligned
+
+CoExecutor executor;
+
+static uint8_t arena[CO_ARENA_SIZE] __attribute__((aligned(8)));
+static uint32_t arena_used = 0;
+
+static uint32_t now_ms(void) {
+    return (uint32_t)Kernel::Clock::now().time_since_epoch().count();
+}
+
+void* CoTask::promise_type::operator new(size_t size) noexcept {
+    uint32_t total = (FRAME_HEADER + size + 7) & ~7u;
+    CriticalSectionLock lock;
+    if (arena_used + total > CO_ARENA_SIZE) return nullptr;
+    uint8_t* block = arena + arena_used;
+    arena_used += total;
+    *(uint32_t*)block = size;
+    return block + FRAME_HEADER;
+}
+
+void CoTask::promise_type::operator delete(void*, size_t) noexcept { //the arena is not given back
+}
+
+static uint32_t frame_size(CoTask::Handle task) {
+    return *(uint32_t*)((uint8_t*)task.address() - FRAME_HEADER);
+}
+
+bool CoExecutor::spawn(CoTask task, const char* name) {
+    if (!task.handle) return false;
+    task.handle.promise().name = name;
+    if (task_count < CO_MAX_TASKS) tasks[task_count++] = task.handle;
+    make_ready(task.handle);
+    return true;
+}
+
+void CoExecutor::make_ready(CoTask::Handle task) { //Only from the executor thread
+    CoTask::promise_type* p = &task.promise();
+    p->next = nullptr;
+    if (ready_tail) ready_tail->next = p;
+    else ready_head = p;
+    ready_tail = p;
+}
+
+void CoExecutor::wake_from_isr(CoTask::Handle task) {
+    CriticalSectionLock lock;
+    if (isr_head - isr_tail >= CO_ISR_WAKES) return; //cannot happen with one waiter per task and fewer tasks
+    task.promise().isr_stamp = DWT->CYCCNT | 1;      //| 1: a stamp is never 0
+    isr_wakes[isr_head++ % CO_ISR_WAKES] = &task.promise();
+    if (runner) osThreadFlagsSet(runner, CO_WAKE_FLAG);
+}
+
+void CoExecutor::sleep_until(CoTask::Handle task, uint32_t deadline) {
+    CoTask::promise_type* p = &task.promise();
+    p->deadline = deadline;
+    CoTask::promise_type** link = &timers;
+    while (*link && (int32_t)((*link)->deadline - deadline) <= 0) link = &(*link)->next;
+    p->next = *link;
+    *link = p;
+}
+
+void CoExecutor::take_isr_wakes(void) {
+    while (true) {
+        CoTask::promise_type* p;
+        {
+            CriticalSectionLock lock;
+            if (isr_tail == isr_head) return;
+            p = isr_wakes[isr_tail++ % CO_ISR_WAKES];
+        }
+        make_ready(CoTask::Handle::from_promise(*p));
+    }
+}
+
+void CoExecutor::resume(CoTask::promise_type* task) {
+    if (task->isr_stamp) {
+        uint32_t cycles = (DWT->CYCCNT | 1) - task->isr_stamp;
+        task->isr_stamp = 0;
+        wakes++;
+        wake_cycles_total += cycles;
+        if (cycles > wake_cycles_max) wake_cycles_max = cycles;
+    }
+    CoTask::Handle::from_promise(*task).resume();
+}
+
+void CoExecutor::run(void) {
+    runner = ThisThread::get_id();
+    CoreDebug->DEMCR = CoreDebug->DEMCR | CoreDebug_DEMCR_TRCENA_Msk; //no |= on a volatile register in C++20
+    DWT->CTRL = DWT->CTRL | DWT_CTRL_CYCCNTENA_Msk;
+
+    while (1) {
+        take_isr_wakes();
+        uint32_t now = now_ms();
+        while (timers && (int32_t)(now - timers->deadline) >= 0) { //the sleeping tasks whose time has come
+            CoTask::promise_type* p = timers;
+            timers = p->next;
+            timer_wakes++;
+            if (now - p->deadline > timer_late_max) timer_late_max = now - p->deadline;
+            make_ready(CoTask::Handle::from_promise(*p));
+        }
+
+        if (ready_head) {
+            CoTask::promise_type* p = ready_head;
+            ready_head = p->next;
+            if (ready_head == nullptr) ready_tail = nullptr;
+            resume(p);
+        } else if (timers) {
+            ThisThread::flags_wait_any_for(CO_WAKE_FLAG, std::chrono::milliseconds(timers->deadline - now));
+        } else {
+            ThisThread::flags_wait_any(CO_WAKE_FLAG);
+        }
+    }
+}
+
+/*-------------------------------------------Awaitables-----------------------------------------------------*/
+CoPinEdge::CoPinEdge(PinName pin, bool rising) : input(pin) {
+    if (rising) input.rise(callback(this, &CoPinEdge::handler));
+    else input.fall(callback(this, &CoPinEdge::handler));
+}
+
+void CoPinEdge::handler(void) { //Interrupt context
+    if (waiters == nullptr) {
+        missed++;
+        return;
+    }
+    while (waiters) {
+        CoTask::promise_type* p = waiters;
+        waiters = p->next;
+        executor.wake_from_isr(CoTask::Handle::from_promise(*p));
+    }
+}
+
+bool CoPinEdge::Wait::await_ready(void) { //An edge that nobody waited for is not lost
+    CriticalSectionLock lock;
+    if (edge.missed == 0) return false;
+    edge.missed = 0;
+    return true;
+}
+
+void CoPinEdge::Wait::await_suspend(CoTask::Handle task) {
+    CriticalSectionLock lock;
+    task.promise().next = edge.waiters;
+    edge.waiters = &task.promise();
+}
+
+/*-------------------------------------------Report---------------------------------------------------------*/
+void CoExecutor::print_report(FileHandle* out) {
+    uint32_t cycles_per_us = SystemCoreClock / 1000000;
+    print_line(out, "Coroutines: %d tasks on one stack, %lu of %d arena bytes\n\r", task_count,
+               (unsigned long)arena_used, CO_ARENA_SIZE);
+    for (int i = 0; i < task_count; i++) {
+        print_line(out, "  %-18s frame %4lu bytes, as a Thread %lu bytes (stack %d + object %d)\n\r",
+                   tasks[i].promise().name, (unsigned long)(frame_size(tasks[i]) + FRAME_HEADER),
+                   (unsigned long)(OS_STACK_SIZE + sizeof(Thread)), OS_STACK_SIZE, (int)sizeof(Thread));
+    }
+    print_line(out, "  wake-up from an interrupt: %lu, mean %lu us, max %lu us; from a timer: %lu, max %lu ms late\n\r",
+               (unsigned long)wakes, (unsigned long)(wakes ? wake_cycles_total / wakes / cycles_per_us : 0),
+               (unsigned long)(wake_cycles_max / cycles_per_us), (unsigned long)timer_wakes,
+               (unsigned long)timer_late_max);
+}
+
+#endif //__cpp_impl_coroutine
@@ -0,0 +1,217 @@
+/*Header file for a cooperative executor of C++20 coroutines: many small tasks on the stack of one thread, instead of
+one Thread (and one stack of OS_STACK_SIZE bytes) per task. A task is a function returning CoTask that waits with
+co_await on one of the awaitables below; meanwhile its local variables live in a frame of a few dozen bytes, taken
+from a static arena, and the thread runs the other tasks or sleeps:
+    CoTask blink(void) {
+        while (1) {
+            led = !led;
+            co_await co_sleep(200ms);
+        }
+    }
+    executor.spawn(blink(), "blink");
+    executor.run();                        //never returns
+A task only gives the CPU away at a co_await: a long computation (or printf) delays the other tasks.
+
+Needs C++20 (-std=gnu++20 and GCC 10 or newer, set in the build profile); with the C++14 default of Mbed OS this file
+declares nothing. */
+
+#ifndef CORO_EXECUTOR_H
+#define CORO_EXECUTOR_H
+#include "mbed.h"
+
+#ifdef __cpp_impl_coroutine
+#include <coroutine>
+
+#define CO_ARENA_SIZE  512    //bytes for all the coroutine frames
+#define CO_MAX_TASKS   8      //tasks in the report
+#define CO_ISR_WAKES   8      //wake-ups from interrupts not yet seen by the executor
+#define CO_WAKE_FLAG   0x4000 //thread flag of the executor thread, set by the interrupts
+
+class CoTask {
+public:
+    struct promise_type {
+        const char* name = "task";
+        promise_type* next = nullptr;      //ready list, timer list or waiter list: a task is in one at most
+        uint32_t deadline = 0;             //Kernel::Clock ms, when sleeping
+        uint32_t isr_stamp = 0;            //DWT->CYCCNT of the interrupt that woke it, 0 if none
+
+        CoTask get_return_object(void) {
+            return CoTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend(void) noexcept { return {}; } //starts when the executor runs it
+        std::suspend_always final_suspend(void) noexcept { return {}; }
+        void return_void(void) {}
+        void unhandled_exception(void) {}
+        static void* operator new(size_t size) noexcept; //from the arena, nullptr when it is full
+        static void operator delete(void* frame, size_t size) noexcept;
+        static CoTask get_return_object_on_allocation_failure(void) { return CoTask(nullptr); }
+    };
+    typedef std::coroutine_handle<promise_type> Handle;
+
+    explicit CoTask(Handle handle) : handle(handle) {}
+    Handle handle;
+};
+
+class CoExecutor {
+public:
+    bool spawn(CoTask task, const char* name); //false if its frame did not fit in the arena
+    [[noreturn]] void run(void);               //runs the tasks in the calling thread, forever
+
+    void make_ready(CoTask::Handle task);                     //from tasks and awaitables
+    void wake_from_isr(CoTask::Handle task);                  //from interrupts
+    void sleep_until(CoTask::Handle task, uint32_t deadline); //Kernel::Clock ms
+    void print_report(FileHandle* out);        //RAM per task against threads, and the wake-up latencies
+
+private:
+    void take_isr_wakes(void);
+    void resume(CoTask::promise_type* task);
+
+    CoTask::promise_type* ready_head = nullptr;
+    CoTask::promise_type* ready_tail = nullptr;
+    CoTask::promise_type* timers = nullptr;    //sorted by deadline
+    CoTask::promise_type* isr_wakes[CO_ISR_WAKES];
+    uint32_t isr_head = 0, isr_tail = 0;
+    osThreadId_t runner = nullptr;
+
+    CoTask::Handle tasks[CO_MAX_TASKS];
+    int task_count = 0;
+    uint32_t wakes = 0, wake_cycles_max = 0;                         //interrupt to resumed task
+    uint64_t wake_cycles_total = 0;
+    uint32_t timer_wakes = 0, timer_late_max = 0;                    //ms after the deadline
+};
+
+extern CoExecutor executor;
+
+/*-------------------------------------------Awaitables-----------------------------------------------------*/
+//co_await co_sleep(500ms): like ThisThread::sleep_for(), for this task only
+struct co_sleep {
+    explicit co_sleep(Kernel::Clock::duration_u32 time) : time(time) {}
+    bool await_ready(void) const { return time.count() == 0; }
+    void await_suspend(CoTask::Handle task) {
+        executor.sleep_until(task, (uint32_t)Kernel::Clock::now().time_since_epoch().count() + time.count());
+    }
+    void await_resume(void) {}
+    Kernel::Clock::duration_u32 time;
+};
+
+//A periodic timer without drift: co_await timer.tick() returns one period after the previous tick, however long the
+//task worked in between
+class CoTimer {
+public:
+    explicit CoTimer(Kernel::Clock::duration_u32 period)
+        : period(period.count()), next((uint32_t)Kernel::Clock::now().time_since_epoch().count()) {}
+
+    struct Tick {
+        CoTimer& timer;
+        bool await_ready(void) const { return false; }
+        void await_suspend(CoTask::Handle task) {
+            timer.next += timer.period;
+            executor.sleep_until(task, timer.next);
+        }
+        void await_resume(void) {}
+    };
+    Tick tick(void) { return Tick{*this}; }
+
+private:
+    uint32_t period, next;
+};
+
+//The edges of an InterruptIn: co_await edge.wait() returns at the next edge, or at once for an edge that came while
+//no task was waiting. All the waiting tasks wake up.
+class CoPinEdge {
+public:
+    CoPinEdge(PinName pin, bool rising);
+
+    struct Wait {
+        CoPinEdge& edge;
+        bool await_ready(void);
+        void await_suspend(CoTask::Handle task);
+        void await_resume(void) {}
+    };
+    Wait wait(void) { return Wait{*this}; }
+
+private:
+    void handler(void);
+
+    InterruptIn input;
+    CoTask::promise_type* waiters = nullptr;
+    uint32_t missed = 0;                       //edges with no task waiting
+};
+
+//A queue between interrupts (or tasks) and one receiving task: T value = co_await queue.receive()
+template <typename T, int N>
+class CoQueue {
+public:
+    bool send(const T& value) {                //from interrupts and tasks, false if full
+        CriticalSectionLock lock;
+        if (receiver) {                        //straight to the waiting task
+            CoTask::Handle task = CoTask::Handle::from_promise(*receiver);
+            receiver = nullptr;
+            slot = value;
+            if (core_util_is_isr_active()) executor.wake_from_isr(task);
+            else executor.make_ready(task);
+            return true;
+        }
+        if (count == N) return false;
+        items[(first + count++) % N] = value;
+        return true;
+    }
+
+    struct Receive {
+        CoQueue& queue;
+        bool await_ready(void) { return queue.take(); }
+        bool await_suspend(CoTask::Handle task) {
+            CriticalSectionLock lock;
+            if (queue.take()) return false;    //a send came in after await_ready(): go on at once
+            queue.receiver = &task.promise();
+            return true;
+        }
+        T await_resume(void) { return queue.slot; }
+    };
+    Receive receive(void) { return Receive{*this}; }
+
+private:
+    bool take(void) {                          //the oldest item into the slot of the receiver
+        CriticalSectionLock lock;
+        if (count == 0) return false;
+        slot = items[first];
+        first = (first + 1) % N;
+        count--;
+        return true;
+    }
+
+    T items[N];
+    T slot;                                    //the value for the receiver
+    int first = 0, count = 0;
+    CoTask::promise_type* receiver = nullptr;
+};
+
+//co_await co_spi_transfer(spi, tx, tx_length, rx, rx_length): with the asynchronous SPI API of the target (DMA or
+//interrupts) the task waits for the completion event; without it the transfer is done at once
+struct co_spi_transfer {
+    co_spi_transfer(SPI& spi, const char* tx, int tx_length, char* rx, int rx_length)
+        : spi(spi), tx(tx), rx(rx), tx_length(tx_length), rx_length(rx_length) {}
+#if DEVICE_SPI_ASYNCH
+    bool await_ready(void) const { return false; }
+    void await_suspend(CoTask::Handle task) {
+        waiter = task;
+        spi.transfer(tx, tx_length, rx, rx_length, event_callback_t(this, &co_spi_transfer::done), SPI_EVENT_COMPLETE);
+    }
+    void done(int) { executor.wake_from_isr(waiter); }
+    CoTask::Handle waiter;
+#else
+    bool await_ready(void) {
+        spi.write(tx, tx_length, rx, rx_length);
+        return true;
+    }
+    void await_suspend(CoTask::Handle) {}
+#endif
+    void await_resume(void) {}
+    SPI& spi;
+    const char* tx;
+    char* rx;
+    int tx_length, rx_length;
+};
+
+#endif //__cpp_impl_coroutine
+#endif
@@ -5,6 +5,24 @@
  *******************************************************************************************************************
  * Learning outcome: In the search of digital switches, relays prove to be a very useful alternative. However, there
  must be ways to control switches through the microcontroller itself.
+
+ + With a C++20 compiler the two relays are coroutines ("coro_executor.h") run by main on its own stack, instead of two
+ threads with a stack each. They wait for the rising edge of the sound sensor instead of checking a flag every 10 ms,
+ and the LED stripe blinks on a periodic timer that does not drift. 5 s after the sound the program prints the RAM of
+ each task against a Thread, and how long the executor took to resume a task after the interrupt. With the C++14
+ default of Mbed OS (or COROUTINE_TASKS set to 0) the two relays are timers of a timer wheel ("timer_wheel.h"):
+ 24 bytes each instead of a thread with its stack, with their callbacks run by main, and started by the interrupt of
+ the sound sensor. With TIMER_WHEEL_TASKS set to 0 as well, the original version with one thread per relay is built.
+
+ + Does the LED stripe keep its 200 ms? relay_activation has a PeriodMonitor ("period_monitor.h") that compares the
+ start of every toggle with when it was due; every minute the program prints how late the toggles came (histogram),
+ the missed deadlines and the drift from the grid of the first toggle. The thread version drifts, the coroutine one
+ should not.
+
+ + Does the board sleep while it waits? "sleep_stats.h" counts the sleeps of the core, the time asleep and what woke
+ it up (the tick, a kernel timer, the sound sensor...). Every second it prints a line, every minute the "top wakers"
+ and whether the idle thread runs tickless. The 10 ms polls of the thread version show up as 200 kernel timer
+ wake-ups per second before the sound; the coroutine and timer versions sleep until the sound.
  *******************************************************************************************************************
  * Author: Luciano Carricart, https://github.com/lcarricart/
  * Status: Information Engineering student at HAW Hamburg, Germany.
@@ -13,15 +31,169 @@
 
  // Preprocessor directives
 #include "mbed.h"
+#include "coro_executor.h"
+#include "period_monitor.h"
+#include "timer_wheel.h"
+#include "sleep_stats.h"
+
+#ifndef COROUTINE_TASKS
+#ifdef __cpp_impl_coroutine
+#define COROUTINE_TASKS 1     // C++20: the relays are coroutines sharing the stack of main
+#else
+#define COROUTINE_TASKS 0     // timers, or one Thread per relay
+#endif
+#endif
+#ifndef TIMER_WHEEL_TASKS
+#define TIMER_WHEEL_TASKS 1   // 1: the relays are timers run by main, 0: one Thread per relay
+#endif
+#define TRIGGER_PULSES 6      // changes of relay2 that make a trigger
+#define PERIOD_REPORT 60s     // how often the jitter of the relay is printed
+#define SLEEP_SUMMARY_MS 1000 // how often a line of sleep statistics is printed
+#define SLEEP_REPORT_MS 60000 // and the top wakers
 
 // Object declarations
 DigitalOut relay(D5);         // Relay to control the LED stripe
 DigitalOut relay2(D4);        // Relay to control the speakers trigger
+#if COROUTINE_TASKS
+CoPinEdge soundSensor(D3, true); // Activation method for the system: its rising edge wakes the tasks
+#else
 InterruptIn soundSensor(D3);  // Activation method for the system
+#endif
 
 // This global flag is declared as volatile because it is modified inside an interrupt service routine
 volatile bool already_started = 0;   // Indicates if system is already running or not
+PeriodMonitor relay_period("relay_activation", 200); // Compares each toggle with when it was due
+
+#if COROUTINE_TASKS
+//-------------- Tasks ------------------//
+
+// If sound sensor is triggered, relay goes active
+CoTask relay_activation()
+{
+    co_await soundSensor.wait();    // sleeps until the sound, no polling
+    already_started = 1;
+
+    CoTimer blink(200ms);
+    while (1)
+    {
+        relay_period.activated();
+        relay = !relay;
+        co_await blink.tick();
+    }
+}
+
+// If sound sensor is triggered, relay goes active
+CoTask relay_activation2()
+{
+    int i;
+    co_await soundSensor.wait();
+    while (1)
+    {
+        // One single switch is not recognized by the MP3 player as a trigger signal, 6 make sure it always activates.
+        for (i = 0; i < 6; i++)
+        {
+            relay2 = !relay2;
+            co_await co_sleep(500ms);
+        }
+        co_await co_sleep(1000000s);
+    }
+}
+
+// Prints the RAM of the tasks and the wake-up latency, once the relays have done their start, then the relay jitter
+CoTask report()
+{
+    co_await soundSensor.wait();
+    co_await co_sleep(5s);
+    executor.print_report(mbed_file_handle(STDOUT_FILENO));
+    while (1)
+    {
+        co_await co_sleep(PERIOD_REPORT);
+        print_period_reports(mbed_file_handle(STDOUT_FILENO));
+    }
+}
+
+//--------------- Main ------------------//
+int main() {
+    sleep_stats_init(); // Counts the sleeps and what ends them, printed every second
+    sleep_stats_start_reporter(mbed_file_handle(STDOUT_FILENO), SLEEP_SUMMARY_MS, SLEEP_REPORT_MS);
 
+    executor.spawn(relay_activation(), "relay_activation");
+    executor.spawn(relay_activation2(), "relay_activation2");
+    executor.spawn(report(), "report");
+
+    executor.run(); // Runs the tasks, and waits for interrupts when none of them is ready
+}
+
+#elif TIMER_WHEEL_TASKS
+// Prototypes
+void relay_activation(void* arg);
+void relay_activation2(void* arg);
+void report(void* arg);
+
+TimerWheel wheel;             // Runs the callbacks of all the timers, in main
+WheelTimer blink_timer(relay_activation);
+WheelTimer trigger_timer(relay_activation2);
+WheelTimer report_timer(report);
+int trigger_pulses = 0;       // changes of relay2 so far in this trigger
+
+//-------------- Timers -----------------//
+
+// Every 200 ms once the sound came: toggles the LED stripe
+void relay_activation(void*)
+{
+    relay_period.activated();
+    relay = !relay;
+}
+
+// One change of relay2 every 500 ms: one single switch is not recognized by the MP3 player as a trigger signal, 6 make
+// sure it always activates. Then the trigger rests for 1000000 s, like the sleep of the thread version.
+void relay_activation2(void*)
+{
+    relay2 = !relay2;
+    if (++trigger_pulses < TRIGGER_PULSES) {
+        wheel.start(&trigger_timer, 500ms);
+    } else {
+        trigger_pulses = 0;
+        wheel.start(&trigger_timer, 500ms + 1000000s);
+    }
+}
+
+// 5 s after the sound the RAM of the timers against threads, then every minute the jitter of the relay
+void report(void*)
+{
+    static bool first = true;
+    if (first) {
+        wheel.print_report(mbed_file_handle(STDOUT_FILENO));
+        wheel.start(&report_timer, PERIOD_REPORT, PERIOD_REPORT);
+        first = false;
+    } else {
+        print_period_reports(mbed_file_handle(STDOUT_FILENO));
+    }
+}
+
+/*-------------- Handlers ---------------*/
+
+// Interrupt Service Routine (ISR) triggered when the sensor output goes HIGH: starts the timers, once
+void soundDetectedISR()
+{
+    sleep_stats_isr("sound sensor");
+    if (already_started == 1) return;
+    already_started = 1;
+    wheel.start(&blink_timer, 0ms, 200ms);
+    wheel.start(&trigger_timer, 0ms);
+    wheel.start(&report_timer, 5s);
+}
+
+//--------------- Main ------------------//
+int main() {
+    sleep_stats_init(); // Counts the sleeps and what ends them, printed every second
+    sleep_stats_start_reporter(mbed_file_handle(STDOUT_FILENO), SLEEP_SUMMARY_MS, SLEEP_REPORT_MS);
+    soundSensor.rise(callback(soundDetectedISR));
+
+    wheel.run(); // Runs the callbacks when their time comes, and sleeps until the next one meanwhile
+}
+
+#else
 // Prototypes
 void relay_activation(void);
 void relay_activation2(void);
@@ -36,6 +208,7 @@ void relay_activation()
     {
         if (already_started == 1)
         {
+            relay_period.activated();
             relay = !relay;
             ThisThread::sleep_for(200ms);
         }
@@ -73,12 +246,16 @@ void relay_activation2()
 // Interrupt Service Routine (ISR) triggered when the sensor output goes HIGH.
 void soundDetectedISR()
 {
+    sleep_stats_isr("sound sensor");
     if (already_started == 0)
         already_started = 1;  // Flag goes active
 }
 
 //--------------- Main ------------------//
 int main() {
+    sleep_stats_init(); // Counts the sleeps and what ends them, printed every second
+    sleep_stats_start_reporter(mbed_file_handle(STDOUT_FILENO), SLEEP_SUMMARY_MS, SLEEP_REPORT_MS);
+
     // Set up the sound sensor interrupt.
     soundSensor.rise(callback(soundDetectedISR));
 
@@ -87,6 +264,12 @@ int main() {
     thread2.start(callback(relay_activation2));
 
     while (1) {
-        __WFI(); // Wait For Interrupt
+#if PERIOD_MONITOR
+        ThisThread::sleep_for(PERIOD_REPORT); // the idle thread waits for interrupts meanwhile
+        print_period_reports(mbed_file_handle(STDOUT_FILENO));
+#else
+        sleep_stats_wfi(); // Wait For Interrupt, and count what ends the sleep
+#endif
     }
-}
\ No newline at end of file
+}
+#endif
\ No newline at end of file
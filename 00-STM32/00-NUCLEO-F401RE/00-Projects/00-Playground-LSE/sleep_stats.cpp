@@ -0,0 +1,341 @@
+/*Sleep and wake-up accounting. The idle hook does what the default one of Mbed OS does, with counting around it:
+    - tickless (MBED_TICKLESS): the kernel is suspended until its next timeout and the core sleeps, deep if no driver
+      holds the deep sleep lock, until that timeout or an interrupt. A sleep that lasted the whole timeout was ended
+      by the kernel timer; a shorter one by an interrupt, named if its ISR called sleep_stats_isr().
+    - with the tick: the core sleeps with the interrupts masked, so the interrupt that wakes it is still pending
+      afterwards and the NVIC tells which one it was (SysTick: the tick). The same goes for sleep_stats_wfi().
+The time asleep comes from the low power ticker when there is one: the microsecond ticker stops in deep sleep.
+Without the STM32 core registers (e.g. on the PC) only sleep_stats_wfi() is counted, with an unknown waker. */
+
+#include "sleep_stats.h"
+#include "report_line.h"
+#if SLEEP_STATS
+#include <cstdio>
+#if defined(TARGET_STM32F4)
+#include "rtx_os.h"
+#include "platform/source/mbed_os_timer.h"
+#if DEVICE_LPTICKER
+#include "hal/lp_ticker_api.h"
+#endif
+#endif
+
+#define WAKE_TICK    -1         //the kernel tick (SysTick)
+#define WAKE_TIMER   -2         //a kernel timeout: a sleep_for(), a timer, a wait with a time limit
+#define WAKE_UNKNOWN -3
+#define WAKE_OTHERS  -4         //the sources that did not fit in the table
+
+typedef struct {
+    int16_t irq;                //interrupt number, or one of the WAKE_ values above
+    const char* name;           //from sleep_stats_isr(), nullptr if none
+    uint32_t wakes;
+    uint32_t summarized;        //wakes at the previous summary
+} waker_t;
+
+typedef struct {
+    uint32_t sleeps;
+    uint32_t in_main;           //of those, in sleep_stats_wfi()
+    uint32_t deep;              //of those, deep sleep was allowed
+    uint32_t locked;            //of those, the idle thread could not sleep deep because of the lock
+    uint64_t asleep_us;
+    uint64_t time_us;           //when the counts were taken, since sleep_stats_init()
+} counts_t;
+
+typedef struct {
+    const char* name;
+    bool (*holding)(void);
+    uint32_t held;              //sleeps it was holding the lock at
+} holder_t;
+
+static waker_t wakers[SLEEP_STATS_WAKERS + 1]; //the last line collects the sources that did not fit
+static int waker_count = 0;
+static holder_t holders[SLEEP_STATS_HOLDERS];
+static counts_t counts, summarized;
+static uint32_t clock_read_us;                //sleep_clock_us() at the previous stats_clock_us()
+static volatile bool waker_armed = false;      //tickless: the first named ISR after the sleep started woke it
+static volatile int16_t isr_waker = WAKE_UNKNOWN;
+
+static uint32_t sleep_clock_us(void) {
+#if defined(TARGET_STM32F4) && DEVICE_LPTICKER
+    return (uint32_t)ticker_read_us(get_lp_ticker_data());
+#else
+    return us_ticker_read();
+#endif
+}
+
+//The 32-bit clock wraps after 71 minutes: the reports count on from the previous reading. In a critical section.
+static uint64_t stats_clock_us(void) {
+    uint32_t read = sleep_clock_us();
+    uint64_t time = counts.time_us + (read - clock_read_us);
+    clock_read_us = read;
+    return time;
+}
+
+static waker_t* find_waker(int irq) { //Line of a source, new sources take a free one. In a critical section.
+    for (int i = 0; i < waker_count; i++) {
+        if (wakers[i].irq == irq) return &wakers[i];
+    }
+    if (waker_count == SLEEP_STATS_WAKERS) {
+        wakers[SLEEP_STATS_WAKERS].irq = WAKE_OTHERS;
+        return &wakers[SLEEP_STATS_WAKERS];
+    }
+    wakers[waker_count].irq = irq;
+    return &wakers[waker_count++];
+}
+
+static void count_sleep(bool in_main, bool deep, bool locked, uint32_t asleep_us, int irq) {
+    CriticalSectionLock lock;
+    counts.sleeps++;
+    if (in_main) counts.in_main++;
+    if (deep) counts.deep++;
+    if (locked) {
+        counts.locked++;
+        for (int i = 0; i < SLEEP_STATS_HOLDERS && holders[i].name; i++) {
+            if (holders[i].holding == nullptr || holders[i].holding()) holders[i].held++;
+        }
+    }
+    counts.asleep_us += asleep_us;
+    find_waker(irq)->wakes++;
+}
+
+#if defined(TARGET_STM32F4)
+static int pending_irq(void) { //The interrupt that woke the core: still pending while the interrupts are masked
+    if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) return WAKE_TICK;
+    for (int i = 0; i < 8; i++) {
+        uint32_t pending = NVIC->ISPR[i] & NVIC->ISER[i];
+        if (pending) return i * 32 + __builtin_ctz(pending);
+    }
+    return WAKE_UNKNOWN;
+}
+
+#if defined(MBED_TICKLESS)
+static bool kernel_event_pending(void*) { //An interrupt made a thread ready: the idle thread must give way
+    return osRtxInfo.kernel.pendSV != 0;
+}
+
+static void counting_idle(void) {
+    isr_waker = WAKE_UNKNOWN;
+    waker_armed = true;
+    rtos::Kernel::Clock::duration_u32 timeout{osKernelSuspend()}; //the tick stops until the next kernel timeout
+    bool deep = sleep_manager_can_deep_sleep();
+    uint32_t start = sleep_clock_us();
+    rtos::Kernel::Clock::duration_u32 slept =
+        mbed::internal::do_timed_sleep_relative_to_acknowledged_ticks(timeout, kernel_event_pending);
+    uint32_t asleep = sleep_clock_us() - start;
+    osKernelResume(slept.count());
+    waker_armed = false;
+
+    int irq = isr_waker != WAKE_UNKNOWN ? isr_waker : slept >= timeout ? WAKE_TIMER : WAKE_UNKNOWN;
+    count_sleep(false, deep, !deep, asleep, irq);
+}
+#else
+static void counting_idle(void) {
+    core_util_critical_section_enter();
+    bool deep = sleep_manager_can_deep_sleep();
+    sleep_manager_lock_deep_sleep(); //the SysTick stops in deep sleep, and with it the kernel
+    uint32_t start = sleep_clock_us();
+    sleep();
+    uint32_t asleep = sleep_clock_us() - start;
+    int irq = pending_irq();
+    sleep_manager_unlock_deep_sleep();
+    core_util_critical_section_exit();
+    count_sleep(false, false, !deep, asleep, irq);
+}
+#endif
+
+void sleep_stats_init(void) {
+    clock_read_us = sleep_clock_us();
+    counts.time_us = 0;
+    summarized = counts;
+    rtos_attach_idle_hook(&counting_idle);
+}
+
+void sleep_stats_wfi(void) {
+    core_util_critical_section_enter(); //the waker stays pending until the section ends
+    uint32_t start = sleep_clock_us();
+    __WFI();
+    uint32_t asleep = sleep_clock_us() - start;
+    int irq = pending_irq();
+    core_util_critical_section_exit();
+    count_sleep(true, false, false, asleep, irq);
+}
+
+void sleep_stats_isr(const char* name) {
+    int irq = (int)(__get_IPSR() & 0x1FF) - 16;
+    CriticalSectionLock lock;
+    waker_t* w = find_waker(irq);
+    if (w->irq == irq) w->name = name;
+    if (waker_armed) {
+        isr_waker = irq;
+        waker_armed = false;
+    }
+}
+
+#else
+void sleep_stats_init(void) {
+    clock_read_us = sleep_clock_us();
+    counts.time_us = 0;
+    summarized = counts;
+}
+
+void sleep_stats_wfi(void) {
+    uint32_t start = sleep_clock_us();
+    __WFI();
+    count_sleep(true, false, false, sleep_clock_us() - start, WAKE_UNKNOWN);
+}
+
+void sleep_stats_isr(const char*) {}
+#endif
+
+void sleep_stats_add_holder(const char* name, bool (*holding)(void)) {
+    CriticalSectionLock lock;
+    for (int i = 0; i < SLEEP_STATS_HOLDERS; i++) {
+        if (holders[i].name == nullptr) {
+            holders[i].name = name;
+            holders[i].holding = holding;
+            return;
+        }
+    }
+}
+
+/*-------------------------------------------Reports--------------------------------------------------------*/
+static uint32_t permille(uint64_t part, uint64_t whole) {
+    return whole ? (uint32_t)(part * 1000 / whole) : 0;
+}
+
+static const char* waker_name(const waker_t* w, char* buffer, size_t size) {
+    switch (w->irq) {
+    case WAKE_TICK: return "tick";
+    case WAKE_TIMER: return "kernel timer";
+    case WAKE_UNKNOWN: return "unknown";
+    case WAKE_OTHERS: return "(others)";
+    }
+    if (w->name) return w->name;
+    snprintf(buffer, size, "IRQ %d", w->irq);
+    return buffer;
+}
+
+//The n busiest sources: wakes since the previous summary, or since the start
+static int top_wakers(const waker_t* table, int count, bool since_summary, const waker_t** top, int n) {
+    int found = 0;
+    for (int i = 0; i < count; i++) { //insertion into the sorted top
+        uint32_t wakes = table[i].wakes - (since_summary ? table[i].summarized : 0);
+        if (wakes == 0) continue;
+        int at = found;
+        while (at > 0 && wakes > top[at - 1]->wakes - (since_summary ? top[at - 1]->summarized : 0)) {
+            if (at < n) top[at] = top[at - 1];
+            at--;
+        }
+        if (at < n) {
+            top[at] = &table[i];
+            if (found < n) found++;
+        }
+    }
+    return found;
+}
+
+static void take(counts_t* now, waker_t* table, int* count) {
+    CriticalSectionLock lock;
+    counts.time_us = stats_clock_us();
+    *now = counts;
+    wakers[SLEEP_STATS_WAKERS].irq = WAKE_OTHERS;
+    *count = waker_count;
+    for (int i = 0; i < waker_count; i++) table[i] = wakers[i];
+    table[(*count)++] = wakers[SLEEP_STATS_WAKERS];
+}
+
+void print_sleep_summary(FileHandle* out) {
+    counts_t now;
+    waker_t table[SLEEP_STATS_WAKERS + 1];
+    int count;
+    take(&now, table, &count);
+    counts_t before = summarized;
+    summarized = now;
+    for (int i = 0; i < count - 1; i++) wakers[i].summarized = table[i].wakes; //only this thread writes them
+    wakers[SLEEP_STATS_WAKERS].summarized = table[count - 1].wakes;
+
+    uint64_t interval_us = now.time_us - before.time_us;
+    uint32_t sleeps = now.sleeps - before.sleeps;
+    uint32_t asleep = permille(now.asleep_us - before.asleep_us, interval_us);
+    char line[128], name[12];
+    int len = snprintf(line, sizeof(line), "sleep: %lu sleeps (%lu in main), %lu.%lu %% asleep, %lu deep, %lu locked;",
+                       (unsigned long)sleeps, (unsigned long)(now.in_main - before.in_main),
+                       (unsigned long)(asleep / 10), (unsigned long)(asleep % 10),
+                       (unsigned long)(now.deep - before.deep), (unsigned long)(now.locked - before.locked));
+    const waker_t* top[SLEEP_STATS_TOP];
+    int n = top_wakers(table, count, true, top, SLEEP_STATS_TOP);
+    for (int i = 0; i < n && len < (int)sizeof(line); i++) {
+        len += snprintf(line + len, sizeof(line) - len, " %s %lu", waker_name(top[i], name, sizeof(name)),
+                        (unsigned long)(top[i]->wakes - top[i]->summarized));
+    }
+    if (len > (int)sizeof(line) - 3) len = sizeof(line) - 3;
+    line[len++] = '\n';
+    line[len++] = '\r';
+    out->write(line, len);
+}
+
+void print_sleep_report(FileHandle* out) {
+    counts_t now;
+    waker_t table[SLEEP_STATS_WAKERS + 1];
+    int count;
+    take(&now, table, &count);
+
+    uint32_t elapsed_ms = (uint32_t)(now.time_us / 1000);
+    uint32_t asleep = permille(now.asleep_us, (uint64_t)elapsed_ms * 1000);
+    uint32_t deep = permille(now.deep, now.sleeps), locked = permille(now.locked, now.sleeps);
+    print_line(out, "\n\rSleep over %lu s: %lu sleeps (%lu in main), %lu.%lu %% asleep, deep %lu.%lu %%, "
+               "locked %lu.%lu %%\n\r",
+               (unsigned long)(elapsed_ms / 1000), (unsigned long)now.sleeps, (unsigned long)now.in_main,
+               (unsigned long)(asleep / 10), (unsigned long)(asleep % 10), (unsigned long)(deep / 10),
+               (unsigned long)(deep % 10), (unsigned long)(locked / 10), (unsigned long)(locked % 10));
+#if defined(MBED_TICKLESS)
+    print_line(out, "  tickless idle: on, the tick is stopped while the idle thread sleeps\n\r");
+#else
+    print_line(out, "  tickless idle: OFF, the tick wakes the idle thread every ms (MBED_TICKLESS not set)\n\r");
+#endif
+
+    print_line(out, "%-20s %10s %8s\n\r", "WAKER", "WAKES", "PER S");
+    const waker_t* top[SLEEP_STATS_WAKERS + 1];
+    int n = top_wakers(table, count, false, top, SLEEP_STATS_WAKERS + 1);
+    char name[12];
+    for (int i = 0; i < n; i++) {
+        uint32_t rate = elapsed_ms ? (uint32_t)((uint64_t)top[i]->wakes * 10000 / elapsed_ms) : 0; //tenths per s
+        print_line(out, "%-20.20s %10lu %6lu.%lu\n\r", waker_name(top[i], name, sizeof(name)),
+                   (unsigned long)top[i]->wakes, (unsigned long)(rate / 10), (unsigned long)(rate % 10));
+    }
+    for (int i = 0; i < SLEEP_STATS_HOLDERS && holders[i].name; i++) {
+        uint32_t held = permille(holders[i].held, now.locked);
+        print_line(out, "  deep sleep lock: %s held it at %lu.%lu %% of the locked sleeps\n\r", holders[i].name,
+                   (unsigned long)(held / 10), (unsigned long)(held % 10));
+    }
+}
+
+/*-------------------------------------------Reporter thread------------------------------------------------*/
+//Above normal, like the RTOS statistics: a thread that never sleeps would keep a lower one from printing. Its own
+//wake-ups show up as one "kernel timer" wake per print.
+static Thread reporter(osPriorityAboveNormal, 1536, nullptr, "sleep_stats");
+static FileHandle* report_out;
+static uint32_t summary_period_ms, report_period_ms;
+
+static void reporter_loop(void) {
+    uint32_t step_ms = summary_period_ms ? summary_period_ms : report_period_ms;
+    uint32_t waited_ms = 0;
+    while (true) {
+        ThisThread::sleep_for(std::chrono::milliseconds(step_ms));
+        waited_ms += step_ms;
+        if (summary_period_ms) print_sleep_summary(report_out);
+        if (report_period_ms && waited_ms >= report_period_ms) {
+            print_sleep_report(report_out);
+            waited_ms = 0;
+        }
+    }
+}
+
+void sleep_stats_start_reporter(FileHandle* out, uint32_t summary_ms, uint32_t report_ms) {
+    if (summary_ms == 0 && report_ms == 0) return;
+    report_out = out;
+    summary_period_ms = summary_ms;
+    report_period_ms = report_ms;
+    reporter.start(callback(reporter_loop));
+}
+
+#endif
@@ -0,0 +1,44 @@
+/*Header file for the sleep and wake-up accounting: how often the core goes to sleep, how long it stays asleep, whether
+it may go into deep sleep and what wakes it up again (the kernel tick, a kernel timer, or which interrupt). It answers
+"does this program really sleep between its events?": a loop that polls every 10 ms shows up as 100 wake-ups per second
+of the kernel timer, a __WFI() in main() as 1000 of the tick. Two reports:
+    - print_sleep_summary(): one line for the time since the previous one, e.g. every second,
+    - print_sleep_report(): the "top wakers" since the start, with the deep sleep lock holders and whether the idle
+      thread runs tickless (MBED_TICKLESS: the tick is stopped while idle, so it cannot wake the core).
+sleep_stats_init() replaces the idle hook of the RTOS with one that sleeps as the default one does and counts. An ISR
+that calls sleep_stats_isr("name") gives its interrupt a name in the reports. With SLEEP_STATS set to 0 the calls are
+empty and the default idle hook stays. */
+
+#ifndef SLEEP_STATS_H
+#define SLEEP_STATS_H
+#include "mbed.h"
+
+#ifndef SLEEP_STATS
+#define SLEEP_STATS 1         //0: no accounting, no code, no RAM
+#endif
+#define SLEEP_STATS_WAKERS  12 //wake-up sources with their own line, later ones are added up as "others"
+#define SLEEP_STATS_HOLDERS 4  //suspects for the deep sleep lock
+#define SLEEP_STATS_TOP     3  //wake-up sources in a summary line
+
+#if SLEEP_STATS
+//Function Prototypes
+void sleep_stats_init(void);                  //replaces the idle hook, call first thing in main()
+void sleep_stats_wfi(void);                   //__WFI() of a main() loop that also counts the sleep and its waker
+void sleep_stats_isr(const char* name);       //first thing in an ISR: names its interrupt, ISR-safe
+//A driver that may hold the deep sleep lock, e.g. a running Timer or a PwmOut; holding(): is it holding it now
+//(nullptr: always). Checked at every sleep that could not be deep.
+void sleep_stats_add_holder(const char* name, bool (*holding)(void) = nullptr);
+void sleep_stats_start_reporter(FileHandle* out, uint32_t summary_ms, uint32_t report_ms); //0: not printed
+void print_sleep_summary(FileHandle* out);    //one line since the previous summary
+void print_sleep_report(FileHandle* out);     //top wakers since the start, fits rtos_stats_add_report()
+#else
+inline void sleep_stats_init(void) {}
+inline void sleep_stats_wfi(void) { __WFI(); }
+inline void sleep_stats_isr(const char*) {}
+inline void sleep_stats_add_holder(const char*, bool (*)(void) = nullptr) {}
+inline void sleep_stats_start_reporter(FileHandle*, uint32_t, uint32_t) {}
+inline void print_sleep_summary(FileHandle*) {}
+inline void print_sleep_report(FileHandle*) {}
+#endif
+
+#endif
@@ -0,0 +1,183 @@
+/*Hierarchical timer wheel. A timer due in d ms goes into ring L, the lowest one where d fits in a whole turn
+(32^(L+1) ms). In ring 0 its slot is the millisecond it is due; in ring L > 0 it is the slot that the ring reaches
+d / 32^L turns of ring L-1 from now. When a ring reaches a slot, its timers drop into the lower rings with what is left
+of their delay (the cascade), so a timer moves down at most WHEEL_LEVELS times, and ring 0 calls the ones that are due.
+Starting and stopping a timer are a few pointer writes in a critical section.
+
+The worker does not wake up every millisecond: a bitmap per ring tells which slots hold timers, so it sleeps until the
+nearest of them, which is the next due timer or the next cascade, and the wheel jumps over the empty slots. */
+
+#include "timer_wheel.h"
+#include "report_line.h"
+
+#define SLOT_MASK (WHEEL_SLOTS - 1)
+
+static uint32_t now_ms(void) {
+    return (uint32_t)Kernel::Clock::now().time_since_epoch().count();
+}
+
+static uint32_t rotate_right(uint32_t bits, uint32_t n) {
+    n &= 31;
+    return n ? (bits >> n) | (bits << (32 - n)) : bits;
+}
+
+void TimerWheel::insert(WheelTimer* timer, int32_t min_delay) { //In a critical section
+    int32_t delay = (int32_t)(timer->expires - now);
+    if (delay < min_delay) delay = min_delay;   //0 only in a cascade: due in this millisecond, ring 0 comes next
+
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1 && (uint32_t)delay >> ((level + 1) * WHEEL_SLOT_BITS)) level++;
+    int shift = level * WHEEL_SLOT_BITS;
+    uint32_t turns = (uint32_t)delay >> shift;  //1 to 31 for a ring above 0
+    if (turns > SLOT_MASK) turns = SLOT_MASK;   //past the last ring: it cascades back into it
+    int slot = ((now >> shift) + turns) & SLOT_MASK;
+
+    WheelTimer** head = &slots[level][slot];
+    timer->next = *head;
+    if (timer->next) timer->next->link = &timer->next;
+    timer->link = head;
+    *head = timer;
+    occupied[level] |= 1u << slot;
+}
+
+void TimerWheel::unlink(WheelTimer* timer) { //In a critical section
+    *timer->link = timer->next;
+    if (timer->next) timer->next->link = timer->link;
+    uintptr_t offset = (uintptr_t)timer->link - (uintptr_t)slots; //first in its slot: the slot may be empty now
+    if (offset < sizeof(slots) && *timer->link == nullptr) {
+        uint32_t index = offset / sizeof(WheelTimer*);
+        occupied[index / WHEEL_SLOTS] &= ~(1u << (index % WHEEL_SLOTS));
+    }
+    timer->next = nullptr;
+    timer->link = nullptr;
+}
+
+void TimerWheel::start(WheelTimer* timer, Kernel::Clock::duration_u32 delay, Kernel::Clock::duration_u32 period) {
+    {
+        CriticalSectionLock lock;
+        if (timer->link) unlink(timer);
+        else if (++running > running_max) running_max = running;
+        timer->expires = now_ms() + delay.count();
+        timer->period = period.count();
+        insert(timer, 1);
+    }
+    if (worker && (core_util_is_isr_active() || ThisThread::get_id() != worker)) {
+        osThreadFlagsSet(worker, WHEEL_WAKE_FLAG);  //it may be sleeping until a later timer
+    }
+}
+
+void TimerWheel::stop(WheelTimer* timer) {
+    CriticalSectionLock lock;
+    if (!timer->link) return;
+    unlink(timer);
+    running--;
+}
+
+uint32_t TimerWheel::ticks_to_next(void) const { //In a critical section
+    uint32_t next = 0;
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+        if (!occupied[level]) continue;
+        int shift = level * WHEEL_SLOT_BITS;
+        uint32_t cursor = (now >> shift) & SLOT_MASK;
+        //bit i of the rotated map is the slot i + 1 turns ahead of the cursor
+        uint32_t turns = __builtin_ctz(rotate_right(occupied[level], cursor + 1)) + 1;
+        uint32_t ticks = (((now >> shift) + turns) << shift) - now;
+        if (next == 0 || ticks < next) next = ticks;
+    }
+    return next;
+}
+
+void TimerWheel::tick(void) {
+    WheelTimer* due;
+    {
+        CriticalSectionLock lock;
+        now++;
+        //Every ring that a lower ring has just finished a turn of moves one slot, and that slot cascades
+        for (int level = 1; level < WHEEL_LEVELS && ((now >> ((level - 1) * WHEEL_SLOT_BITS)) & SLOT_MASK) == 0;
+             level++) {
+            int slot = (now >> (level * WHEEL_SLOT_BITS)) & SLOT_MASK;
+            WheelTimer* list = slots[level][slot];
+            slots[level][slot] = nullptr;
+            occupied[level] &= ~(1u << slot);
+            while (list) {
+                WheelTimer* timer = list;
+                list = timer->next;
+                insert(timer, 0);
+            }
+        }
+        int slot = now & SLOT_MASK;
+        due = slots[0][slot];
+        slots[0][slot] = nullptr;
+        occupied[0] &= ~(1u << slot);
+        if (due) due->link = &due;              //a callback may still stop one of them
+    }
+
+    while (true) {
+        WheelTimer* timer;
+        uint32_t expired;
+        {
+            CriticalSectionLock lock;
+            timer = due;
+            if (!timer) break;
+            due = timer->next;
+            if (due) due->link = &due;
+            timer->next = nullptr;
+            timer->link = nullptr;
+            expired = timer->expires;
+            if (timer->period) {                //the next period counts from the due time, not from now
+                timer->expires += timer->period;
+                insert(timer, 1);
+            } else {
+                running--;
+            }
+        }
+        uint32_t late = now_ms() - expired;
+        if (late > late_max) late_max = late;
+        callbacks++;
+        timer->callback(timer->arg);
+    }
+}
+
+void TimerWheel::advance(uint32_t target) { //Turns the wheel up to target, jumping over the empty slots
+    while ((int32_t)(target - now) > 0) {
+        {
+            CriticalSectionLock lock;
+            uint32_t ticks = ticks_to_next();
+            if (ticks == 0 || (int32_t)(target - (now + ticks)) < 0) {
+                now = target;
+                return;
+            }
+            now += ticks - 1;
+        }
+        tick();
+    }
+}
+
+void TimerWheel::run(void) {
+    worker = ThisThread::get_id();
+    while (1) {
+        advance(now_ms());
+        uint32_t ticks;
+        {
+            CriticalSectionLock lock;
+            ticks = ticks_to_next();
+        }
+        int32_t wait = (int32_t)(now + ticks - now_ms());
+        if (ticks == 0) {
+            ThisThread::flags_wait_any(WHEEL_WAKE_FLAG);
+        } else if (wait > 0) {
+            ThisThread::flags_wait_any_for(WHEEL_WAKE_FLAG, std::chrono::milliseconds(wait));
+        }
+        wakes++;
+    }
+}
+
+/*-------------------------------------------Report---------------------------------------------------------*/
+void TimerWheel::print_report(FileHandle* out) {
+    print_line(out, "Timer wheel: %lu timers running (at most %lu), %d bytes each, %d bytes of wheel\n\r",
+               (unsigned long)running, (unsigned long)running_max, (int)sizeof(WheelTimer), (int)sizeof(TimerWheel));
+    print_line(out, "  as a Thread each: %lu bytes (stack %d + object %d)\n\r",
+               (unsigned long)(OS_STACK_SIZE + sizeof(Thread)), OS_STACK_SIZE, (int)sizeof(Thread));
+    print_line(out, "  %lu callbacks, at most %lu ms late; the worker woke up %lu times\n\r",
+               (unsigned long)callbacks, (unsigned long)late_max, (unsigned long)wakes);
+}
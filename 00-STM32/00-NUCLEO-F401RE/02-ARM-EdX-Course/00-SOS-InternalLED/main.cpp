@@ -1,12 +1,23 @@
 /*******************************************************************************************************************
  * Objective of the program:  Make an external LED throw an SOS morse code signal every time the USER button is pressed.
  *******************************************************************************************************************
+ * Learning outcome: the SOS does not need to block the thread in a chain of ThisThread::sleep_for(), nor to poll the
+ button without a pause. With TIMER_WHEEL_TASKS set to 1 it is one timer of a timer wheel ("timer_wheel.h"): each
+ callback switches the LED and starts the timer again for the time of the next step of the signal, the button is an
+ interrupt that starts the first step, and main runs the callbacks and sleeps in between. Set to 0, the sleep_for()
+ version is built.
+ *******************************************************************************************************************
  * Author: Luciano Carricart, https://github.com/lcarricart/
  * Status: Information Engineering student at HAW Hamburg, Germany.
  * Profile: https://www.linkedin.com/in/lucianocarricart/
  *******************************************************************************************************************/
 
 #include "mbed.h"
+#include "timer_wheel.h"
+
+#ifndef TIMER_WHEEL_TASKS
+#define TIMER_WHEEL_TASKS 1   // 1: the SOS is a timer run by main, 0: a chain of sleep_for() while polling the button
+#endif
 
 
 // Blinking rate in milliseconds
@@ -14,6 +25,58 @@
 #define SHORT_BLINK_RATE    200ms
 #define INTER_LETTER_DELAY  1000ms
 #define INTER_BLINK_DELAY   200ms
+#define SOS_ELEMENTS        9       // ... --- ...
+
+#if TIMER_WHEEL_TASKS
+static const char sos[SOS_ELEMENTS + 1] = "...---...";
+
+DigitalOut led(D10);
+InterruptIn user_button(BUTTON1);     // Active-low: the press is the falling edge
+
+// Prototypes
+void sos_step(void* arg);
+
+TimerWheel wheel;             // Runs the callbacks of the timers, in main
+WheelTimer sos_timer(sos_step);
+int step = 0;                 // Even: the LED goes on for element step / 2, odd: it goes off. 0: no SOS going on
+
+// One step of the signal: switches the LED and starts the timer for the time of the step
+void sos_step(void*)
+{
+    int element = step / 2;
+    if (step == 2 * SOS_ELEMENTS)   // The signal is over, a press starts it again
+    {
+        step = 0;
+        return;
+    }
+    if (step % 2 == 0)
+    {
+        led = 1;
+        wheel.start(&sos_timer, sos[element] == '.' ? SHORT_BLINK_RATE : LONG_BLINK_RATE);
+    }
+    else
+    {
+        led = 0;
+        bool end_of_letter = element % 3 == 2 && element < SOS_ELEMENTS - 1;
+        wheel.start(&sos_timer, end_of_letter ? INTER_BLINK_DELAY + INTER_LETTER_DELAY : INTER_BLINK_DELAY);
+    }
+    step++;
+}
+
+// Interrupt Service Routine (ISR) of the button: starts the signal, unless it is already going on
+void button_pressed()
+{
+    if (step == 0 && !wheel.is_running(&sos_timer)) wheel.start(&sos_timer, 0ms);
+}
+
+int main()
+{
+    user_button.fall(callback(button_pressed));
+
+    wheel.run(); // Runs the steps when their time comes, and sleeps until the next one meanwhile
+}
+
+#else
 
 int main()
 {
@@ -59,3 +122,4 @@ int main()
         }
     }
 }
+#endif
@@ -0,0 +1,63 @@
+/*Header file for a timer service: many one-shot and periodic timers whose callbacks all run in one worker thread,
+instead of one Thread (and one stack of OS_STACK_SIZE bytes) per timed output. A timer is a 24-byte object:
+    void toggle(void* arg) { relay = !relay; }
+    WheelTimer blink(toggle);
+    wheel.start(&blink, 200ms, 200ms);      //first call after 200 ms, then every 200 ms, without drift
+    wheel.run();                            //the worker: runs the callbacks in the calling thread, never returns
+start() and stop() may be called from interrupts, other threads and the callbacks themselves, and take the same time
+however many timers are running. The timers hang in a hierarchical timer wheel: WHEEL_LEVELS rings of WHEEL_SLOTS
+lists, the first one with a slot per millisecond, each next one with slots as long as a whole turn of the previous
+one. A callback runs in the worker: a long one (or a printf) delays the other timers, like a task of one thread. */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+#include "mbed.h"
+
+#define WHEEL_SLOT_BITS  5
+#define WHEEL_SLOTS      (1 << WHEEL_SLOT_BITS)
+#define WHEEL_LEVELS     4       //32^4 ms = 17 minutes; a longer timer goes round the last ring until it is due
+#define WHEEL_WAKE_FLAG  0x2000  //thread flag of the worker, set when a timer is started from another context
+
+class WheelTimer {
+public:
+    explicit WheelTimer(void (*callback)(void* arg), void* arg = nullptr) //a plain function: Callback<> is larger
+        : next(nullptr), link(nullptr), expires(0), period(0), callback(callback), arg(arg) {}
+
+private:
+    WheelTimer* next;
+    WheelTimer** link;           //the pointer to this timer in its slot, nullptr when not running: unlinks in O(1)
+    uint32_t expires;            //Kernel::Clock ms
+    uint32_t period;             //ms, 0: one-shot
+    void (*callback)(void* arg);
+    void* arg;
+    friend class TimerWheel;
+};
+
+class TimerWheel {
+public:
+    //(Re)starts a timer: the callback runs after delay, then every period if it is not 0
+    void start(WheelTimer* timer, Kernel::Clock::duration_u32 delay,
+               Kernel::Clock::duration_u32 period = Kernel::Clock::duration_u32(0));
+    void stop(WheelTimer* timer);          //the callback will not run, unless it is running right now
+    bool is_running(const WheelTimer* timer) const { return timer->link != nullptr; }
+    [[noreturn]] void run(void);           //the worker: runs the callbacks in the calling thread, forever
+    void print_report(FileHandle* out);    //RAM per timer against threads, and how late the callbacks ran
+
+private:
+    void insert(WheelTimer* timer, int32_t min_delay);
+    void unlink(WheelTimer* timer);
+    uint32_t ticks_to_next(void) const;    //to the next slot that holds a timer, 0 if none
+    void advance(uint32_t target);
+    void tick(void);
+
+    WheelTimer* slots[WHEEL_LEVELS][WHEEL_SLOTS] = {};
+    uint32_t occupied[WHEEL_LEVELS] = {};  //a bit per slot that holds a timer
+    uint32_t now = 0;                      //Kernel::Clock ms up to which the wheel has turned
+    osThreadId_t worker = nullptr;
+
+    uint32_t running = 0, running_max = 0;
+    uint32_t callbacks = 0, late_max = 0;  //ms after the due time
+    uint32_t wakes = 0;                    //times the worker woke up
+};
+
+#endif
@@ -0,0 +1,234 @@
+/*Joystick acquisition. On the NUCLEO-F401RE: TIM2 overflows JOY_SCAN_RATE times per second and its trigger output
+(TRGO) starts a scan of ADC1 over channels 0 and 1 (A0, A1); DMA2 Stream0 moves every result into dma_buffer, in
+circular mode, and raises an interrupt at the half and at the end of the buffer. The mbed AnalogIn class cannot do
+this (it converts one channel when read() is called and waits for it), so the STM32 HAL is used directly, as in
+08-Queue-MemoryPool-Theory. Everything after the buffer (oversampling, filter, calibration) is the same code on every
+platform. */
+
+#include "joystick_scan.h"
+
+#define BUFFER_SAMPLES     (2 * JOY_BLOCK_SCANS * JOY_CHANNELS)
+#define BLOCK_RATE         (JOY_SCAN_RATE / JOY_BLOCK_SCANS)
+#define CALIBRATION_BLOCKS (JOY_CALIBRATION_MS * BLOCK_RATE / 1000)
+#define FULL_SCALE         (4095 * JOY_BLOCK_SCANS)  //a block of samples at the top of the range
+#define IIR_FRAC           4                         //fraction bits of the filter state
+#define MIN_SPAN           (FULL_SCALE * 3 / 8)      //center to a learned end at least, 3/4 of a perfect stick
+
+static joystick_publish_t publish_position;
+static int32_t filtered[JOY_CHANNELS];     //oversampled counts, Q(IIR_FRAC)
+static uint32_t center_sum[JOY_CHANNELS];
+static int8_t shown[JOY_CHANNELS];         //last published position
+static uint32_t sequence;
+static joystick_stats_t stats;
+static uint32_t busy_cycles, window_start; //CPU load over the current window of about one second
+
+//Percent of the calibrated range, 0 inside the dead zone; the rest of the range is stretched to start at 0 there
+static int8_t to_percent(int c, int32_t value) {
+    int32_t offset = value - stats.center[c];
+    int32_t span = offset > 0 ? stats.high[c] - stats.center[c] : stats.center[c] - stats.low[c];
+    if (span <= 0) return 0;    //calibrated against an end: that side has no range
+    int32_t percent = offset * 100 / span;
+    int32_t size = percent < 0 ? -percent : percent;
+    if (size > 100) size = 100;
+    if (size <= JOY_DEAD_ZONE) return 0;
+    size = (size - JOY_DEAD_ZONE) * 100 / (100 - JOY_DEAD_ZONE);
+    return (int8_t)(percent < 0 ? -size : size);
+}
+
+//Moved by the threshold, or onto the center or an end, which a reader expects to see exactly
+static bool moved(int8_t now, int8_t before) {
+    int diff = now - before;
+    if (diff >= JOY_CHANGE_THRESHOLD || diff <= -JOY_CHANGE_THRESHOLD) return true;
+    return now != before && (now == 0 || now == 100 || now == -100);
+}
+
+void joystick_block_ready(const uint16_t* block) {
+    uint32_t start = DWT->CYCCNT;
+    int32_t value[JOY_CHANNELS];
+
+    for (int c = 0; c < JOY_CHANNELS; c++) {
+        uint32_t sum = 0; //oversampling: JOY_BLOCK_SCANS samples into one value with more bits and less noise
+        for (int s = 0; s < JOY_BLOCK_SCANS; s++) sum += block[s * JOY_CHANNELS + c];
+        if (stats.blocks == 0) filtered[c] = (int32_t)sum << IIR_FRAC;
+        filtered[c] += (((int32_t)sum << IIR_FRAC) - filtered[c]) >> JOY_IIR_SHIFT;
+        value[c] = filtered[c] >> IIR_FRAC;
+    }
+    stats.blocks++;
+
+    if (stats.blocks <= CALIBRATION_BLOCKS) { //the stick is at rest: its center
+        for (int c = 0; c < JOY_CHANNELS; c++) {
+            center_sum[c] += value[c];
+            if (stats.blocks < CALIBRATION_BLOCKS) continue;
+            int32_t center = center_sum[c] / CALIBRATION_BLOCKS;
+            stats.center[c] = (uint16_t)center;
+            stats.low[c] = (uint16_t)(center > MIN_SPAN ? center - MIN_SPAN : 0);
+            stats.high[c] = (uint16_t)(center + MIN_SPAN < FULL_SCALE ? center + MIN_SPAN : FULL_SCALE);
+        }
+    } else {
+        bool changed = false;
+        int8_t position[JOY_CHANNELS];
+        for (int c = 0; c < JOY_CHANNELS; c++) {
+            if (value[c] < stats.low[c]) stats.low[c] = (uint16_t)value[c];    //the ends grow as the stick reaches them
+            if (value[c] > stats.high[c]) stats.high[c] = (uint16_t)value[c];
+            position[c] = to_percent(c, value[c]);
+            if (moved(position[c], shown[c])) changed = true;
+        }
+        if (changed) {
+            joystick_position_t p = {position[0], position[1], sequence++};
+            shown[0] = position[0];
+            shown[1] = position[1];
+            publish_position(&p);
+            stats.changes++;
+        }
+    }
+
+    uint32_t end = DWT->CYCCNT;
+    busy_cycles += end - start;
+    if (end - window_start >= SystemCoreClock) {
+        stats.cpu_permille = (uint32_t)((uint64_t)busy_cycles * 1000 / (end - window_start));
+        busy_cycles = 0;
+        window_start = end;
+    }
+}
+
+void get_joystick_stats(joystick_stats_t* copy) {
+    CriticalSectionLock lock;
+    *copy = stats;
+}
+
+static void start_cycle_count(void) {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    window_start = DWT->CYCCNT;
+}
+
+#if defined(TARGET_STM32F4)
+/*-------------------------------------------ADC + DMA------------------------------------------------------*/
+static ADC_HandleTypeDef hadc;
+static DMA_HandleTypeDef hdma;
+static TIM_HandleTypeDef htim;
+static uint16_t dma_buffer[BUFFER_SAMPLES];
+
+//The DMA counts down the samples left to the end of the buffer. When a half is done being processed, the DMA must
+//still be writing the other half; if it is back in this one, it overwrote samples we had not read yet.
+static void check_overrun(bool first_half) {
+    bool dma_in_first_half = __HAL_DMA_GET_COUNTER(&hdma) > BUFFER_SAMPLES / 2;
+    if (dma_in_first_half == first_half) stats.overruns++;
+}
+
+extern "C" void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef*) {
+    joystick_block_ready(&dma_buffer[0]);
+    check_overrun(true);
+}
+
+extern "C" void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef*) {
+    joystick_block_ready(&dma_buffer[BUFFER_SAMPLES / 2]);
+    check_overrun(false);
+}
+
+static void dma_irq_handler(void) {
+    HAL_DMA_IRQHandler(&hdma);
+}
+
+void start_joystick(joystick_publish_t publish) {
+    publish_position = publish;
+    start_cycle_count();
+
+    __HAL_RCC_GPIOA_CLK_ENABLE();
+    __HAL_RCC_ADC1_CLK_ENABLE();
+    __HAL_RCC_DMA2_CLK_ENABLE();
+    __HAL_RCC_TIM2_CLK_ENABLE();
+
+    //PA0 (A0) and PA1 (A1) as analog inputs
+    GPIO_InitTypeDef gpio = {};
+    gpio.Pin = GPIO_PIN_0 | GPIO_PIN_1;
+    gpio.Mode = GPIO_MODE_ANALOG;
+    gpio.Pull = GPIO_NOPULL;
+    HAL_GPIO_Init(GPIOA, &gpio);
+
+    //DMA2 Stream0 Channel0 is wired to ADC1: 16-bit transfers into the buffer, round and round
+    hdma.Instance = DMA2_Stream0;
+    hdma.Init.Channel = DMA_CHANNEL_0;
+    hdma.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    hdma.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma.Init.MemInc = DMA_MINC_ENABLE;
+    hdma.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+    hdma.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+    hdma.Init.Mode = DMA_CIRCULAR;
+    hdma.Init.Priority = DMA_PRIORITY_MEDIUM;
+    hdma.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+    HAL_DMA_Init(&hdma);
+    __HAL_LINKDMA(&hadc, DMA_Handle, hdma);
+    NVIC_SetVector(DMA2_Stream0_IRQn, (uint32_t)&dma_irq_handler);
+    HAL_NVIC_SetPriority(DMA2_Stream0_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(DMA2_Stream0_IRQn);
+
+    //ADC1: one scan of both channels per TIM2 trigger, a DMA request after every conversion. The stick is a pair of
+    //potentiometers of a few kOhm: the longest sampling time keeps their source impedance from mattering.
+    hadc.Instance = ADC1;
+    hadc.Init.ClockPrescaler = ADC_CLOCK_SYNC_PCLK_DIV4;
+    hadc.Init.Resolution = ADC_RESOLUTION_12B;
+    hadc.Init.ScanConvMode = ENABLE;
+    hadc.Init.ContinuousConvMode = DISABLE;
+    hadc.Init.DiscontinuousConvMode = DISABLE;
+    hadc.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_RISING;
+    hadc.Init.ExternalTrigConv = ADC_EXTERNALTRIGCONV_T2_TRGO;
+    hadc.Init.DataAlign = ADC_DATAALIGN_RIGHT;
+    hadc.Init.NbrOfConversion = JOY_CHANNELS;
+    hadc.Init.DMAContinuousRequests = ENABLE;
+    hadc.Init.EOCSelection = ADC_EOC_SEQ_CONV;
+    HAL_ADC_Init(&hadc);
+
+    ADC_ChannelConfTypeDef channel = {};
+    channel.SamplingTime = ADC_SAMPLETIME_480CYCLES;
+    channel.Channel = ADC_CHANNEL_0;
+    channel.Rank = 1;
+    HAL_ADC_ConfigChannel(&hadc, &channel);
+    channel.Channel = ADC_CHANNEL_1;
+    channel.Rank = 2;
+    HAL_ADC_ConfigChannel(&hadc, &channel);
+
+    //TIM2 runs at twice PCLK1 when APB1 is divided (84 MHz on the F401), one update = one scan
+    uint32_t timer_clock = HAL_RCC_GetPCLK1Freq();
+    if ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_CFGR_PPRE1_DIV1) timer_clock *= 2;
+    htim.Instance = TIM2;
+    htim.Init.Prescaler = 0;
+    htim.Init.CounterMode = TIM_COUNTERMODE_UP;
+    htim.Init.Period = timer_clock / JOY_SCAN_RATE - 1;
+    htim.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+    HAL_TIM_Base_Init(&htim);
+    TIM_MasterConfigTypeDef master = {};
+    master.MasterOutputTrigger = TIM_TRGO_UPDATE;
+    master.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
+    HAL_TIMEx_MasterConfigSynchronization(&htim, &master);
+
+    HAL_ADC_Start_DMA(&hadc, (uint32_t*)dma_buffer, BUFFER_SAMPLES);
+    HAL_TIM_Base_Start(&htim);
+}
+
+#else
+/*-------------------------------------------AnalogIn Source------------------------------------------------*/
+//No ADC to program: a thread reads a block through AnalogIn every block period, as the DMA would fill it, and
+//processes it. AnalogIn locks a mutex, so it cannot be read in a Ticker interrupt.
+static AnalogIn inputs[JOY_CHANNELS] = {AnalogIn(A0), AnalogIn(A1)};
+static Thread scan_thread(osPriorityAboveNormal, 1024, nullptr, "joystick_scan");
+static uint16_t scan_buffer[BUFFER_SAMPLES / 2];
+
+static void scan_loop(void) {
+    auto next = Kernel::Clock::now();
+    while (true) {
+        next += std::chrono::milliseconds(1000 / BLOCK_RATE);
+        ThisThread::sleep_until(next);
+        for (int s = 0; s < JOY_BLOCK_SCANS; s++) {
+            for (int c = 0; c < JOY_CHANNELS; c++) scan_buffer[s * JOY_CHANNELS + c] = inputs[c].read_u16() >> 4;
+        }
+        joystick_block_ready(scan_buffer);
+    }
+}
+
+void start_joystick(joystick_publish_t publish) {
+    publish_position = publish;
+    start_cycle_count();
+    scan_thread.start(callback(scan_loop));
+}
+#endif
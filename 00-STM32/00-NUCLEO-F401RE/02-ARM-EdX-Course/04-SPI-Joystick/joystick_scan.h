@@ -0,0 +1,47 @@
+/*Header file for the joystick acquisition. The ADC scans A0 (X) and A1 (Y) JOY_SCAN_RATE times per second, paced by
+a timer, and the DMA writes the results into a double buffer with no CPU involved. Every time one half is full an
+interrupt turns its JOY_BLOCK_SCANS scans into one position:
+    - oversampling: the samples of the block are added up, 16 x 12 bits = a 16-bit value with less noise,
+    - a first order IIR low-pass filter in fixed point, no float in the interrupt,
+    - calibration: the center is the average of the first JOY_CALIBRATION_MS (the stick must be left alone at
+      power-up), and the ends are learned as the stick reaches them,
+    - a dead zone around the center, so a released stick reads exactly 0,
+    - a change detector: the position is published only when an axis moved by JOY_CHANGE_THRESHOLD or more.
+The position is updated 200 times per second, and nothing runs after the interrupt while the stick stays still.
+Without an STM32F4 (e.g. on a PC) a thread reads the two AnalogIn inputs into the same blocks instead. */
+
+#ifndef JOYSTICK_SCAN_H
+#define JOYSTICK_SCAN_H
+#include "mbed.h"
+
+#define JOY_CHANNELS          2     //A0: X, A1: Y
+#define JOY_SCAN_RATE         3200  //scans per second
+#define JOY_BLOCK_SCANS       16    //scans per half buffer, one interrupt and one position each: 200 Hz
+#define JOY_IIR_SHIFT         2     //filter weight of a new block: 1/4, a time constant of ~20 ms at 200 Hz
+#define JOY_CALIBRATION_MS    100   //blocks averaged for the center at startup
+#define JOY_DEAD_ZONE         6     //percent around the center that read as 0
+#define JOY_CHANGE_THRESHOLD  2     //percent an axis has to move before the position is published again
+
+//Position in percent of the calibrated range: -100 (left / down) to 100 (right / up), 0 in the dead zone
+typedef struct {
+    int8_t x, y;
+    uint32_t sequence;           //positions published, a gap means the reader missed some
+} joystick_position_t;
+
+//Called in interrupt context when the position changed
+typedef void (*joystick_publish_t)(const joystick_position_t* position);
+
+typedef struct {
+    uint32_t blocks;             //half buffers processed
+    uint32_t changes;            //positions published
+    uint32_t overruns;           //half buffers the DMA rewrote before they were processed
+    uint32_t cpu_permille;       //CPU time of the processing interrupt, in 1/1000 of the elapsed time
+    uint16_t center[JOY_CHANNELS], low[JOY_CHANNELS], high[JOY_CHANNELS]; //calibration, oversampled counts
+} joystick_stats_t;
+
+//Function Prototypes
+void start_joystick(joystick_publish_t publish);
+void joystick_block_ready(const uint16_t* block); //processes JOY_BLOCK_SCANS scans of JOY_CHANNELS samples each
+void get_joystick_stats(joystick_stats_t* stats);
+
+#endif
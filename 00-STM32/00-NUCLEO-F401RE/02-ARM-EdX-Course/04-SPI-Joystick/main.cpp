@@ -3,16 +3,29 @@
  joystick to read its X and Y axis values in the LCD display. The new implementation related to the joystick is 
  marked as **New Code, and it involves three parts.
  *******************************************************************************************************************
+ * Theory: The first version initialised and cleared the LCD and read both axes with AnalogIn every 500 ms, and
+ redrew both lines even when the stick had not moved: 2 positions per second, a flickering screen, and most of the CPU
+ time of the loop spent in the LCD delays. "joystick_scan.h" lets the ADC scan A0 and A1 3200 times per second by
+ itself (a timer triggers it, the DMA stores the results), and an interrupt turns every 16 scans into one position:
+ oversampled, filtered, calibrated and with a dead zone, 200 times per second. main() sleeps until the position has
+ moved by 2 % or more and then rewrites only the digits that changed, so a stick that is left alone costs only the
+ interrupt, a few microseconds every 5 ms. The CPU time of both parts is printed on the PC every 5 s.
+ *******************************************************************************************************************
  * Author: Luciano Carricart, https://github.com/lcarricart/
  * Status: Information Engineering student at HAW Hamburg, Germany.
  * Profile: https://www.linkedin.com/in/lucianocarricart/
  *******************************************************************************************************************/
 
 #include "mbed.h"
+#include "static_format.h"
+#include "joystick_scan.h"
 
 #define ENABLE         0x08 
 #define COMMAND_MODE   0x00 
 #define DATA_MODE      0x04 
+#define JOY_MOVED_FLAG 0x01   // thread flag of main(): a new position is waiting
+#define STATS_PERIOD_S 5      // how often the CPU time goes to the PC, in s
+#define COLUMN_VALUE   15     // first column of the numbers, after " Position: X = "
 
 DigitalOut CS(D10);
 SPI ser_port(D11, D12, D13);
@@ -27,45 +40,95 @@ void write_data(char c);
 void write_4bit(int data, int mode);
 
 // **New code. Part 1/3
-AnalogIn joystickX(A0);
-AnalogIn joystickY(A1);
+// The ADC reads A0 (X) and A1 (Y) by itself; the interrupt hands over the position when it has moved
+joystick_position_t position;
+osThreadId_t main_thread;
+
+void position_changed(const joystick_position_t* moved) // in the DMA interrupt
+{
+    position = *moved;
+    osThreadFlagsSet(main_thread, JOY_MOVED_FLAG);
+}
+
+// Lets sfmt (static_format.h) write straight into the LCD, character by character
+struct lcd_sink {
+    void put(char c) { write_data(c); wait_us(40); }
+    void write(const char* text, size_t n) { while (n--) put(*text++); }
+};
+lcd_sink lcd;
+
+// Writes the number of one axis over the old one; the label in front of it stays on the LCD
+void draw_axis(int line, int value)
+{
+    write_cmd(line + COLUMN_VALUE);
+    wait_us(40);
+    sfmt::format(lcd, FMT("%4d%%"), value);
+}
 
 int main() {
-    while (true) 
+    CS = 1;
+
+    init_lcd(); // once: the first version initialised and cleared the LCD every 500 ms, and the screen flickered
+    clr_lcd();
+
+    /*  **New Code. Part 2/3
+    The labels are written once, only the numbers change. The position is an integer percentage (-100 to 100) that the
+    acquisition computes in fixed point. In many Mbed configurations the default minimal printf implementation does
+    not support floating point formatting (%f), and no float is needed anymore: sfmt from "static_format.h" prints
+    the integers straight into the LCD, and only the %d code is linked in.
+    */
+    write_cmd(0xc0); // Set cursor to second line (1st = 0x80, 2nd = 0xc0, 3rd = 0x94, 4th = 0xD4).
+    wait_us(40);
+    print_lcd(" Position: X = ");
+    write_cmd(0x94); // Set cursor to third line (0xc0 + 0x08)
+    wait_us(40);
+    print_lcd(" Position: Y = ");
+    int shown_x = 0, shown_y = 0;
+    draw_axis(0xc0, shown_x);
+    draw_axis(0x94, shown_y);
+
+    main_thread = ThisThread::get_id();
+    start_joystick(position_changed);
+
+    uint32_t lcd_cycles = 0, redraws = 0, blocks = 0, changes = 0; // blocks and changes: counters at the last report
+    auto report = Kernel::Clock::now() + std::chrono::seconds(STATS_PERIOD_S);
+    while (true)
     {
-        CS = 1;
-    
-        init_lcd(); 
-        clr_lcd();  
-
-        /*  **New Code. Part 2/3
-        Read the analog values; these are normalized from (0.1 to 1) * 100. The variables need to be multiplied because in many Mbed configurations, the default 
-        minimal printf implementation does not support floating point formatting (i.e., using %f). By multiplying the normalized float (ranging from 0.0 to 1.0) by
-        100 and storing it as an integer, you avoid the floating point formatting issue and can print the values using an integer specifier (%u).
-
-        If you want to print them as floats (without converting to an integer), you would need to enable full floating point support in printf by adjusting your Mbed 
-        configuration (for example, by setting "platform.stdio-minimal": false in your mbed_app.json)
-        */
-        int8_t x = joystickX.read() * 100;
-        int8_t y = joystickY.read() * 100;
-
-        // **New Code. Part 3/3. Print the joystick coordinates to the LCD
-        write_cmd(0xc0); // Set cursor to second line (1st = 0x80, 2nd = 0xc0, 3rd = 0x94, 4th = 0xD4).
-        print_lcd("  Position: X = ");
-
-        /* Now we have a problem because we wanna pass an integer but our function is built for strings. I can overload the functions (but they´re a chain of them),
-        or rather transform my integer into a string. I´m chosing the latter.*/
-        char buffer[4]; // This array will hold the value converted into a string.
-        sprintf(buffer, "%d", x); // This function is versatile and can convert various data types to their string representations. First argument is where it´ll be stored.
-        print_lcd(buffer);
-
-        write_cmd(0x94); // Set cursor to third line (0xc0 + 0x08)
-        wait_us(40);
-        print_lcd("  Position: Y = ");
-        sprintf(buffer, "%d", y);
-        print_lcd(buffer);
-
-        ThisThread::sleep_for(500ms);
+        // **New Code. Part 3/3. Sleep until the stick moves, then print only the axis that changed
+        Kernel::Clock::duration_u32 left = report - Kernel::Clock::now();
+        uint32_t flags = (int32_t)left.count() > 0 ? ThisThread::flags_wait_any_for(JOY_MOVED_FLAG, left) : 0;
+        if (flags & JOY_MOVED_FLAG)
+        {
+            joystick_position_t latest;
+            {
+                CriticalSectionLock lock;
+                latest = position;
+            }
+            uint32_t start = DWT->CYCCNT;
+            if (latest.x != shown_x) draw_axis(0xc0, shown_x = latest.x);
+            if (latest.y != shown_y) draw_axis(0x94, shown_y = latest.y);
+            lcd_cycles += DWT->CYCCNT - start;
+            redraws++;
+        }
+
+        if (Kernel::Clock::now() >= report)
+        {
+            joystick_stats_t stats;
+            get_joystick_stats(&stats);
+            uint64_t period_cycles = (uint64_t)SystemCoreClock * STATS_PERIOD_S;
+            uint32_t lcd_permille = (uint32_t)((uint64_t)lcd_cycles * 1000 / period_cycles);
+            printf("Joystick: %lu blocks, %lu changes, %lu redraws in %d s; CPU: filter %lu.%lu %%, LCD %lu.%lu %%; "
+                   "%lu overruns\n", (unsigned long)(stats.blocks - blocks), (unsigned long)(stats.changes - changes),
+                   (unsigned long)redraws, STATS_PERIOD_S,
+                   (unsigned long)(stats.cpu_permille / 10), (unsigned long)(stats.cpu_permille % 10),
+                   (unsigned long)(lcd_permille / 10), (unsigned long)(lcd_permille % 10),
+                   (unsigned long)stats.overruns);
+            lcd_cycles = 0;
+            redraws = 0;
+            blocks = stats.blocks;
+            changes = stats.changes;
+            report += std::chrono::seconds(STATS_PERIOD_S);
+        }
     }
 }
 
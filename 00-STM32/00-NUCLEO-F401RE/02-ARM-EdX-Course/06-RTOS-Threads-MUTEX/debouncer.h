@@ -0,0 +1,90 @@
+/*Header file for a debouncer of N buttons on InterruptIn pins. A mechanical contact bounces for a few ms when it
+closes or opens, so a fall() handler alone sees one press as several. Here the first edge of a burst is the press (or
+the release) right away, and the edges that follow only store their time from the microsecond hardware timer until the
+pin has been quiet for DEBOUNCE_SETTLE_US. Held buttons produce a long press and then repeats. e.g.:
+    InterruptIn up(D4);
+    Debouncer buttons;                          //or Debouncer buttons(on_button) to get the events in the ISR
+    int up_button = buttons.add(up, "UP");      //active low: pressed = 0, as with a pull-up
+    button_event_t event;
+    buttons.get(&event);                        //sleeps until the next event
+Nothing runs while no button moves: no polling thread and no periodic timer, only one Timeout per button while it
+settles or is held. The edge interrupt takes the same few instructions however many buttons there are. */
+
+#ifndef DEBOUNCER_H
+#define DEBOUNCER_H
+#include "mbed.h"
+
+#ifndef DEBOUNCE_LEADING_EDGE
+#define DEBOUNCE_LEADING_EDGE   1   //0: the event waits until the pin is quiet, which also rejects spikes of noise
+#endif                              //   but adds the bounce and DEBOUNCE_SETTLE_US to the latency
+#define DEBOUNCE_SETTLE_US   5000   //quiet time before the level of the pin counts
+#define DEBOUNCE_LONG_MS      800   //held this long: BUTTON_LONG
+#define DEBOUNCE_REPEAT_MS    200   //then a BUTTON_REPEAT this often while it stays held
+#define DEBOUNCE_BUDGET_US  10000   //first edge to the sink or get(), the report counts the events that took longer
+#define DEBOUNCE_MAX_BUTTONS    8
+#define DEBOUNCE_QUEUE_SIZE    16   //events waiting for get()
+
+enum {BUTTON_PRESS, BUTTON_RELEASE, BUTTON_LONG, BUTTON_REPEAT};
+
+typedef struct {
+    uint8_t button;              //the number add() returned
+    uint8_t type;                //BUTTON_PRESS...
+    uint16_t held;               //BUTTON_LONG / BUTTON_REPEAT: 1 for the long press, then 2, 3... per repeat
+    uint32_t us;                 //us_ticker_read() of the first edge of a press/release, or of a long press/repeat
+    bool glitch;                 //BUTTON_PRESS / BUTTON_RELEASE: undoes the previous event, its edge was a glitch
+} button_event_t;
+
+class Debouncer {
+public:
+    typedef void (*sink_t)(const button_event_t& event);   //runs in interrupt context, e.g. posts to a state machine
+
+    explicit Debouncer(sink_t sink = nullptr);  //nullptr: the events are queued for get()
+    //Both edges of the pin are taken over. Returns the number of the button, in the order of the calls, or -1.
+    int add(InterruptIn& pin, const char* name, bool active_low = true);
+    void get(button_event_t* event);            //sleeps until there is an event; without a sink only
+    bool pressed(int button) const { return buttons[button].down; } //the debounced level
+    uint32_t lost_events(void) const { return lost; }
+    void print_report(FileHandle* out);         //edges per press, glitches, latencies from the edge to the event
+
+private:
+    class Button {
+    public:
+        void edge(void);                        //both edges, in the pin interrupt
+        void expire(void);                      //the Timeout: the pin settled, or a long press / repeat is due
+        int change(bool level);                 //the debounced level changes: the event to send
+
+        Debouncer* owner = nullptr;
+        InterruptIn* pin = nullptr;
+        const char* name = nullptr;
+        Timeout timer;
+        uint32_t edge_us = 0;                   //last edge
+        uint32_t first_us = 0;                  //first edge since the level settled
+        uint32_t hold_us = 0;                   //when the next long press / repeat is due
+        uint16_t held = 0;                      //long press and repeats of this press
+        uint8_t index = 0;
+        bool active_low = true;
+        bool settling = false;                  //edges seen, the Timeout waits for the quiet time
+        bool down = false;                      //debounced: pressed
+
+        struct Counts {
+            uint32_t edges, changes, glitches;  //glitches: bursts that ended at the level they started from
+            uint32_t longs, repeats;
+            uint32_t timed, over_budget;        //presses and releases delivered, not counting the glitches
+            uint32_t latency_max_us;
+            uint64_t latency_sum_us;
+        } counts = {};
+    };
+
+    void emit(int button, int type, uint16_t held, uint32_t us, bool glitch = false);
+    void delivered(const button_event_t& event); //first edge to the sink or get(): the latency of the event
+
+    sink_t sink;
+    Button buttons[DEBOUNCE_MAX_BUTTONS];
+    int count;
+    button_event_t queue[DEBOUNCE_QUEUE_SIZE];
+    uint32_t head, tail;                        //written by emit() / by get(), under a critical section
+    uint32_t lost;
+    Semaphore ready;                            //one token per queued event
+};
+
+#endif
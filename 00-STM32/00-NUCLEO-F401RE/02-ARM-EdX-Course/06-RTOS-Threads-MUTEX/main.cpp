@@ -20,6 +20,31 @@
  the thread to sleep for one tick period, which is why I mentioned 1 ms as the minimum sleep duration. In other words,
  even if you request a sleep shorter than one tick period, the scheduler will round it up to the duration of one tick,
  making 1 ms the effective lower bound on sleep time.
+
+ + Which thread uses the CPU? "rtos_stats.h" counts, per thread, the CPU time, the context switches and the deepest
+ stack use seen, plus the time the CPU spends asleep. Every 5 s (or when a key is pressed in the terminal) it prints a
+ "top"-like table. Here breadboardled_thread shows up near 100 %: it never sleeps, so the other threads of the same
+ priority only run when its time slice ends. With RTOS_STATS set to 0 none of it is compiled.
+
+ + Does the MUTEX slow down the button? lcd_mutex is a ProfiledMutex ("profiled_mutex.h"), a Mutex that also measures
+ how often a thread had to wait for it, how long it waited and how long the LCD writes held it. Its report is printed
+ together with the RTOS statistics.
+
+ + Stacks sized from their peaks: each thread gets a static stack of its peak use plus a safety margin
+ ("stack_budget.h", peaks in "stack_sizes.h") instead of OS_STACK_SIZE. With STACK_MEASURE set to 1 the stacks are
+ large and painted, and after STACK_WORKLOAD_MS (press the user button meanwhile) the peaks are printed as the lines of
+ "stack_sizes.h". A normal build checks at startup that no thread has gone past its peak. The peaks are still estimates
+ (STACK_SIZES_MEASURED 0), so the check only warns until a measurement on the board replaces them.
+
+ + Do the threads keep their periods? count_thread and led1_thread each have a PeriodMonitor ("period_monitor.h")
+ that compares the start of every round with when it was due. The report shows how late the rounds came (histogram),
+ the missed deadlines and the drift: count_thread sleeps 1000 ms after its LCD write, so it falls behind a 1000 ms grid
+ a little every second.
+
+ + buttonThread no longer polls the button every 50 ms: it sleeps in a Debouncer ("debouncer.h") until the button
+ moves. The first edge is the press, the bounces after it are filtered by their timestamps, so a press counts once,
+ within microseconds, and the thread uses no CPU at all while nobody touches the button. Its report (edges per press,
+ latency) comes with the RTOS statistics.
  *******************************************************************************************************************
  * Sources of error: depending on the Mbed OS and CMSIS inclusion files, the Wait For Interrupt function could be
  defined uppercase or lowercase [__WFI() or __wfi()].
@@ -37,11 +62,18 @@
  *******************************************************************************************************************/
 
 #include "mbed.h"
+#include "rtos_stats.h"
+#include "profiled_mutex.h"
+#include "stack_budget.h"
+#include "stack_sizes.h"
+#include "period_monitor.h"
+#include "debouncer.h"
 
  // Pre-definitions
 #define ENABLE         0x08
 #define COMMAND_MODE   0x00
 #define DATA_MODE      0x04
+#define STACK_WORKLOAD_MS 20000 // STACK_MEASURE: time to go through every path, the button included
 
 // Instead of a plain DigitalIn, use an InterruptIn (on D3) so that you can detect when the button is pressed. This way, you won’t need to poll its state continuously.
 InterruptIn userButton(PC_13, PullUp); // PullUp add-on avoid me including a resistor to my circuit.
@@ -51,13 +83,12 @@ DigitalOut CS(D10);
 SPI ser_port(D11, D12, D13);
 
 /* New variables for the button counter and debouncing.
- + The Timer is used to measure the elapsed time between button presses for debouncing purposes. It doesn't "count
- seconds automatically" in the sense of a clock—it simply measures how much time has passed. The precision of a Timer
- depends on the underlying hardware; many microcontrollers offer microsecond resolution. While the RTOS system tick
- might be around 1 ms, the Timer itself can often provide finer granularity because it’s tied directly to a hardware
- counter running off the CPU clock, which is much faster than 1 ms per cycle.
+ + The debouncer stamps every edge of the button with the microsecond hardware timer to tell the bounces from the
+ press. That timer doesn't "count seconds automatically" in the sense of a clock—it simply measures how much time has
+ passed. While the RTOS system tick might be around 1 ms, the hardware timer provides finer granularity because it’s
+ tied directly to a counter running off the CPU clock, which is much faster than 1 ms per cycle.
 */
-Timer debounce_timer;
+Debouncer buttons; // the presses wait in its queue for buttonThread
 char button_counter = 0; // global
 
 // Prototypes
@@ -74,12 +105,15 @@ PwmOut LED_var(D2); // The PWM defines different brigthness for values between 0
 AnalogIn pot1(A0); // The key point is that both the potentiometer reading and the PWM output use normalized values between 0.0 and 1.0.
 
 /*-------------------------------------------Threads--------------------------------------------------------*/
-Thread thread1; // Blinchar_counter an LED
+BUDGETED_STACK(led1_stack, STACK_LED1_THREAD);
+Thread thread1(osPriorityNormal, sizeof(led1_stack), led1_stack, "led1_thread"); // Blinchar_counter an LED
+PeriodMonitor led1_period("led1_thread", 500); // Compares each round with when it was due
 void led1_thread(void const* args)
 {
     led = 0;
     while (true)
     {
+        led1_period.activated();
         //led = !led;
         thread_sleep_for(500);
     }
@@ -89,14 +123,17 @@ void led1_thread(void const* args)
 Semaphores are commonly used for allocating shared resources to applications. When a shared resource can only service one
 client or application processor, we call it Mutual Exclusion (MUTEX).
 */
-Mutex lcd_mutex;
+ProfiledMutex lcd_mutex("lcd_mutex"); // a Mutex that measures the waits for it and how long it is held
 
-Thread thread2; // Display a counter on the LCD
+BUDGETED_STACK(count_stack, STACK_COUNT_THREAD);
+Thread thread2(osPriorityNormal, sizeof(count_stack), count_stack, "count_thread"); // Display a counter on the LCD
+PeriodMonitor count_period("count_thread", 1000);
 void count_thread(void const* args)
 {
     char char_counter = 0; // Our counter is a character because that´s the best format for the LCD representation.
     while (true)
     {
+        count_period.activated();
         lcd_mutex.lock();
         write_cmd(0xc0);
         wait_us(40);
@@ -111,39 +148,41 @@ void count_thread(void const* args)
     }
 }
 
-// Button polling thread function
-Thread buttonThread;
+// Button thread function: sleeps until the debouncer has a press
+BUDGETED_STACK(button_stack, STACK_BUTTON_THREAD);
+Thread buttonThread(osPriorityNormal, sizeof(button_stack), button_stack, "buttonThread"); // The names show up in the statistics
 void buttonThreadFunction() {
-    // Read initial state (should be high due to PullUp)
-    bool lastState = userButton.read();
+    button_event_t event;
     while (true) {
-        bool currentState = userButton.read();
-        // Detect a falling edge (transition from high to low)
-        if (lastState && !currentState) {
-            // Toggle LED to indicate button press
-            led = !led;
-
-            // Protect LCD access with the mutex
-            lcd_mutex.lock();
-            write_cmd(0x80);    // Set cursor to the beginning of the first line (0x80)
-            wait_us(40);
-            print_lcd("Button count: ");
-            write_data(button_counter | 0x30); // ASCII codes for the digits '0' to '9' start at 0x30 (48 in decimal)
-            lcd_mutex.unlock();
-
-            button_counter++;
-
-            if (button_counter > 9) button_counter = 0;
-            // Simple debounce delay (adjust as necessary)
-            thread_sleep_for(50);
-        }
-        lastState = currentState;
-        thread_sleep_for(50);
+        buttons.get(&event);
+        if (event.type != BUTTON_PRESS || event.glitch) continue; // only real presses count, not the glitches
+
+        // Toggle LED to indicate button press
+        led = !led;
+
+        // Protect LCD access with the mutex
+        lcd_mutex.lock();
+        write_cmd(0x80);    // Set cursor to the beginning of the first line (0x80)
+        wait_us(40);
+        print_lcd("Button count: ");
+        write_data(button_counter | 0x30); // ASCII codes for the digits '0' to '9' start at 0x30 (48 in decimal)
+        lcd_mutex.unlock();
+
+        button_counter++;
+
+        if (button_counter > 9) button_counter = 0;
     }
 }
 
+// The debouncer counters, next to the RTOS statistics
+void print_button_report(FileHandle* out)
+{
+    buttons.print_report(out);
+}
+
 // Brights a LED in three different intensity levels depending on the position of the potentiometer.
-Thread thread4;
+BUDGETED_STACK(breadboardled_stack, STACK_BREADBOARDLED);
+Thread thread4(osPriorityNormal, sizeof(breadboardled_stack), breadboardled_stack, "breadboardled");
 void breadboardled_thread(void const* args)
 {
     while (1)
@@ -166,10 +205,23 @@ void breadboardled_thread(void const* args)
 /*----------------------------------------Main Function-----------------------------------------------------*/
 int main()
 {
+    rtos_stats_init(); // CPU and stack statistics per thread, printed on the PC every 5 s
+    rtos_stats_start_reporter(mbed_file_handle(STDOUT_FILENO), 5000);
+    rtos_stats_add_report(print_mutex_reports); // and the lcd_mutex measurements with them
+    rtos_stats_add_report(print_stack_report); // and the stacks against their budgets
+    rtos_stats_add_report(print_period_reports); // and how late the periodic threads woke up
+    rtos_stats_add_report(print_button_report); // and the presses of the user button
+
     init_lcd();
     clr_lcd();
 
-    debounce_timer.start();  // Start the timer for debounce measurement.
+    buttons.add(userButton, "user"); // both edges of the button go to the debouncer
+
+    // The stacks are painted before the threads start, so that their peak use can be measured
+    STACK_BUDGET_ADD(led1_stack, STACK_LED1_THREAD);
+    STACK_BUDGET_ADD(count_stack, STACK_COUNT_THREAD);
+    STACK_BUDGET_ADD(button_stack, STACK_BUTTON_THREAD);
+    STACK_BUDGET_ADD(breadboardled_stack, STACK_BREADBOARDLED);
 
     // thread.start(callback(task, argument)) is the standard for calling threads
     thread1.start(callback(led1_thread, &led));
@@ -177,13 +229,27 @@ int main()
     buttonThread.start(callback(buttonThreadFunction));
     thread4.start(callback(breadboardled_thread, &pot1));
 
+#if STACK_MEASURE
+    thread_sleep_for(STACK_WORKLOAD_MS); // the threads are the workload, plus some presses of the user button
+    print_stack_report(mbed_file_handle(STDOUT_FILENO));
+#else
+    thread_sleep_for(STACK_CHECK_MS); // Startup check: the first round of the threads stayed within stack_sizes.h
+    bool stacks_ok = stack_budget_check(mbed_file_handle(STDOUT_FILENO));
+#if STACK_SIZES_MEASURED
+    if (!stacks_ok) error("Stacks past their budget, see stack_sizes.h\n");
+#else
+    printf("Warning: the stack sizes are estimates%s, measure them with STACK_MEASURE 1\n\r",
+           stacks_ok ? "" : " and a thread went past one");
+#endif
+#endif
+
     /* The idle thread (running __WFI()) puts the CPU in low-power mode whenever no threads are ready to run. So, even
     if a task sleeps for a short time (like 1–100 ms), the CPU is in low-power mode during that interval (it halts its
     functioning until another interrupt occurs, saving energy).
     */
     while (true)
     {
-        __WFI(); // Wait for (timer) interrupt
+        rtos_stats_wfi(); // Wait for (timer) interrupt, a __WFI() that also counts the time asleep
     }
 }
 
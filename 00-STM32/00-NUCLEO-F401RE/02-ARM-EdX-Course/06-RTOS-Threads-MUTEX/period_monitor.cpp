@@ -0,0 +1,110 @@
+/*Monitor of periodic tasks. The times come from the microsecond ticker (us_ticker_read(), a hardware timer that keeps
+counting while the core sleeps, unlike the cycle counter), so a round costs one register read and a few additions.
+The ticker wraps every 71 minutes; only differences are used, so that does not matter as long as a period is shorter.
+The statistics of a monitor are only written by its own task; a report copies them with the interrupts off. */
+
+#include "period_monitor.h"
+#include "report_line.h"
+#include <cstdio>
+#include <cstring>
+
+#if PERIOD_MONITOR
+static PeriodMonitor* first_monitor = nullptr; //all monitors, newest first
+
+static int bin_of(uint32_t us) {
+    int bin = 0;
+    while (bin < PERIOD_HIST_BINS - 1 && us >= ((uint32_t)PERIOD_HIST_FIRST_US << bin)) bin++;
+    return bin;
+}
+
+PeriodMonitor::PeriodMonitor(const char* name, uint32_t period_ms, uint32_t deadline_ms)
+    : name(name), period_us(period_ms * 1000), deadline_us((deadline_ms ? deadline_ms : period_ms) * 1000),
+      started(false), previous(0), grid(0) {
+    memset(&stats, 0, sizeof(stats));
+
+    CriticalSectionLock lock;
+    next = first_monitor;
+    first_monitor = this;
+}
+
+void PeriodMonitor::activated(void) {
+    uint32_t now = us_ticker_read();
+    if (!started) {              //the first round is the reference of the ones after it
+        started = true;
+        previous = now;
+        grid = now + period_us;
+        return;
+    }
+
+    int32_t late = (int32_t)(now - (previous + period_us)); //due one period after the previous round
+    int32_t drift = (int32_t)(now - grid);
+    previous = now;
+    grid += period_us;
+
+    CriticalSectionLock lock;    //a report may be copying them
+    stats.activations++;
+    stats.drift = drift;
+    if (late < 0) {
+        stats.early++;
+        if ((uint32_t)-late > stats.early_max) stats.early_max = -late;
+        stats.hist[0]++;
+        return;
+    }
+    stats.late_total += late;
+    if ((uint32_t)late > stats.late_max) stats.late_max = late;
+    if ((uint32_t)late > deadline_us) stats.missed++;
+    stats.hist[bin_of(late)]++;
+}
+
+void PeriodMonitor::restart(void) {
+    started = false;
+}
+
+void PeriodMonitor::get_stats(period_stats_t* copy) {
+    CriticalSectionLock lock;
+    *copy = stats;
+}
+
+/*-------------------------------------------Report---------------------------------------------------------*/
+static void print_histogram(FileHandle* out, const uint32_t* hist) { //Only the bins in use
+    char line[160];
+    int len = snprintf(line, sizeof(line), "  late");
+    for (int bin = 0; bin < PERIOD_HIST_BINS && len < (int)sizeof(line); bin++) {
+        if (hist[bin] == 0) continue;
+        uint32_t limit = (uint32_t)PERIOD_HIST_FIRST_US << (bin < PERIOD_HIST_BINS - 1 ? bin : bin - 1);
+        bool ms = limit >= 1000;
+        len += snprintf(line + len, sizeof(line) - len, " %s%lu%s:%lu", bin < PERIOD_HIST_BINS - 1 ? "<" : ">=",
+                        (unsigned long)(ms ? limit / 1000 : limit), ms ? "ms" : "us", (unsigned long)hist[bin]);
+    }
+    if (len > (int)sizeof(line) - 3) len = sizeof(line) - 3;
+    line[len++] = '\n';
+    line[len++] = '\r';
+    out->write(line, len);
+}
+
+void PeriodMonitor::print_report(FileHandle* out) {
+    period_stats_t s;
+    {
+        CriticalSectionLock lock;
+        s = stats;
+        memset(&stats, 0, sizeof(stats)); //the next report starts over, the reference and the grid stay
+    }
+
+    print_line(out, "%s every %lu ms: %lu rounds, %lu missed deadlines (%lu ms), %lu early\n\r", name,
+               (unsigned long)(period_us / 1000), (unsigned long)s.activations, (unsigned long)s.missed,
+               (unsigned long)(deadline_us / 1000), (unsigned long)s.early);
+    if (s.activations == 0) return;
+    uint32_t late_rounds = s.activations - s.early;
+    print_line(out, "  late mean %lu us, max %lu us; early max %lu us; drift %ld us\n\r",
+               (unsigned long)(late_rounds ? s.late_total / late_rounds : 0), (unsigned long)s.late_max,
+               (unsigned long)s.early_max, (long)s.drift);
+    print_histogram(out, s.hist);
+}
+
+void print_period_reports(FileHandle* out) {
+    for (PeriodMonitor* m = first_monitor; m != nullptr; m = m->next) m->print_report(out);
+}
+
+#else
+void print_period_reports(FileHandle*) {}
+#endif
@@ -0,0 +1,72 @@
+/*Header file for a monitor of periodic tasks: a thread (or a coroutine) that claims to run every N ms marks the start
+of each round, and the monitor compares that moment with when the round was due:
+    PeriodMonitor count_period("count_thread", 1000);
+    while (true) {
+        count_period.activated();             //first thing in the round
+        ...
+        thread_sleep_for(1000);
+    }
+A round is due one period after the previous one started; how late it came is the jitter, kept as a histogram with
+the mean and the maximum. A round later than the deadline (by default a whole period: a round was lost) counts as a
+missed deadline. The drift is how far the rounds have fallen behind the grid of the first one, which a sleep_for()
+after the work adds up to. With PERIOD_MONITOR set to 0 the calls are empty. */
+
+#ifndef PERIOD_MONITOR_H
+#define PERIOD_MONITOR_H
+#include "mbed.h"
+
+#ifndef PERIOD_MONITOR
+#define PERIOD_MONITOR 1      //0: no measurement, no code, no RAM
+#endif
+#define PERIOD_HIST_BINS     12 //histogram bins: below 16 us (or early), then doubling up to 16 ms, and the rest
+#define PERIOD_HIST_FIRST_US 16 //upper limit of the first bin
+
+//Measurements of one periodic task, times in microseconds
+typedef struct {
+    uint32_t activations;                    //rounds measured (the first one only sets the reference)
+    uint32_t missed;                         //rounds later than the deadline
+    uint32_t early;                          //rounds before they were due, e.g. by the rounding of the tick
+    uint32_t late_max, early_max;
+    uint64_t late_total;
+    int32_t drift;                           //behind (+) or ahead (-) of the grid of the first round
+    uint32_t hist[PERIOD_HIST_BINS];         //how late the rounds came
+} period_stats_t;
+
+//Function Prototypes
+void print_period_reports(FileHandle* out);   //report of every PeriodMonitor since its last report
+
+#if PERIOD_MONITOR
+class PeriodMonitor {
+public:
+    PeriodMonitor(const char* name, uint32_t period_ms, uint32_t deadline_ms = 0); //deadline 0: one period
+
+    void activated(void);                     //a round starts: called by the task itself
+    void restart(void);                       //the next round only sets the reference, e.g. after a pause
+
+    const char* get_name(void) const { return name; }
+    void get_stats(period_stats_t* copy);
+    void print_report(FileHandle* out);       //the measurements since the previous report, then starts over
+
+private:
+    const char* name;
+    uint32_t period_us, deadline_us;
+    PeriodMonitor* next;                      //list of all monitors, for print_period_reports()
+    bool started;
+    uint32_t previous;                        //microsecond ticker at the previous round
+    uint32_t grid;                            //when this round is due on the grid of the first one
+    period_stats_t stats;
+    friend void print_period_reports(FileHandle* out);
+};
+#else
+class PeriodMonitor {
+public:
+    PeriodMonitor(const char*, uint32_t, uint32_t = 0) {}
+    void activated(void) {}
+    void restart(void) {}
+    const char* get_name(void) const { return ""; }
+    void get_stats(period_stats_t* copy) { *copy = period_stats_t(); } //nothing measured
+    void print_report(FileHandle*) {}
+};
+#endif
+
+#endif
@@ -0,0 +1,71 @@
+/*Stack budgets. The paint is written before the thread starts, so RTX only changes the bottom word (its magic word
+for the overflow check) and the top of the stack (the first context frame); everything the thread overwrites after
+that counts as used. The scan goes up from the bottom and stops at the first word that is not the paint: a few
+hundred reads, done only for a report or a check, never on a context switch.
+
+A word that the thread wrote with the paint value itself would count as unused, and the peak would look one word
+lower: the margin covers that too. */
+
+#include "stack_budget.h"
+#include "report_line.h"
+
+typedef struct {
+    const unsigned char* stack;
+    uint32_t size;
+    uint32_t peak;               //measured peak from "stack_sizes.h", 0 while measuring
+    const char* name;            //name of the peak macro
+} stack_budget_t;
+
+static stack_budget_t budgets[STACK_BUDGET_THREADS];
+static int budget_count = 0;
+
+void stack_budget_add(unsigned char* stack, uint32_t size, uint32_t peak, const char* name) {
+    uint32_t* word = (uint32_t*)stack;
+    for (uint32_t i = 0; i < size / 4; i++) word[i] = STACK_PAINT;
+    if (budget_count < STACK_BUDGET_THREADS) budgets[budget_count++] = {stack, size, peak, name};
+}
+
+uint32_t stack_budget_used(const unsigned char* stack, uint32_t size) {
+    const uint32_t* word = (const uint32_t*)stack;
+    uint32_t i = 1;              //word 0 is the magic word of RTX
+    while (i < size / 4 && word[i] == STACK_PAINT) i++;
+    return i < size / 4 ? size - i * 4 : 0;
+}
+
+bool stack_budget_check(FileHandle* out) {
+    bool ok = true;
+    for (int i = 0; i < budget_count && !STACK_MEASURE; i++) {
+        const stack_budget_t& b = budgets[i];
+        uint32_t used = stack_budget_used(b.stack, b.size);
+        if (used <= b.peak) continue;
+        print_line(out, "Stack budget: %s used %lu of %lu bytes, past its peak of %lu: measure again\n\r", b.name,
+                   (unsigned long)used, (unsigned long)b.size, (unsigned long)b.peak);
+        ok = false;
+    }
+    return ok;
+}
+
+void print_stack_report(FileHandle* out) {
+    uint32_t total = 0;
+    for (int i = 0; i < budget_count; i++) total += budgets[i].size;
+
+#if STACK_MEASURE
+    print_line(out, "Stack peaks for stack_sizes.h (%d threads, %lu bytes while measuring):\n\r", budget_count,
+               (unsigned long)total);
+    for (int i = 0; i < budget_count; i++) {
+        print_line(out, "#define %-24s %5lu\n\r", budgets[i].name,
+                   (unsigned long)stack_budget_used(budgets[i].stack, budgets[i].size));
+    }
+#else
+    print_line(out, "Stacks: %lu bytes for %d threads instead of %lu, margin %d %% (at least %d bytes)\n\r",
+               (unsigned long)total, budget_count, (unsigned long)budget_count * OS_STACK_SIZE, STACK_MARGIN_PERCENT,
+               STACK_MARGIN_MIN);
+    print_line(out, "  %-24s %6s %6s %6s\n\r", "", "USED", "PEAK", "SIZE");
+    for (int i = 0; i < budget_count; i++) {
+        const stack_budget_t& b = budgets[i];
+        uint32_t used = stack_budget_used(b.stack, b.size);
+        print_line(out, "  %-24s %6lu %6lu %6lu%s\n\r", b.name, (unsigned long)used, (unsigned long)b.peak,
+                   (unsigned long)b.size, used > b.peak ? "  past the peak" : "");
+    }
+#endif
+}
@@ -0,0 +1,49 @@
+/*Header file for stack sizes that come from a measurement instead of the OS_STACK_SIZE default. Each thread gets its
+stack from a static buffer, painted with a known word before the thread starts; the deepest word that no longer holds
+the paint is the peak use of the thread, however briefly it was reached:
+    BUDGETED_STACK(lcd_cont_stack, STACK_LCD_CONT);   //STACK_LCD_CONT: measured peak, from "stack_sizes.h"
+    Thread thread1(osPriorityNormal, sizeof(lcd_cont_stack), lcd_cont_stack, "LCD_cont");
+    STACK_BUDGET_ADD(lcd_cont_stack, STACK_LCD_CONT); //paints it: before thread1.start()
+The sizes are set in two steps:
+    1. STACK_MEASURE 1: every stack is STACK_MEASURE_SIZE bytes. The program runs a workload through all its paths
+       and print_stack_report() prints the peaks as #define lines.
+    2. Those lines go into "stack_sizes.h". With STACK_MEASURE 0 each stack is its peak plus the safety margin.
+stack_budget_check() is the startup check: a thread that goes past its peak means the code changed since the
+measurement (or the peak was only an estimate), and it eats into the margin. */
+
+#ifndef STACK_BUDGET_H
+#define STACK_BUDGET_H
+#include "mbed.h"
+
+#ifndef STACK_MEASURE
+#define STACK_MEASURE 0           //1: large painted stacks and a report of the peaks, to fill in "stack_sizes.h"
+#endif
+#ifndef STACK_MARGIN_PERCENT
+#define STACK_MARGIN_PERCENT 25   //safety margin over the measured peak
+#endif
+#define STACK_MARGIN_MIN    128   //bytes, at least: one exception frame with FPU state is 104
+#define STACK_MEASURE_SIZE  4096  //bytes per thread while measuring
+#define STACK_BUDGET_THREADS 8
+#define STACK_CHECK_MS      1000  //the startup check runs once the threads have been through their first round
+#define STACK_PAINT         0xCCCCCCCCu //the fill pattern of RTX (osRtxStackFillPattern)
+
+#define STACK_MARGIN(peak) ((peak) * STACK_MARGIN_PERCENT / 100 > STACK_MARGIN_MIN ? \
+                            (peak) * STACK_MARGIN_PERCENT / 100 : STACK_MARGIN_MIN)
+#if STACK_MEASURE
+#define STACK_SIZE(peak) STACK_MEASURE_SIZE
+#else
+#define STACK_SIZE(peak) (((peak) + STACK_MARGIN(peak) + 7) & ~7) //RTX wants a multiple of 8
+#endif
+
+//A static stack of the budgeted size, 8-byte aligned as RTX requires
+#define BUDGETED_STACK(name, peak) static unsigned char name[STACK_SIZE(peak)] __attribute__((aligned(8)))
+//Registers and paints a stack; the name of the peak macro is the name of its line in the report
+#define STACK_BUDGET_ADD(stack, peak) stack_budget_add(stack, sizeof(stack), peak, #peak)
+
+//Function Prototypes
+void stack_budget_add(unsigned char* stack, uint32_t size, uint32_t peak, const char* name); //before Thread::start()
+uint32_t stack_budget_used(const unsigned char* stack, uint32_t size); //bytes below the deepest overwritten word
+bool stack_budget_check(FileHandle* out);     //false (and a line per thread) if a thread went past its peak
+void print_stack_report(FileHandle* out);     //fits rtos_stats_add_report(); #define lines when STACK_MEASURE is 1
+
+#endif
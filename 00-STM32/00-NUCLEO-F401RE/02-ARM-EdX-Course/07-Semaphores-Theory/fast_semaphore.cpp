@@ -0,0 +1,30 @@
+/*Slow paths of FastSemaphore: the count has already been moved by the fast path, so these only block on, or hand a
+token to, the Semaphore of the waiters. A release() that finds a negative count gives exactly one token, and the
+thread that counted itself as waiting takes it, whether it is already blocked or about to block: the Semaphore keeps
+the token until then, so a wake-up cannot be lost between the atomic operation and the kernel call. */
+
+#include "fast_semaphore.h"
+
+void FastSemaphore::block(void) {
+    slow_paths.fetch_add(1, std::memory_order_relaxed);
+    waiters.acquire();
+}
+
+void FastSemaphore::wake(void) {
+    slow_paths.fetch_add(1, std::memory_order_relaxed);
+    waiters.release();
+}
+
+bool FastSemaphore::try_acquire_for(Kernel::Clock::duration_u32 rel_time) {
+    if (count.fetch_sub(1, std::memory_order_acquire) > 0) return true;
+    slow_paths.fetch_add(1, std::memory_order_relaxed);
+    if (waiters.try_acquire_for(rel_time)) return true;
+
+    //Timed out: leave the count of the waiters, unless a release() has already counted on this thread
+    int32_t c = count.load(std::memory_order_relaxed);
+    while (c < 0) {
+        if (count.compare_exchange_weak(c, c + 1, std::memory_order_relaxed)) return false;
+    }
+    waiters.acquire(); //that release() gives (or gave) its token to this thread
+    return true;
+}
@@ -0,0 +1,58 @@
+/*Header file for a counting semaphore and a mutex that only call the RTOS when a thread has to block or to be woken.
+The count lives in an atomic variable: while the resource is free, acquire() and release() are one atomic decrement
+or increment in the calling thread (LDREX/STREX on the Cortex-M4, no SVC, no kernel lock). A negative count is the
+number of threads blocked on a plain Semaphore with no tokens, which is only touched on those slow paths:
+    FastSemaphore one_slot(1);
+    one_slot.acquire();    //count 1 -> 0: free, no kernel call
+    one_slot.release();    //count 0 -> 1: nobody to wake, no kernel call
+release() may be called from an ISR, acquire() only from threads. FastMutex is not recursive and, unlike Mutex, has no
+priority inheritance: a low priority owner is not raised while a high priority thread waits for it. */
+
+#ifndef FAST_SEMAPHORE_H
+#define FAST_SEMAPHORE_H
+#include "mbed.h"
+#include <atomic>
+
+class FastSemaphore {
+public:
+    explicit FastSemaphore(int32_t count = 0) : count(count), waiters(0), slow_paths(0) {}
+
+    void acquire(void) {
+        if (count.fetch_sub(1, std::memory_order_acquire) > 0) return;
+        block();
+    }
+    bool try_acquire(void) {                    //never blocks, never calls the kernel
+        int32_t c = count.load(std::memory_order_relaxed);
+        while (c > 0) {
+            if (count.compare_exchange_weak(c, c - 1, std::memory_order_acquire)) return true;
+        }
+        return false;
+    }
+    bool try_acquire_for(Kernel::Clock::duration_u32 rel_time);
+    void release(void) {
+        if (count.fetch_add(1, std::memory_order_release) < 0) wake();
+    }
+    uint32_t kernel_calls(void) const { return slow_paths.load(std::memory_order_relaxed); } //blocked + woken
+
+private:
+    void block(void);
+    void wake(void);
+
+    std::atomic<int32_t> count;                 //> 0: free tokens, < 0: threads blocked
+    Semaphore waiters;                          //one token per woken thread
+    std::atomic<uint32_t> slow_paths;
+};
+
+class FastMutex {
+public:
+    FastMutex() : slot(1) {}
+    void lock(void) { slot.acquire(); }
+    bool trylock(void) { return slot.try_acquire(); }
+    void unlock(void) { slot.release(); }
+    uint32_t kernel_calls(void) const { return slot.kernel_calls(); }
+
+private:
+    FastSemaphore slot;
+};
+
+#endif
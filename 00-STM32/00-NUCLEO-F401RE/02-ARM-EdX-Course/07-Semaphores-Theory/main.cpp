@@ -1,14 +1,27 @@
 /*******************************************************************************************************************
  * Objective of the program: Theory on semaphores and threads within an RTOS environment. Prints to the PC.
  *******************************************************************************************************************
+ * Theory: every acquire() and release() of a Semaphore enters the RTOS kernel (an SVC exception and the kernel's own
+ bookkeeping), even when the semaphore is free and nobody waits. one_slot is a FastSemaphore ("fast_semaphore.h"): its
+ count is an atomic variable, so a free slot is taken and given back with a few LDREX/STREX instructions in the thread
+ itself, and the kernel is only called to block a thread or to wake one.
+
+ + With SEMAPHORE_BENCHMARK set to 1 the program first prints the cycles per operation of Semaphore, Mutex,
+ FastSemaphore and FastMutex, with nobody waiting and with two threads fighting for the object.
+ *******************************************************************************************************************
  * Author: Luciano Carricart, https://github.com/lcarricart/
  * Status: Information Engineering student at HAW Hamburg, Germany.
  * Profile: https://www.linkedin.com/in/lucianocarricart/
  *******************************************************************************************************************/
 
+#ifndef SEMAPHORE_BENCHMARK
+#define SEMAPHORE_BENCHMARK 0 //1: print the benchmark of "semaphore_benchmark.h" before the threads start
+#endif
 #include "mbed.h"
+#include "fast_semaphore.h"
+#include "semaphore_benchmark.h"
 
-Semaphore one_slot(1); // Create semaphore, named one_slot, one resource
+FastSemaphore one_slot(1); // Create semaphore, named one_slot, one resource; kernel calls only to block and to wake
 Thread t2;
 Thread t3;
 
@@ -25,6 +38,9 @@ void test_thread(void const* name)
 
 int main(void)
 {
+#if SEMAPHORE_BENCHMARK
+    run_semaphore_benchmark();
+#endif
     t2.start(callback(test_thread, (void*)"Th 2"));
     t3.start(callback(test_thread, (void*)"Th 3"));
     test_thread((void*)"Th 1");
@@ -0,0 +1,20 @@
+/*Header file for the benchmark of Semaphore and Mutex against FastSemaphore and FastMutex, in CPU cycles per
+operation (one acquire or one release), counted with the DWT cycle counter:
+    - uncontended: one thread acquires and releases in a loop, nobody waits;
+    - contended: two threads of the same priority acquire, yield while holding, and release, so every acquire of the
+      other thread blocks and every release wakes it (the cycles include the two context switches).
+On the host emulation the same code runs against the PC models of the kernel objects: the numbers show the same
+difference between kernel calls and atomics, at the speed of a PC. The table is aligned with printf field widths, so
+mbed_app.json selects the full printf ("target.printf_lib": "std") instead of the minimal one. */
+
+#ifndef SEMAPHORE_BENCHMARK_H
+#define SEMAPHORE_BENCHMARK_H
+#include "mbed.h"
+
+#define BENCHMARK_ROUNDS           10000 //acquire + release pairs, uncontended
+#define BENCHMARK_CONTENDED_ROUNDS 1000  //per thread, contended
+
+//Function Prototypes
+void run_semaphore_benchmark(void); //prints a table on the console, from a thread of normal priority
+
+#endif
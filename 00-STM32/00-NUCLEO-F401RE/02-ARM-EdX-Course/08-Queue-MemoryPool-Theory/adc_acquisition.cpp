@@ -0,0 +1,195 @@
+/*ADC acquisition stage. On the NUCLEO-F401RE: TIM2 overflows ADC_SCAN_RATE times per second and its trigger output
+(TRGO) starts a scan of ADC1 over channels 0 and 1 (A0, A1); DMA2 Stream0 moves every result into dma_buffer, in
+circular mode, and raises an interrupt at the half and at the end of the buffer. The mbed AnalogIn class cannot do
+this (it converts one channel when read() is called), so the STM32 HAL is used directly. Everything after the buffer
+(filters, scaling, time stamps) is the same code on every platform. */
+
+#include "adc_acquisition.h"
+#include "cic_decimator.h"
+
+#define BUFFER_SAMPLES    (2 * ADC_BLOCK_SCANS * ADC_CHANNELS)
+#define MV_PER_COUNT_Q16  52800  //3300 mV / 4096 counts, times 65536
+#define VOLTAGE_DIVIDER   1      //input voltage / voltage at A0
+#define CURRENT_ZERO_MV   1650   //current sensor output at 0 A (e.g. ACS712 at 3.3 V)
+#define CURRENT_MV_PER_A  185    //current sensor sensitivity
+
+static adc_publish_t publish_frame;
+static CicDecimator<ADC_DECIMATION> filters[ADC_CHANNELS];
+static uint64_t scans;           //scans processed since the start, the sample clock of the time stamps
+static uint32_t sequence;
+static adc_stats_t stats;
+static uint32_t busy_cycles, window_start; //CPU load over the current window of about one second
+
+void adc_block_ready(const uint16_t* block) {
+    uint32_t start = DWT->CYCCNT;
+    int32_t value[ADC_CHANNELS];
+
+    for (int s = 0; s < ADC_BLOCK_SCANS; s++) {
+        bool ready = false;
+        for (int c = 0; c < ADC_CHANNELS; c++) {
+            ready = filters[c].push(block[s * ADC_CHANNELS + c], &value[c]);
+        }
+        scans++;
+        if (!ready) continue;
+
+        //Scale once per frame, in fixed point: counts -> mV -> mA
+        adc_frame_t frame;
+        int32_t current_mv = (value[1] * MV_PER_COUNT_Q16) >> 16;
+        frame.millivolts = ((value[0] * MV_PER_COUNT_Q16) >> 16) * VOLTAGE_DIVIDER;
+        frame.milliamps = (current_mv - CURRENT_ZERO_MV) * 1000 / CURRENT_MV_PER_A;
+        frame.sequence = sequence++;
+        frame.timestamp_us = (uint32_t)(scans * 1000000 / ADC_SCAN_RATE);
+        publish_frame(&frame);
+        stats.frames++;
+    }
+    stats.blocks++;
+
+    uint32_t end = DWT->CYCCNT;
+    busy_cycles += end - start;
+    if (end - window_start >= SystemCoreClock) {
+        stats.cpu_permille = (uint32_t)((uint64_t)busy_cycles * 1000 / (end - window_start));
+        busy_cycles = 0;
+        window_start = end;
+    }
+}
+
+void get_acquisition_stats(adc_stats_t* copy) {
+    CriticalSectionLock lock;
+    *copy = stats;
+}
+
+static void start_cycle_count(void) {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    window_start = DWT->CYCCNT;
+}
+
+#if defined(TARGET_STM32F4)
+/*-------------------------------------------ADC + DMA------------------------------------------------------*/
+static ADC_HandleTypeDef hadc;
+static DMA_HandleTypeDef hdma;
+static TIM_HandleTypeDef htim;
+static uint16_t dma_buffer[BUFFER_SAMPLES];
+
+//The DMA counts down the samples left to the end of the buffer. When a half is done being processed, the DMA must
+//still be writing the other half; if it is back in this one, it overwrote samples we had not read yet.
+static void check_overrun(bool first_half) {
+    bool dma_in_first_half = __HAL_DMA_GET_COUNTER(&hdma) > BUFFER_SAMPLES / 2;
+    if (dma_in_first_half == first_half) stats.overruns++;
+}
+
+extern "C" void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef*) {
+    adc_block_ready(&dma_buffer[0]);
+    check_overrun(true);
+}
+
+extern "C" void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef*) {
+    adc_block_ready(&dma_buffer[BUFFER_SAMPLES / 2]);
+    check_overrun(false);
+}
+
+static void dma_irq_handler(void) {
+    HAL_DMA_IRQHandler(&hdma);
+}
+
+void start_acquisition(adc_publish_t publish) {
+    publish_frame = publish;
+    start_cycle_count();
+
+    __HAL_RCC_GPIOA_CLK_ENABLE();
+    __HAL_RCC_ADC1_CLK_ENABLE();
+    __HAL_RCC_DMA2_CLK_ENABLE();
+    __HAL_RCC_TIM2_CLK_ENABLE();
+
+    //PA0 (A0) and PA1 (A1) as analog inputs
+    GPIO_InitTypeDef gpio = {};
+    gpio.Pin = GPIO_PIN_0 | GPIO_PIN_1;
+    gpio.Mode = GPIO_MODE_ANALOG;
+    gpio.Pull = GPIO_NOPULL;
+    HAL_GPIO_Init(GPIOA, &gpio);
+
+    //DMA2 Stream0 Channel0 is wired to ADC1: 16-bit transfers into the buffer, round and round
+    hdma.Instance = DMA2_Stream0;
+    hdma.Init.Channel = DMA_CHANNEL_0;
+    hdma.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    hdma.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma.Init.MemInc = DMA_MINC_ENABLE;
+    hdma.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+    hdma.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+    hdma.Init.Mode = DMA_CIRCULAR;
+    hdma.Init.Priority = DMA_PRIORITY_HIGH;
+    hdma.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+    HAL_DMA_Init(&hdma);
+    __HAL_LINKDMA(&hadc, DMA_Handle, hdma);
+    NVIC_SetVector(DMA2_Stream0_IRQn, (uint32_t)&dma_irq_handler);
+    HAL_NVIC_SetPriority(DMA2_Stream0_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(DMA2_Stream0_IRQn);
+
+    //ADC1: one scan of both channels per TIM2 trigger, a DMA request after every conversion
+    hadc.Instance = ADC1;
+    hadc.Init.ClockPrescaler = ADC_CLOCK_SYNC_PCLK_DIV4;
+    hadc.Init.Resolution = ADC_RESOLUTION_12B;
+    hadc.Init.ScanConvMode = ENABLE;
+    hadc.Init.ContinuousConvMode = DISABLE;
+    hadc.Init.DiscontinuousConvMode = DISABLE;
+    hadc.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_RISING;
+    hadc.Init.ExternalTrigConv = ADC_EXTERNALTRIGCONV_T2_TRGO;
+    hadc.Init.DataAlign = ADC_DATAALIGN_RIGHT;
+    hadc.Init.NbrOfConversion = ADC_CHANNELS;
+    hadc.Init.DMAContinuousRequests = ENABLE;
+    hadc.Init.EOCSelection = ADC_EOC_SEQ_CONV;
+    HAL_ADC_Init(&hadc);
+
+    ADC_ChannelConfTypeDef channel = {};
+    channel.SamplingTime = ADC_SAMPLETIME_84CYCLES;
+    channel.Channel = ADC_CHANNEL_0;
+    channel.Rank = 1;
+    HAL_ADC_ConfigChannel(&hadc, &channel);
+    channel.Channel = ADC_CHANNEL_1;
+    channel.Rank = 2;
+    HAL_ADC_ConfigChannel(&hadc, &channel);
+
+    //TIM2 runs at twice PCLK1 when APB1 is divided (84 MHz on the F401), one update = one scan
+    uint32_t timer_clock = HAL_RCC_GetPCLK1Freq();
+    if ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_CFGR_PPRE1_DIV1) timer_clock *= 2;
+    htim.Instance = TIM2;
+    htim.Init.Prescaler = 0;
+    htim.Init.CounterMode = TIM_COUNTERMODE_UP;
+    htim.Init.Period = timer_clock / ADC_SCAN_RATE - 1;
+    htim.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+    HAL_TIM_Base_Init(&htim);
+    TIM_MasterConfigTypeDef master = {};
+    master.MasterOutputTrigger = TIM_TRGO_UPDATE;
+    master.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
+    HAL_TIMEx_MasterConfigSynchronization(&htim, &master);
+
+    HAL_ADC_Start_DMA(&hadc, (uint32_t*)dma_buffer, BUFFER_SAMPLES);
+    HAL_TIM_Base_Start(&htim);
+}
+
+#else
+/*-------------------------------------------Synthetic Source-----------------------------------------------*/
+//No ADC: a Ticker produces one block per block period, as the DMA would. Voltage: 2.5 Hz sine around 1.65 V;
+//current: 0.5 A at 1 Hz; both with a little noise, which the decimator should remove.
+#include <math.h>
+#include <stdlib.h>
+
+static Ticker block_clock;
+static uint16_t synthetic_buffer[BUFFER_SAMPLES / 2];
+
+static void synthetic_block(void) {
+    for (int s = 0; s < ADC_BLOCK_SCANS; s++) {
+        float t = (float)(scans + s) / ADC_SCAN_RATE;
+        float noise = (float)(rand() % 41 - 20);
+        synthetic_buffer[s * ADC_CHANNELS + 0] = (uint16_t)(2048 + 1200 * sinf(2 * 3.14159265f * 2.5f * t) + noise);
+        synthetic_buffer[s * ADC_CHANNELS + 1] = (uint16_t)(2048 + 115 * sinf(2 * 3.14159265f * 1.0f * t) + noise);
+    }
+    adc_block_ready(synthetic_buffer);
+}
+
+void start_acquisition(adc_publish_t publish) {
+    publish_frame = publish;
+    start_cycle_count();
+    block_clock.attach(&synthetic_block, std::chrono::microseconds(1000000LL * ADC_BLOCK_SCANS / ADC_SCAN_RATE));
+}
+#endif
@@ -0,0 +1,39 @@
+/*Header file for the ADC acquisition stage. The ADC scans ADC_CHANNELS inputs ADC_SCAN_RATE times per second, paced
+by a timer, and the DMA writes the results into a double buffer with no CPU involved. Every time one half is full an
+interrupt filters and decimates it (cic_decimator.h) while the DMA fills the other half. Every ADC_DECIMATION scans
+one frame per channel group is published, with a sequence number and the time of its last scan. Without an STM32F4
+(e.g. on a PC) a synthetic source fills the buffer with test signals instead. */
+
+#ifndef ADC_ACQUISITION_H
+#define ADC_ACQUISITION_H
+#include "mbed.h"
+
+#define ADC_CHANNELS      2     //A0: voltage, A1: current
+#define ADC_SCAN_RATE     5000  //scans per second, 10 kHz aggregate with 2 channels
+#define ADC_BLOCK_SCANS   64    //scans per half buffer, one interrupt each
+#define ADC_DECIMATION    512   //scans per published frame, ~10 frames per second
+
+//One decimated frame, already in physical units
+typedef struct {
+    int32_t millivolts;        //voltage input, after the divider
+    int32_t milliamps;         //current sensor, offset removed
+    uint32_t sequence;         //frame number, a gap means frames were lost
+    uint32_t timestamp_us;     //time of the last scan of the frame, counted by the sample clock
+} adc_frame_t;
+
+//Called in interrupt context with every new frame
+typedef void (*adc_publish_t)(const adc_frame_t* frame);
+
+typedef struct {
+    uint32_t blocks;           //half buffers processed
+    uint32_t frames;           //frames published
+    uint32_t overruns;         //half buffers the DMA rewrote before they were processed
+    uint32_t cpu_permille;     //CPU time of the processing interrupt, in 1/1000 of the elapsed time
+} adc_stats_t;
+
+//Function Prototypes
+void start_acquisition(adc_publish_t publish);
+void adc_block_ready(const uint16_t* block); //processes ADC_BLOCK_SCANS scans of ADC_CHANNELS samples each
+void get_acquisition_stats(adc_stats_t* stats);
+
+#endif
@@ -0,0 +1,42 @@
+/*Second order CIC (cascaded integrator-comb) decimator in integer arithmetic. It averages D samples twice over (a
+triangular window of 2D-1 samples), which removes the noise and everything that would fold back onto the output rate,
+and gives one output every D inputs. Per input it costs two additions; per output two subtractions and a shift, no
+multiplication. The integrators are allowed to overflow: the combs subtract the overflow away again, as long as
+32 bits hold input bits + 2*log2(D) (12-bit ADC: D up to 1024). No mbed dependency, so the PC can run it too. */
+
+#ifndef CIC_DECIMATOR_H
+#define CIC_DECIMATOR_H
+#include <stdint.h>
+
+template <uint32_t D>
+class CicDecimator {
+    static_assert(D >= 2 && (D & (D - 1)) == 0, "CIC decimation must be a power of two");
+
+public:
+    CicDecimator() : integrator1(0), integrator2(0), comb1(0), comb2(0), phase(0) {}
+
+    //Adds one sample. Every D samples returns true and writes the filtered value (same scale as the input) in *out.
+    bool push(uint32_t sample, int32_t* out) {
+        integrator1 += sample;
+        integrator2 += integrator1;
+        if (++phase < D) return false;
+        phase = 0;
+
+        uint32_t c1 = integrator2 - comb1;
+        comb1 = integrator2;
+        uint32_t c2 = c1 - comb2;
+        comb2 = c1;
+        *out = (int32_t)(c2 >> SHIFT); //the gain of the filter is D*D
+        return true;
+    }
+
+private:
+    static constexpr uint32_t log2_of(uint32_t n) { return n <= 1 ? 0 : 1 + log2_of(n >> 1); }
+    static const uint32_t SHIFT = 2 * log2_of(D);
+
+    uint32_t integrator1, integrator2; //run at the input rate
+    uint32_t comb1, comb2;             //previous values, at the output rate
+    uint32_t phase;
+};
+
+#endif
@@ -0,0 +1,56 @@
+#!/bin/sh
+# ARM code size report (runs on the PC): links the same three lines once with snprintf (newlib-nano, with and without
+# float support) and once with sfmt, for a Cortex-M4F like the F401, and prints the text/data/bss of each image.
+# Needs the GNU Arm Embedded toolchain (arm-none-eabi-g++) in the PATH. Run from this folder: sh code_size.sh
+set -e
+CXX=${CXX:-arm-none-eabi-g++}
+SIZE=${SIZE:-arm-none-eabi-size}
+FLAGS="-std=gnu++14 -Os -mcpu=cortex-m4 -mthumb -mfpu=fpv4-sp-d16 -mfloat-abi=hard -ffunction-sections -fdata-sections
+       -fno-exceptions -fno-rtti --specs=nano.specs --specs=nosys.specs -Wl,--gc-sections -I.."
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+cat > "$TMP/common.h" <<'END'
+#include <stdint.h>
+extern "C" void __attribute__((noinline)) emit(const char* text, int len) { asm volatile("" :: "r"(text), "r"(len) : "memory"); }
+volatile int32_t voltage = 12, current = 3;
+volatile uint32_t counter = 7;
+volatile float watts = 36.5f;
+END
+
+cat > "$TMP/with_printf.cpp" <<'END'
+#include <stdio.h>
+#include "common.h"
+int main() {
+    char line[48];
+    emit(line, snprintf(line, sizeof(line), "Voltage: %d V\n\r", (int)voltage));
+    emit(line, snprintf(line, sizeof(line), "Number of cycles: %u\n\r", (unsigned)counter));
+    emit(line, snprintf(line, sizeof(line), "Power: %.2f W\n\r", (double)watts));
+    return 0;
+}
+END
+
+cat > "$TMP/with_sfmt.cpp" <<'END'
+#include "static_format.h"
+#include "common.h"
+int main() {
+    char line[48];
+    emit(line, (int)sfmt::format_to(line, FMT("Voltage: %d V\n\r"), (int)voltage));
+    emit(line, (int)sfmt::format_to(line, FMT("Number of cycles: %u\n\r"), (unsigned)counter));
+    emit(line, (int)sfmt::format_to(line, FMT("Power: %.2f W\n\r"), (float)watts));
+    return 0;
+}
+END
+
+cat > "$TMP/empty.cpp" <<'END'
+#include "common.h"
+int main() { emit("", 0); return 0; }
+END
+
+cd "$TMP"
+$CXX $FLAGS empty.cpp -o empty.elf
+$CXX $FLAGS with_printf.cpp -o printf_nano.elf
+$CXX $FLAGS -u _printf_float with_printf.cpp -o printf_nano_float.elf
+$CXX $FLAGS with_sfmt.cpp -o sfmt.elf
+$SIZE empty.elf printf_nano.elf printf_nano_float.elf sfmt.elf
+echo "(printf_nano.elf prints no float; subtract empty.elf to get the cost of each formatter)"
@@ -0,0 +1,43 @@
+/*******************************************************************************************************************
+ * Host benchmark (runs on the PC, not on the board): time per call of sfmt::format_to() against snprintf() for the
+ kind of lines the projects print. Build and run from this folder:
+    g++ -std=c++14 -O2 -I.. format_benchmark.cpp -o format_benchmark && ./format_benchmark
+ *******************************************************************************************************************/
+
+#include "static_format.h"
+#include <chrono>
+#include <cstdio>
+
+static const int ITERATIONS = 2000000;
+static volatile int sink_value; // keeps the compiler from dropping the loops
+
+template <class Body>
+double ns_per_call(Body body) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ITERATIONS; i++) body(i);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / ITERATIONS;
+}
+
+int main() {
+    char buffer[64];
+
+    double int_sfmt = ns_per_call([&](int i) { sink_value = (int)sfmt::format_to(buffer, FMT("Voltage: %d V\n\r"), i * 3); });
+    double int_printf = ns_per_call([&](int i) { sink_value = snprintf(buffer, sizeof(buffer), "Voltage: %d V\n\r", i * 3); });
+
+    double mixed_sfmt = ns_per_call([&](int i) {
+        sink_value = (int)sfmt::format_to(buffer, FMT("#%u: %d V, %d A, %5.2f W"), (unsigned)i, i * 3, i * 2, i * 0.01f);
+    });
+    double mixed_printf = ns_per_call([&](int i) {
+        sink_value = snprintf(buffer, sizeof(buffer), "#%u: %d V, %d A, %5.2f W", (unsigned)i, i * 3, i * 2, i * 0.01f);
+    });
+
+    double fixed_sfmt = ns_per_call([&](int i) { sink_value = (int)sfmt::format_to(buffer, FMT("X = %.3f"), sfmt::q<16>(i)); });
+    double fixed_printf = ns_per_call([&](int i) { sink_value = snprintf(buffer, sizeof(buffer), "X = %.3f", i / 65536.0); });
+
+    printf("%-28s %10s %10s %8s\n", "format", "sfmt [ns]", "snprintf", "speedup");
+    printf("%-28s %10.1f %10.1f %7.1fx\n", "\"Voltage: %d V\"", int_sfmt, int_printf, int_printf / int_sfmt);
+    printf("%-28s %10.1f %10.1f %7.1fx\n", "\"#%u: %d V, %d A, %5.2f W\"", mixed_sfmt, mixed_printf, mixed_printf / mixed_sfmt);
+    printf("%-28s %10.1f %10.1f %7.1fx\n", "\"X = %.3f\" (Q16.16)", fixed_sfmt, fixed_printf, fixed_printf / fixed_sfmt);
+    return 0;
+}
@@ -0,0 +1,155 @@
+/*******************************************************************************************************************
+ * Host benchmark (runs on the PC, not on the board): one std::thread produces message_t and another consumes them,
+ through SpscRing and through the PC equivalent of MemoryPool + Queue (a pool and a queue of pointers, each protected
+ by a mutex, with a condition variable to block on). Prints messages per second and time/cycles per message.
+ Build and run from this folder:
+    g++ -std=c++14 -O2 -pthread -I.. ring_benchmark.cpp -o ring_benchmark && ./ring_benchmark
+ *******************************************************************************************************************/
+
+#include "spsc_ring.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+static const uint32_t MESSAGES = 5000000;
+
+typedef struct {
+    int voltage;
+    int current;
+    uint32_t counter;
+} message_t;
+
+static uint64_t cycles_now() {
+#ifdef HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+//---- MemoryPool + Queue, as the RTOS does it: two locked objects, a pointer per message ----//
+template <typename T, uint32_t N>
+class LockedPool {
+public:
+    LockedPool() : free_count(N) { for (uint32_t i = 0; i < N; i++) free_list[i] = &blocks[i]; }
+    T* try_alloc() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return free_count ? free_list[--free_count] : nullptr;
+    }
+    void free(T* block) {
+        std::lock_guard<std::mutex> lock(mutex);
+        free_list[free_count++] = block;
+    }
+private:
+    std::mutex mutex;
+    T blocks[N];
+    T* free_list[N];
+    uint32_t free_count;
+};
+
+template <typename T, uint32_t N>
+class LockedQueue {
+public:
+    bool try_put(T* item) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (count == N) return false;
+        items[(first + count++) % N] = item;
+        not_empty.notify_one();
+        return true;
+    }
+    T* get() { // blocks like queue.get(osWaitForever)
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [this] { return count != 0; });
+        T* item = items[first];
+        first = (first + 1) % N;
+        count--;
+        return item;
+    }
+private:
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    T* items[N];
+    uint32_t first = 0, count = 0;
+};
+
+struct result_t {
+    double seconds;
+    uint64_t cycles;
+};
+
+template <class Producer, class Consumer>
+static result_t run(Producer producer, Consumer consumer) {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t start_cycles = cycles_now();
+    std::thread thread(producer);
+    consumer();
+    thread.join();
+    uint64_t cycles = cycles_now() - start_cycles;
+    return { std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), cycles };
+}
+
+static void report(const char* name, result_t r, uint32_t checksum_errors) {
+    printf("%-22s %8.2f M msg/s %8.1f ns/msg", name, MESSAGES / r.seconds / 1e6, r.seconds * 1e9 / MESSAGES);
+#ifdef HAVE_TSC
+    printf(" %8.1f cycles/msg", (double)r.cycles / MESSAGES);
+#endif
+    printf("%s\n", checksum_errors ? "  (ORDER ERRORS)" : "");
+}
+
+int main() {
+    static SpscRing<message_t, 16> ring;
+    static LockedPool<message_t, 16> pool;
+    static LockedQueue<message_t, 16> queue;
+    uint32_t errors;
+
+    errors = 0;
+    result_t locked = run(
+        [] {
+            for (uint32_t i = 0; i < MESSAGES; i++) {
+                message_t* message;
+                while ((message = pool.try_alloc()) == nullptr) std::this_thread::yield();
+                message->voltage = i * 3;
+                message->current = i * 2;
+                message->counter = i;
+                while (!queue.try_put(message)) std::this_thread::yield();
+            }
+        },
+        [&] {
+            for (uint32_t i = 0; i < MESSAGES; i++) {
+                message_t* message = queue.get();
+                if (message->counter != i) errors++;
+                pool.free(message);
+            }
+        });
+    report("MemoryPool+Queue", locked, errors);
+
+    errors = 0;
+    result_t lock_free = run(
+        [] {
+            for (uint32_t i = 0; i < MESSAGES; i++) {
+                message_t* message;
+                while ((message = ring.reserve()) == nullptr) std::this_thread::yield();
+                message->voltage = i * 3;
+                message->current = i * 2;
+                message->counter = i;
+                ring.commit();
+            }
+        },
+        [&] {
+            for (uint32_t i = 0; i < MESSAGES; i++) {
+                message_t* message;
+                while ((message = ring.peek()) == nullptr) std::this_thread::yield();
+                if (message->counter != i) errors++;
+                ring.release();
+            }
+        });
+    report("SpscRing", lock_free, errors);
+
+    printf("speedup: %.1fx\n", locked.seconds / lock_free.seconds);
+}
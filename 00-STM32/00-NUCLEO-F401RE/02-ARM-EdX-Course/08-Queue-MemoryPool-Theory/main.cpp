@@ -1,4 +1,4 @@
-﻿﻿/*****************************************************************************************************************
+﻿/*****************************************************************************************************************
  * Objective of the program: Theory on Queues and Memory Pool within an RTOS environment. Prints on the PC.
  *******************************************************************************************************************
  * Theory: A queue is like a global array, but with improved mechanisms to be used effectively in thread-communication.
@@ -17,6 +17,48 @@
  default). I’m not sure but this could be the case when building with the online compiler. If your application requires 
  more advanced functionality (at the cost of using more flash memory) you can switch to the standard printf library 
  configuring it in mbed_app.json file by overriding the parameter target.printf_lib with the value std.
+
+ + A third way is "static_format.h": the format string is checked and broken down by the compiler (FMT("...")), so
+ each call only contains the steps it needs. It prints floats and fixed point values with %f, is type-safe (a wrong
+ argument is a compile error) and takes less flash and time than printf (see host/format_benchmark.cpp and
+ host/code_size.sh).
+
+ + MemoryPool + Queue cost two kernel objects, two kernel calls and a pointer per message, and they only work between
+ threads. "spsc_ring.h" is a lock-free ring for one producer and one consumer that stores the messages inside it:
+ the producer fills a slot in place (reserve, write, commit) and the consumer reads it in place (peek, release),
+ without any kernel call. Since nothing can block, the producer can be an interrupt: here a Ticker samples once per
+ second and no sending thread is needed. USE_SPSC_RING selects the path, RING_BENCHMARK=1 measures both (cycles per
+ message, in one thread and between two threads) and host/ring_benchmark.cpp does the same on a PC.
+
+ + Backpressure: if the consumer is slower than the producer (e.g. blocked in printf), the pool runs out sooner or
+ later. try_alloc() then returns nullptr and try_put() fails, and both must be handled or the program crashes or
+ leaks blocks. "message_channel.h" wraps the pool and the queue and applies a policy: block with a timeout, drop the
+ newest message, overwrite the oldest one, or drop and tell the consumer how many were lost. It also keeps metrics
+ (pool high-water mark, queue depth, drops, allocation failures). BACKPRESSURE_STRESS=1 runs every policy against a
+ consumer 20 times slower than the producer and prints the metrics.
+
+ + Batching: a consumer that wakes up for every message pays two context switches per message, which at high sample
+ rates costs more than the work itself. receive_batch() waits until a batch is ready (the size adapts to the rate,
+ and a timeout bounds the latency), takes up to CONSUMER_BATCH messages at once and free_batch() returns them
+ together. BATCH_BENCHMARK=1 compares both loops at 50 kHz: wakeups and CPU cycles per 1000 messages.
+
+ + Real samples instead of i*3 and i*2: "adc_acquisition.h" lets a timer start a scan of A0 (voltage) and A1 (current)
+ 5000 times per second while the DMA stores the results into a double buffer. Each time half of the buffer is full, an
+ interrupt runs a CIC filter over it (cic_decimator.h, only additions and a shift) and every 512 scans publishes a
+ message with the averaged values in mV and mA, a sequence number and the time of the sample. The CPU time of that
+ interrupt is measured and printed with the statistics. USE_ADC_ACQUISITION selects it; on a PC it reads a synthetic
+ signal instead (host/acquisition_benchmark.cpp measures the filter on its own).
+
+ + Sending every message over the UART is wasteful when mostly the trend matters. With USE_AGGREGATOR=1 the consumer
+ passes the messages through "stream_stats.h": per window of AGG_WINDOW messages it prints one summary (min, max, mean,
+ standard deviation and percentiles, each sample added in constant time and memory), and a raw message only when a
+ value leaves or re-enters its allowed range. AGG_HOP = AGG_WINDOW gives tumbling windows, a smaller hop sliding ones.
+
+ + A MemoryPool only holds one type. "slab_allocator.h" keeps several static pools of different block sizes (size
+ classes) behind slab_alloc(size)/slab_free(), for messages of any size without malloc, in constant time and from
+ interrupts too. It counts per class the blocks in use, the peak and the bytes wasted inside the blocks. SlabPool has
+ the interface of MemoryPool, so with USE_SLAB_ALLOCATOR=1 the message channel takes its blocks from the slabs, and
+ the slab statistics are printed every HEALTH_EVERY messages.
  *******************************************************************************************************************
  * Author: Luciano Carricart, https://github.com/lcarricart/
  * Status: Information Engineering student at HAW Hamburg, Germany.
@@ -24,57 +66,420 @@
  *******************************************************************************************************************/
 
 #include "mbed.h"
+#include "static_format.h"
+#include "spsc_ring.h"
+#include "message_channel.h"
+#include "slab_allocator.h"
+#include "adc_acquisition.h"
+#include "stream_stats.h"
 
-// Define a structure for the message with three variables.
+#define USE_SPSC_RING   1   // 1: messages go through the lock-free ring, 0: through MemoryPool + Queue
+#define RING_BENCHMARK  0   // 1: measure both paths instead of running the example
+#define BACKPRESSURE_STRESS 0 // 1: run every backpressure policy against a slow consumer
+#define BACKPRESSURE_POLICY DROP_AND_COUNT // what send_thread does when the consumer falls behind
+#define USE_SLAB_ALLOCATOR 1 // 1: the message blocks come from the slab allocator, 0: from a MemoryPool
+#define CONSUMER_BATCH  8    // messages taken per wakeup, 1: one at a time
+#define BATCH_MAX_WAIT  100ms // longest a message waits for its batch to fill
+#define BATCH_BENCHMARK 0    // 1: compare the one-at-a-time and the batched consumer
+#define USE_ADC_ACQUISITION 1 // 1: messages come from the ADC (DMA + filter), 0: simulated values
+#define USE_AGGREGATOR  1    // 1: print window summaries and limit crossings, 0: print every message
+#define AGG_WINDOW      50   // messages per window (5 s of ADC frames)
+#define AGG_HOP         50   // messages between summaries: AGG_WINDOW for tumbling windows, less for sliding ones
+#define HEALTH_EVERY    100  // messages between two prints of the ADC and allocator state
+#define DATA_FLAG       0x01 // thread flag: new messages in the ring
+
+// Define a structure for the message with four variables.
 typedef struct {
-    int voltage;    /* AD result of measured voltage */
-    int current;    /* AD result of measured current */
-    uint32_t counter; /* A counter value */
+    int voltage;    /* AD result of measured voltage, in mV */
+    int current;    /* AD result of measured current, in mA */
+    uint32_t counter; /* A counter value (sequence number) */
+    uint32_t timestamp_us; /* Time of the measurement */
 } message_t;
 
-// Create a memory pool and a queue to manage message_t objects.
-MemoryPool<message_t, 16> mpool;
-Queue<message_t, 16> queue;
+// Memory pool and queue of message_t objects, with a policy for when the pool runs out.
+#if USE_SLAB_ALLOCATOR
+MessageChannel<message_t, 16, SlabPool> channel(BACKPRESSURE_POLICY);
+#else
+MessageChannel<message_t, 16> channel(BACKPRESSURE_POLICY);
+#endif
 Thread thread;
 
+// The ring stores the messages themselves, the consumer thread is woken up with DATA_FLAG.
+SpscRing<message_t, 16> ring;
+osThreadId_t consumer_id;
+Ticker sampler;
+
 // Thread function that simulates sending data.
 void send_thread(void) {
     uint32_t i = 0;
     while (true) {
         i++; // Simulated data update, e.g. reading from an ADC
 
-        // Allocate a message from the memory pool.
+        // Copy the message into a block of the pool and place it at the end of the queue. If the consumer is
+        // behind, the policy of the channel decides (and counts) what happens, so the result can be ignored here.
+        message_t message = { (int)i * 3, (int)i * 2, i, us_ticker_read() };
+        channel.send(message);
+
+        // Sleep for 1000 ms before sending the next message.
+        ThisThread::sleep_for(1000ms);
+    }
+}
+
+// Interrupt (Ticker) that simulates sampling straight into the ring, no thread is needed to produce.
+void sample_isr(void) {
+    static uint32_t i = 0;
+    i++; // Simulated data update, e.g. reading from an ADC
+
+    // Fill the next free slot in place. If the consumer fell 16 messages behind the sample is lost.
+    message_t* message = ring.reserve();
+    if (message == nullptr) return;
+    message->voltage = i * 3;
+    message->current = i * 2;
+    message->counter = i;
+    message->timestamp_us = us_ticker_read();
+    ring.commit();
+
+    osThreadFlagsSet(consumer_id, DATA_FLAG); // Allowed in interrupts
+}
+
+// Called by the acquisition interrupt with every decimated frame: hand it over to the consumer.
+void publish_frame(const adc_frame_t* frame) {
+    message_t message = { (int)frame->millivolts, (int)frame->milliamps, frame->sequence, frame->timestamp_us };
+#if USE_SPSC_RING
+    if (ring.try_push(message)) osThreadFlagsSet(consumer_id, DATA_FLAG);
+#else
+    channel.send(message);
+#endif
+}
+
+void print_message(FileHandle* pc, const message_t* message) {
+    sfmt::print(*pc, FMT("\nVoltage: %d mV\n\r"), message->voltage);
+    sfmt::print(*pc, FMT("Current: %d mA\n\r"), message->current);
+    sfmt::print(*pc, FMT("Number of cycles: %u (t = %u ms)\n\r"), message->counter, message->timestamp_us / 1000);
+}
+
+// Every HEALTH_EVERY messages: state of the acquisition and of the allocator
+void print_health(FileHandle* pc) {
+#if USE_ADC_ACQUISITION
+    adc_stats_t adc;
+    get_acquisition_stats(&adc);
+    sfmt::print(*pc, FMT("\nADC: %u blocks, %u frames, %u overruns, CPU %u.%u %%\n\r"), adc.blocks, adc.frames,
+                adc.overruns, adc.cpu_permille / 10, adc.cpu_permille % 10);
+#endif
+#if USE_SLAB_ALLOCATOR && !USE_SPSC_RING
+    slab_print_stats(pc);
+#endif
+}
+
+// The DWT cycle counter of the Cortex-M4 counts CPU clock cycles (used by the benchmarks)
+void start_cycle_counter(void) {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/*----------------------------------------Aggregation------------------------------------------------------*/
+#if USE_AGGREGATOR
+StreamWindow<AGG_WINDOW> voltage_window(AGG_HOP, 0, 3300);     // percentiles in 32 bins of 104 mV
+StreamWindow<AGG_WINDOW> current_window(AGG_HOP, -2000, 2000); // percentiles in 32 bins of 125 mA
+ThresholdDetector voltage_limits(800, 2500, 50);                // allowed range in mV, 50 mV hysteresis
+ThresholdDetector current_limits(-400, 400, 20);                // allowed range in mA, 20 mA hysteresis
+
+void print_summary(FileHandle* pc, const char* name, const window_summary_t* s, const message_t* last) {
+    sfmt::print(*pc, FMT("\n%s, %u messages up to #%u: min %d, max %d, mean %.1f, sd %.1f\n\r"), name, s->count,
+                last->counter, s->min, s->max, s->mean, s->stddev);
+    sfmt::print(*pc, FMT("  p50 %d, p90 %d, p99 %d\n\r"), s->p50, s->p90, s->p99);
+}
+#endif
+
+// What the consumer does with each message: print it, or aggregate it and print only what matters
+void consume(FileHandle* pc, const message_t* message) {
+#if USE_AGGREGATOR
+    window_summary_t summary;
+    bool voltage_crossed = voltage_limits.crossed(message->voltage);
+    bool current_crossed = current_limits.crossed(message->current);
+    if (voltage_crossed || current_crossed) {
+        bool outside = voltage_limits.is_outside() || current_limits.is_outside();
+        sfmt::print(*pc, FMT("\nLimit %s:"), outside ? "exceeded" : "back in range");
+        print_message(pc, message);
+    }
+    if (voltage_window.add(message->voltage, &summary)) print_summary(pc, "Voltage [mV]", &summary, message);
+    if (current_window.add(message->current, &summary)) print_summary(pc, "Current [mA]", &summary, message);
+#else
+    print_message(pc, message);
+#endif
+}
+
+/*----------------------------------------Stress Test------------------------------------------------------*/
+#if BACKPRESSURE_STRESS
+#define STRESS_TIME     2s
+#define SLOW_CONSUMER   20ms // time the consumer needs per message, 20 times the producer period
+
+void print_metrics(FileHandle* pc, const char* name, uint32_t received, uint32_t reported_lost) {
+    channel_metrics_t m;
+    channel.get_metrics(&m);
+    sfmt::print(*pc, FMT("%-18s %5u %5u %5u %5u %5u %3u/16 %3u/16 %5u\n\r"), name, m.sent, received, m.drops,
+                m.overwritten, m.alloc_failures, m.pool_high_water, m.queue_high_water, reported_lost);
+}
+
+// The producer runs at its full rate and at a higher priority, so the slow consumer cannot slow it down.
+void stress_producer(void) {
+    uint32_t i = 0;
+    while (true) {
+        i++;
+        message_t message = { (int)i * 3, (int)i * 2, i, us_ticker_read() };
+        channel.send(message);
+        ThisThread::sleep_for(1ms);
+    }
+}
+
+void backpressure_stress(FileHandle* pc) {
+    static const backpressure_t policies[] = { BLOCK_WITH_TIMEOUT, DROP_NEWEST, OVERWRITE_OLDEST, DROP_AND_COUNT };
+    static const char* const names[] = { "block (10 ms)", "drop newest", "overwrite oldest", "drop and count" };
+    Thread producer(osPriorityAboveNormal, 1024);
+
+    sfmt::print(*pc, FMT("\n%-18s %5s %5s %5s %5s %5s %6s %6s %5s\n\r"), "policy", "sent", "recv", "drops", "overw",
+                "afail", "pool", "queue", "lost");
+    producer.start(callback(stress_producer));
+    for (int p = 0; p < 4; p++) {
+        channel.set_policy(policies[p]);
+        channel.reset_metrics();
+        uint32_t received = 0, reported_lost = 0;
+        Kernel::Clock::time_point end = Kernel::Clock::now() + STRESS_TIME;
+        while (Kernel::Clock::now() < end) {
+            uint32_t lost;
+            message_t* message = channel.receive(&lost);
+            ThisThread::sleep_for(SLOW_CONSUMER); // e.g. printf waiting for the UART
+            channel.free(message);
+            received++;
+            reported_lost += lost;
+        }
+        print_metrics(pc, names[p], received, reported_lost);
+    }
+    producer.terminate();
+}
+#endif
+
+/*-------------------------------------------Benchmark-----------------------------------------------------*/
+#if RING_BENCHMARK
+#define BENCH_MESSAGES 10000
+
+// Plain memory pool and queue, to compare the RTOS objects themselves with the ring
+MemoryPool<message_t, 16> mpool;
+Queue<message_t, 16> queue;
+
+// One thread sends and receives each message: the cost of the mechanism itself, no context switch
+uint32_t bench_queue_single(void) {
+    uint32_t start = DWT->CYCCNT;
+    for (uint32_t i = 0; i < BENCH_MESSAGES; i++) {
         message_t* message = mpool.try_alloc();
-        message->voltage = i * 3;
-        message->current = i * 2;
         message->counter = i;
-
-        // Place the message at the end of the queue.
         queue.try_put(message);
+        queue.try_get(&message);
+        mpool.free(message);
+    }
+    return DWT->CYCCNT - start;
+}
 
-        // Sleep for 1000 ms before sending the next message.
-        ThisThread::sleep_for(1000ms);
+uint32_t bench_ring_single(void) {
+    uint32_t start = DWT->CYCCNT;
+    for (uint32_t i = 0; i < BENCH_MESSAGES; i++) {
+        ring.reserve()->counter = i;
+        ring.commit();
+        volatile uint32_t counter = ring.peek()->counter;
+        (void)counter;
+        ring.release();
+    }
+    return DWT->CYCCNT - start;
+}
+
+// A producer thread sends as fast as it can while this thread receives (and blocks when there is nothing)
+void queue_producer(void) {
+    for (uint32_t i = 0; i < BENCH_MESSAGES; i++) {
+        message_t* message;
+        while ((message = mpool.try_alloc()) == nullptr) ThisThread::yield();
+        message->counter = i;
+        while (!queue.try_put(message)) ThisThread::yield();
+    }
+}
+
+void ring_producer(void) {
+    for (uint32_t i = 0; i < BENCH_MESSAGES; i++) {
+        message_t* message;
+        while ((message = ring.reserve()) == nullptr) ThisThread::yield();
+        message->counter = i;
+        ring.commit();
+        osThreadFlagsSet(consumer_id, DATA_FLAG);
+    }
+}
+
+uint32_t bench_queue_threads(void) {
+    Thread producer(osPriorityNormal, 1024);
+    uint32_t start = DWT->CYCCNT;
+    producer.start(callback(queue_producer));
+    for (uint32_t received = 0; received < BENCH_MESSAGES; received++) {
+        message_t* message;
+        queue.try_get_for(Kernel::wait_for_u32_forever, &message);
+        mpool.free(message);
+    }
+    uint32_t cycles = DWT->CYCCNT - start;
+    producer.join();
+    return cycles;
+}
+
+uint32_t bench_ring_threads(void) {
+    Thread producer(osPriorityNormal, 1024);
+    uint32_t start = DWT->CYCCNT;
+    producer.start(callback(ring_producer));
+    for (uint32_t received = 0; received < BENCH_MESSAGES; received++) {
+        while (ring.peek() == nullptr) ThisThread::flags_wait_any(DATA_FLAG);
+        ring.release();
+    }
+    uint32_t cycles = DWT->CYCCNT - start;
+    producer.join();
+    return cycles;
+}
+
+void report(FileHandle* pc, const char* name, uint32_t cycles) {
+    uint32_t per_message = cycles / BENCH_MESSAGES;
+    sfmt::print(*pc, FMT("%-24s %6u cycles/msg %8u msg/s\n\r"), name, per_message, SystemCoreClock / per_message);
+}
+
+void ring_benchmark(FileHandle* pc) {
+    consumer_id = ThisThread::get_id();
+    start_cycle_counter();
+    sfmt::print(*pc, FMT("\n%u messages, core clock %u Hz\n\r"), BENCH_MESSAGES, SystemCoreClock);
+    report(pc, "MemoryPool+Queue, 1 thd", bench_queue_single());
+    report(pc, "SpscRing, 1 thread", bench_ring_single());
+    report(pc, "MemoryPool+Queue, 2 thd", bench_queue_threads());
+    report(pc, "SpscRing, 2 threads", bench_ring_threads());
+}
+#endif
+
+/*----------------------------------------Batch Benchmark--------------------------------------------------*/
+#if BATCH_BENCHMARK
+#define BATCH_MESSAGES  1000
+#define SAMPLE_PERIOD   20us // 50 kHz
+
+Ticker fast_sampler;
+volatile uint32_t produced;
+volatile uint32_t idle_cycles;
+
+// Interrupt producer at 50 kHz. A message the channel cannot take is sent again at the next tick, so all arrive.
+void fast_sample_isr(void) {
+    message_t message = { (int)produced * 3, (int)produced * 2, produced, us_ticker_read() };
+    if (channel.send(message) && ++produced == BATCH_MESSAGES) fast_sampler.detach();
+}
+
+// Idle hook: back-to-back calls mean the CPU had nothing to do in between, a gap means some thread or ISR ran
+void count_idle(void) {
+    static uint32_t last;
+    uint32_t now = DWT->CYCCNT;
+    if (now - last < 200) idle_cycles += now - last;
+    last = now;
+}
+
+void process(const message_t* message) { // The work per message: format it, as the example does
+    char line[48];
+    sfmt::format_to(line, FMT("%d V, %d A, #%u"), message->voltage, message->current, message->counter);
+}
+
+void run_batch_test(FileHandle* pc, const char* name, uint32_t batch_size) {
+    message_t* batch[CONSUMER_BATCH];
+    channel_metrics_t m;
+    channel.reset_metrics();
+    produced = 0;
+    ThisThread::sleep_for(10ms); // let the UART drain before measuring
+
+    uint32_t start = DWT->CYCCNT, idle_start = idle_cycles;
+    fast_sampler.attach(&fast_sample_isr, SAMPLE_PERIOD);
+    for (uint32_t received = 0; received < BATCH_MESSAGES;) {
+        uint32_t n;
+        if (batch_size == 1) {
+            batch[0] = channel.receive();
+            n = 1;
+        } else {
+            n = channel.receive_batch(batch, batch_size, 1ms);
+        }
+        for (uint32_t i = 0; i < n; i++) process(batch[i]);
+        channel.free_batch(batch, n);
+        received += n;
     }
+    uint32_t busy = (DWT->CYCCNT - start) - (idle_cycles - idle_start);
+
+    channel.get_metrics(&m);
+    sfmt::print(*pc, FMT("%-16s %8u %12u %10u %10u\n\r"), name, m.wakeups, 2 * m.wakeups, busy,
+                (uint32_t)((uint64_t)SystemCoreClock * BATCH_MESSAGES / busy));
+}
+
+void batch_benchmark(FileHandle* pc) {
+    start_cycle_counter();
+    rtos_attach_idle_hook(&count_idle);
+    channel.set_policy(DROP_NEWEST);
+    sfmt::print(*pc, FMT("\nPer %u messages at 50 kHz (cycles include the producer interrupt)\n\r"), BATCH_MESSAGES);
+    sfmt::print(*pc, FMT("%-16s %8s %12s %10s %10s\n\r"), "consumer", "wakeups", "ctx switches", "CPU cycles",
+                "max msg/s");
+    run_batch_test(pc, "one at a time", 1);
+    run_batch_test(pc, "batched", CONSUMER_BATCH);
+    channel.set_policy(BACKPRESSURE_POLICY);
 }
+#endif
 
+/*----------------------------------------Main Function-----------------------------------------------------*/
 int main(void) {
+    FileHandle* pc = mbed_file_handle(STDOUT_FILENO); // Same UART as printf
+
+#if RING_BENCHMARK
+    ring_benchmark(pc);
+    while (true) ThisThread::sleep_for(1s);
+#endif
+#if BACKPRESSURE_STRESS
+    backpressure_stress(pc);
+    while (true) ThisThread::sleep_for(1s);
+#endif
+#if BATCH_BENCHMARK
+    batch_benchmark(pc);
+    while (true) ThisThread::sleep_for(1s);
+#endif
+
+    uint32_t message_count = 0;
+    consumer_id = ThisThread::get_id();
+#if USE_ADC_ACQUISITION
+    // Start the acquisition: the DMA interrupt publishes about 10 messages per second.
+    start_acquisition(&publish_frame);
+#elif USE_SPSC_RING
+    // Start sampling: the Ticker interrupt fills the ring once per second.
+    sampler.attach(&sample_isr, 1s);
+#else
     // Start the send_thread.
     thread.start(callback(send_thread));
+#endif
 
-    // Main loop: receive messages from the queue.
+#if USE_SPSC_RING
+    // Main loop: wait for the flag, then take everything that is in the ring.
     while (true) {
-        osEvent evt = queue.get(osWaitForever);
-        if (evt.status == osEventMessage) {
-            // Retrieve the message from the queue.
-            message_t* message = (message_t*)evt.value.p;
-
-            // Print the message data.
-            printf("\nVoltage: %d V\n\r", message->voltage);
-            printf("Current: %d A\n\r", message->current);
-            printf("Number of cycles: %u\n\r", message->counter);
-
-            // Free the message back to the memory pool.
-            mpool.free(message);
+        ThisThread::flags_wait_any(DATA_FLAG);
+        message_t* message;
+        while ((message = ring.peek()) != nullptr) {
+            consume(pc, message);       // Used in place, no copy
+            ring.release();             // The slot goes back to the producer
+            if (++message_count % HEALTH_EVERY == 0) print_health(pc);
         }
     }
+#else
+    // Main loop: receive messages from the queue, up to CONSUMER_BATCH per wakeup.
+    while (true) {
+        message_t* batch[CONSUMER_BATCH];
+        uint32_t lost;
+        uint32_t n = channel.receive_batch(batch, CONSUMER_BATCH, BATCH_MAX_WAIT, &lost);
+
+        // Print the message data, and the gap if the producer had to drop some before them.
+        if (lost > 0) sfmt::print(*pc, FMT("\n(%u messages lost)\n\r"), lost);
+        for (uint32_t i = 0; i < n; i++) consume(pc, batch[i]);
+
+        // Free the messages back to the memory pool, all at once.
+        channel.free_batch(batch, n);
+        if ((message_count += n) % HEALTH_EVERY < n) print_health(pc);
+    }
+#endif
 }
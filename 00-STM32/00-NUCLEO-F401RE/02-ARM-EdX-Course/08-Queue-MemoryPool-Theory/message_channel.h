@@ -0,0 +1,212 @@
+/*MemoryPool + Queue with backpressure: what the producer does when the consumer is too slow and the pool runs out.
+Without it, try_alloc() returns nullptr and the producer writes through it (crash), or try_put() fails and the block
+is never freed (leak). The policy decides instead:
+
+    BLOCK_WITH_TIMEOUT  wait up to "timeout" for a free block / queue place, then drop the message (threads only)
+    DROP_NEWEST         drop the new message at once, send() returns false so the caller can react
+    OVERWRITE_OLDEST    take the oldest message back from the queue and reuse its block for the new one
+    DROP_AND_COUNT      drop the new message at once and tell the consumer how many were lost before the next one
+
+Every policy but BLOCK_WITH_TIMEOUT never waits, so send() may then be called from an interrupt. The metrics are
+updated on every call and can be read at any time with get_metrics(). The blocks come from a MemoryPool unless another
+pool with the same interface is given, e.g. MessageChannel<message_t, 16, SlabPool> (see slab_allocator.h).
+
+receive() wakes the consumer up for every message. receive_batch() waits until "wake threshold" messages are queued
+(or until the oldest one waited "max_wait") and takes them all at once, so at high rates the consumer wakes up once
+per batch instead of once per message. The threshold adapts to the rate: it doubles while batches fill up before
+max_wait, and drops to the size of the last batch when max_wait runs out, so at low rates the latency stays bounded. */
+
+#ifndef MESSAGE_CHANNEL_H
+#define MESSAGE_CHANNEL_H
+#include "mbed.h"
+
+typedef enum {
+    BLOCK_WITH_TIMEOUT,
+    DROP_NEWEST,
+    OVERWRITE_OLDEST,
+    DROP_AND_COUNT
+} backpressure_t;
+
+//Health of a channel
+typedef struct {
+    uint32_t sent;             //messages put in the queue
+    uint32_t drops;            //messages that never reach the consumer (dropped or overwritten)
+    uint32_t overwritten;      //of those, old messages replaced by OVERWRITE_OLDEST
+    uint32_t alloc_failures;   //times the pool had no free block
+    uint32_t in_use;           //blocks allocated right now
+    uint32_t pool_high_water;  //most blocks ever allocated at the same time
+    uint32_t queue_depth;      //messages waiting right now
+    uint32_t queue_high_water; //most messages ever waiting at the same time
+    uint32_t wakeups;          //times the consumer had to wait for messages
+    uint32_t wake_threshold;   //batch size receive_batch() currently waits for
+} channel_metrics_t;
+
+template <typename T, uint32_t N, template <typename, uint32_t> class Pool = MemoryPool>
+class MessageChannel {
+public:
+    MessageChannel(backpressure_t policy, Kernel::Clock::duration_u32 timeout = 10ms)
+        : policy(policy), timeout(timeout), lost(0), wake_threshold(1), metrics() {}
+
+    //---- Producer side ----//
+
+    //Copies "message" into a block and queues it. Returns false if the message was dropped.
+    bool send(const T& message) {
+        slot_t* slot = (policy == BLOCK_WITH_TIMEOUT) ? pool.try_alloc_for(timeout) : pool.try_alloc();
+        if (slot == nullptr) {
+            count_alloc_failure();
+            if (policy != OVERWRITE_OLDEST || !queue.try_get(&slot)) return drop();
+            count_overwrite(); //"slot" is the oldest message, the new one takes its block
+        } else {
+            count_alloc();
+        }
+
+        slot->message = message;
+        slot->lost_before = take_lost();
+        bool queued = (policy == BLOCK_WITH_TIMEOUT) ? queue.try_put_for(timeout, slot) : queue.try_put(slot);
+        if (!queued) { //Cannot happen while the queue is as long as the pool, but never leak the block
+            free(&slot->message);
+            return drop();
+        }
+        uint32_t depth = count_sent();
+        if (depth == 1) ready.set(FIRST_FLAG); //EventFlags may be set from interrupts
+        if (depth >= wake_threshold) ready.set(BATCH_FLAG);
+        return true;
+    }
+
+    //---- Consumer side ----//
+
+    //Waits for the next message. "lost_before" receives how many were dropped just before it (DROP_AND_COUNT).
+    T* receive(uint32_t* lost_before = nullptr) {
+        slot_t* slot;
+        if (!queue.try_get(&slot)) {
+            count_wakeup();
+            queue.try_get_for(Kernel::wait_for_u32_forever, &slot);
+        }
+        if (lost_before) *lost_before = slot->lost_before;
+        return &slot->message;
+    }
+
+    //Waits for a batch and takes up to "max" messages into "messages". Returns how many, at least one.
+    uint32_t receive_batch(T** messages, uint32_t max, Kernel::Clock::duration_u32 max_wait,
+                           uint32_t* lost_before = nullptr) {
+        uint32_t n = 0, lost_total = 0;
+        bool full_batch = true;
+        while (n == 0) {
+            //A flag is cleared before the queue is checked, so a message sent in between still sets it again
+            ready.clear(FIRST_FLAG | BATCH_FLAG);
+            while (queue.count() == 0) { //Nothing yet: sleep until the first message
+                count_wakeup();
+                ready.wait_any(FIRST_FLAG);
+            }
+            if (queue.count() < wake_threshold) { //Give the rest of the batch up to max_wait to arrive
+                count_wakeup();
+                full_batch = !(ready.wait_any_for(BATCH_FLAG, max_wait) & osFlagsError);
+            }
+
+            slot_t* slot;
+            while (n < max && queue.try_get(&slot)) {
+                lost_total += slot->lost_before;
+                messages[n++] = &slot->message;
+            }
+        }
+        if (lost_before) *lost_before = lost_total;
+
+        //Adapt the threshold: bigger batches while they fill in time, smaller when the rate is low
+        uint32_t limit = (max < N) ? max : N;
+        uint32_t threshold = full_batch ? wake_threshold * 2 : n;
+        wake_threshold = (threshold < 1) ? 1 : (threshold > limit) ? limit : threshold;
+        return n;
+    }
+
+    //Gives the block of a received message back to the pool
+    void free(T* message) {
+        free_batch(&message, 1);
+    }
+
+    //Gives the blocks of "n" received messages back to the pool, counting them once
+    void free_batch(T** messages, uint32_t n) {
+        {
+            CriticalSectionLock lock;
+            metrics.in_use -= n;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            pool.free(reinterpret_cast<slot_t*>(messages[i])); //a message is the first member of its slot
+        }
+    }
+
+    //---- Either side ----//
+
+    void get_metrics(channel_metrics_t* copy) {
+        CriticalSectionLock lock;
+        *copy = metrics;
+        copy->queue_depth = queue.count();
+        copy->wake_threshold = wake_threshold;
+    }
+
+    void set_policy(backpressure_t new_policy) { policy = new_policy; }
+
+    void reset_metrics(void) { //Keeps the live values, clears the counters and peaks
+        CriticalSectionLock lock;
+        uint32_t in_use = metrics.in_use;
+        metrics = channel_metrics_t();
+        metrics.in_use = metrics.pool_high_water = in_use;
+        lost = 0;
+    }
+
+private:
+    static const uint32_t FIRST_FLAG = 0x01; //the queue is no longer empty
+    static const uint32_t BATCH_FLAG = 0x02; //the queue holds wake_threshold messages
+
+    typedef struct {
+        T message;
+        uint32_t lost_before;
+    } slot_t;
+
+    bool drop(void) {
+        CriticalSectionLock lock;
+        metrics.drops++;
+        if (policy == DROP_AND_COUNT) lost++;
+        return false;
+    }
+    uint32_t take_lost(void) {
+        CriticalSectionLock lock;
+        uint32_t n = lost;
+        lost = 0;
+        return n;
+    }
+    void count_alloc(void) {
+        CriticalSectionLock lock;
+        if (++metrics.in_use > metrics.pool_high_water) metrics.pool_high_water = metrics.in_use;
+    }
+    void count_alloc_failure(void) {
+        CriticalSectionLock lock;
+        metrics.alloc_failures++;
+    }
+    void count_overwrite(void) {
+        CriticalSectionLock lock;
+        metrics.drops++;
+        metrics.overwritten++;
+    }
+    uint32_t count_sent(void) {
+        uint32_t depth = queue.count();
+        CriticalSectionLock lock;
+        metrics.sent++;
+        if (depth > metrics.queue_high_water) metrics.queue_high_water = depth;
+        return depth;
+    }
+    void count_wakeup(void) {
+        CriticalSectionLock lock;
+        metrics.wakeups++;
+    }
+
+    Pool<slot_t, N> pool;
+    Queue<slot_t, N> queue;
+    backpressure_t policy;
+    Kernel::Clock::duration_u32 timeout;
+    uint32_t lost; //dropped since the last message that got through
+    volatile uint32_t wake_threshold;
+    EventFlags ready;
+    channel_metrics_t metrics;
+};
+
+#endif
@@ -0,0 +1,115 @@
+/*Static slab allocator. Each size class owns a static arena of equal blocks. Free blocks are kept in a singly linked
+list that is stored inside the blocks themselves (the first word of a free block points to the next one), so the list
+costs no RAM. Blocks never used yet are taken from the end of the arena instead, so no initialisation is needed.
+Every operation is a few instructions inside a critical section: O(1) and safe from threads and interrupts. */
+
+#include "slab_allocator.h"
+#include "static_format.h"
+
+typedef struct free_block {
+    struct free_block* next;
+} free_block_t;
+
+typedef struct {
+    uint8_t* arena;
+    uint16_t* requested;    //size asked for by each block in use, to measure the waste
+    uint16_t block_size;
+    uint8_t shift;          //log2(block_size): block index = offset >> shift
+    free_block_t* free_list;
+    uint16_t never_used;    //blocks at the end of the arena that were never allocated
+    slab_stats_t stats;
+} slab_class_t;
+
+constexpr uint8_t log2_of(uint32_t n) { return n <= 1 ? 0 : 1 + log2_of(n >> 1); }
+
+#define SLAB_ARENA(size, count)                                                                    \
+    static_assert((size) >= sizeof(free_block_t) && ((size) & ((size) - 1)) == 0,                  \
+                  "slab block sizes must be powers of two, at least one pointer");                 \
+    alignas(8) static uint8_t arena_##size[(size) * (count)];                                      \
+    static uint16_t requested_##size[count];
+SLAB_CLASSES(SLAB_ARENA)
+
+#define SLAB_CLASS(size, count) \
+    { arena_##size, requested_##size, size, log2_of(size), nullptr, count, { size, count, 0, 0, 0, 0, 0, 0 } },
+static slab_class_t classes[] = { SLAB_CLASSES(SLAB_CLASS) };
+
+#define CLASS_COUNT (int)(sizeof(classes) / sizeof(classes[0]))
+
+static void* take_block(slab_class_t* c) { //Called inside the critical section
+    uint8_t* block;
+    if (c->free_list) {
+        block = (uint8_t*)c->free_list;
+        c->free_list = c->free_list->next;
+    } else if (c->never_used) {
+        block = c->arena + (uint32_t)(c->stats.blocks - c->never_used) * c->block_size;
+        c->never_used--;
+    } else {
+        return nullptr;
+    }
+    if (++c->stats.in_use > c->stats.peak) c->stats.peak = c->stats.in_use;
+    return block;
+}
+
+void* slab_alloc(size_t size) {
+    int first = 0;
+    while (first < CLASS_COUNT && classes[first].block_size < size) first++;
+    if (first == CLASS_COUNT) return nullptr; //bigger than the biggest block
+
+    CriticalSectionLock lock;
+    for (int i = first; i < CLASS_COUNT; i++) {
+        slab_class_t* c = &classes[i];
+        uint8_t* block = (uint8_t*)take_block(c);
+        if (block) {
+            c->stats.allocations++;
+            c->stats.spills += (i != first);
+            c->requested[(uint32_t)(block - c->arena) >> c->shift] = size;
+            c->stats.requested += size;
+            return block;
+        }
+    }
+    classes[first].stats.failures++;
+    return nullptr;
+}
+
+void slab_free(void* block) {
+    if (block == nullptr) return;
+    for (int i = 0; i < CLASS_COUNT; i++) { //the address tells the class, the number of classes is fixed
+        slab_class_t* c = &classes[i];
+        uint32_t offset = (uint32_t)((uint8_t*)block - c->arena);
+        if ((uint8_t*)block < c->arena || offset >= (uint32_t)c->stats.blocks * c->block_size) continue;
+
+        CriticalSectionLock lock;
+        c->stats.requested -= c->requested[offset >> c->shift];
+        c->stats.in_use--;
+        free_block_t* freed = (free_block_t*)block;
+        freed->next = c->free_list;
+        c->free_list = freed;
+        return;
+    }
+    MBED_ASSERT(false); //not a slab block
+}
+
+int slab_class_count(void) {
+    return CLASS_COUNT;
+}
+
+void slab_get_stats(int size_class, slab_stats_t* stats) {
+    CriticalSectionLock lock;
+    *stats = classes[size_class].stats;
+}
+
+int slab_fragmentation(const slab_stats_t* stats) {
+    uint32_t used = (uint32_t)stats->in_use * stats->block_size;
+    return used ? (int)((used - stats->requested) * 100 / used) : 0;
+}
+
+void slab_print_stats(FileHandle* out) {
+    sfmt::print(*out, FMT("%6s %9s %5s %6s %6s %6s %6s\n\r"), "block", "in use", "peak", "allocs", "spills", "fails",
+                "waste");
+    for (int i = 0; i < CLASS_COUNT; i++) {
+        slab_stats_t s;
+        slab_get_stats(i, &s);
+        sfmt::print(*out, FMT("%6u %4u/%-4u %5u %6u %6u %6u %5d%%\n\r"), s.block_size, s.in_use, s.blocks, s.peak,
+                    s.allocations, s.spills, s.failures, slab_fragmentation(&s));
+    }
+}
@@ -0,0 +1,93 @@
+/*Header file for a static slab allocator: several memory pools of different block sizes ("size classes") behind one
+slab_alloc(size) call, so messages of different sizes can be allocated without malloc. Every class is a static array
+of blocks with a list of the free ones, so slab_alloc() and slab_free() take the same short time whatever the state
+and may be called from interrupts. A request takes a block of the smallest class it fits in, or of a bigger class if
+that one is full ("spill"). The classes are set at compile time in SLAB_CLASSES below. */
+
+#ifndef SLAB_ALLOCATOR_H
+#define SLAB_ALLOCATOR_H
+#include "mbed.h"
+#include <new>
+
+//Size classes, smallest first: X(block size in bytes, a power of two, number of blocks)
+#define SLAB_CLASSES(X)                                  \
+    X(32, 32)   /* telemetry frames, message_t */        \
+    X(64, 16)   /* display requests, a line of text */   \
+    X(256, 4)   /* song buffers */
+
+//Statistics of one size class
+typedef struct {
+    uint16_t block_size;
+    uint16_t blocks;
+    uint16_t in_use;         //blocks allocated right now
+    uint16_t peak;           //most blocks ever allocated at the same time
+    uint32_t allocations;    //successful slab_alloc() calls served by this class
+    uint32_t spills;         //of those, requests meant for a smaller class that was full
+    uint32_t failures;       //requests for this class that no class could serve
+    uint32_t requested;      //bytes asked for by the blocks in use (the rest of the blocks is wasted)
+} slab_stats_t;
+
+//Function Prototypes
+void* slab_alloc(size_t size);
+void slab_free(void* block);
+int slab_class_count(void);
+void slab_get_stats(int size_class, slab_stats_t* stats);
+int slab_fragmentation(const slab_stats_t* stats); //wasted bytes inside the used blocks, in percent
+void slab_print_stats(FileHandle* out);
+
+//Typed helpers: construct a T in a slab block / destroy it and give the block back
+template <typename T>
+T* slab_new(void) {
+    void* block = slab_alloc(sizeof(T));
+    return block ? new (block) T() : nullptr;
+}
+
+template <typename T>
+void slab_delete(T* object) {
+    object->~T();
+    slab_free(object);
+}
+
+/*Same interface as MemoryPool<T, N>, so it can replace it (e.g. as the pool of a MessageChannel). The blocks come
+from the shared slabs and N is the most this pool may hold at the same time, so one busy queue cannot take the blocks
+of every other user. Like MemoryPool::try_alloc_for(), try_alloc_for() must not be called from an interrupt. */
+template <typename T, uint32_t N>
+class SlabPool {
+public:
+    SlabPool() : allocated(0) {}
+
+    T* try_alloc(void) {
+        {
+            CriticalSectionLock lock;
+            if (allocated == N) return nullptr;
+            allocated++;
+        }
+        T* block = static_cast<T*>(slab_alloc(sizeof(T)));
+        if (block == nullptr) {
+            CriticalSectionLock lock;
+            allocated--;
+        }
+        return block;
+    }
+
+    T* try_alloc_for(Kernel::Clock::duration_u32 rel_time) { //the slabs cannot wake us up, so check every ms
+        T* block = try_alloc();
+        for (uint32_t waited = 0; block == nullptr && waited < rel_time.count(); waited++) {
+            ThisThread::sleep_for(1ms);
+            block = try_alloc();
+        }
+        return block;
+    }
+
+    osStatus free(T* block) {
+        slab_free(block);
+        CriticalSectionLock lock;
+        allocated--;
+        return osOK;
+    }
+
+private:
+    uint32_t allocated;
+};
+
+#endif
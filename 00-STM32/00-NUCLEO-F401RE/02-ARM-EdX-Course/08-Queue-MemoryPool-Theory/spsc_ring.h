@@ -0,0 +1,92 @@
+/*Lock-free ring buffer for exactly one producer and one consumer (SPSC). The messages are stored inside the ring, so
+there is no memory pool and no pointer to pass around, and no kernel call at all: each side only writes its own index
+and reads the other one. That is why the producer may be an interrupt handler, and why it works the same between two
+std::threads on a PC.
+
+    message_t* slot = ring.reserve();   // producer: get a free slot (nullptr when full)
+    slot->voltage = ...;                 // fill it in place, no copy
+    ring.commit();                       // make it visible to the consumer
+
+    message_t* msg = ring.peek();        // consumer: oldest message (nullptr when empty)
+    ...                                  // use it in place
+    ring.release();                      // give the slot back
+
+The ring does not wake the consumer up; pair it with a thread flag (or a semaphore) set after commit(). */
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+#include <stdint.h>
+#include <atomic>
+
+#if defined(__arm__)
+#define SPSC_RING_ALIGN 4   // no cache on a Cortex-M4, do not waste RAM
+#else
+#define SPSC_RING_ALIGN 64  // keep both indexes on separate cache lines on a PC
+#endif
+
+template <typename T, uint32_t N>
+class SpscRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+    SpscRing() : head(0), tail(0) {}
+
+    //---- Producer side ----//
+
+    // Next free slot, or nullptr if the ring is full. Call commit() once it is filled.
+    T* reserve() {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == N) return nullptr;
+        return &slots[h & (N - 1)];
+    }
+
+    // Publishes the slot returned by reserve()
+    void commit() {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool try_push(const T& item) {
+        T* slot = reserve();
+        if (!slot) return false;
+        *slot = item;
+        commit();
+        return true;
+    }
+
+    //---- Consumer side ----//
+
+    // Oldest message, or nullptr if the ring is empty. Call release() when done with it.
+    T* peek() {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (head.load(std::memory_order_acquire) == t) return nullptr;
+        return &slots[t & (N - 1)];
+    }
+
+    // Frees the slot returned by peek()
+    void release() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool try_pop(T& item) {
+        T* slot = peek();
+        if (!slot) return false;
+        item = *slot;
+        release();
+        return true;
+    }
+
+    //---- Either side (the value may be outdated by the time it is used) ----//
+
+    uint32_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+    bool empty() const { return size() == 0; }
+    static constexpr uint32_t capacity() { return N; }
+
+private:
+    T slots[N];
+    alignas(SPSC_RING_ALIGN) std::atomic<uint32_t> head; // written by the producer only (free-running counter)
+    alignas(SPSC_RING_ALIGN) std::atomic<uint32_t> tail; // written by the consumer only (free-running counter)
+};
+
+#endif
@@ -0,0 +1,333 @@
+/*Type-safe formatting without printf. The format string is given with FMT("..."), which turns the literal into a
+type, so the compiler parses it while compiling: the call becomes a fixed sequence of "write this text, write this
+argument" steps and a wrong argument count or type is a compile error instead of garbage on the screen. There are
+no varargs and no heap, and only the conversions actually used are linked in.
+
+    sfmt::print(pc, FMT("Voltage: %d V, ratio %.3f\n"), voltage, ratio);   // to a BufferedSerial / FileHandle
+    sfmt::format_to(buffer, FMT("X = %5.2f"), joystick.read());             // to a char array
+    sfmt::format(lcd, FMT("%02u:%02u"), minutes, seconds);                   // to any object with put() and write()
+
+Supported: %d %i %u %x %X %c %s %f %% with the flags '-' and '0', a width and a precision. Integers of any size,
+float/double, and binary fixed point values wrapped as sfmt::fixed<FracBits> (e.g. Q16.16) for %f. Length modifiers
+(l, h, ll) are accepted and ignored, the size comes from the argument type. Values of %f above 4294967295 print "ovf". */
+
+#ifndef STATIC_FORMAT_H
+#define STATIC_FORMAT_H
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+//Turns a string literal into a type that carries it, so templates can read the string at compile time
+#define FMT(literal) ([] { struct format_string { static constexpr const char* str() { return literal; } }; return format_string{}; }())
+
+namespace sfmt {
+
+//Binary fixed point number: the value is raw / 2^FracBits
+template <int FracBits>
+struct fixed {
+    int32_t raw;
+};
+
+template <int FracBits>
+inline fixed<FracBits> q(int32_t raw) { return fixed<FracBits>{raw}; }
+
+//Writes into a char array and keeps it NUL terminated. What does not fit is dropped but still counted in length().
+class buffer_sink {
+public:
+    buffer_sink(char* buffer, size_t size) : buf(buffer), size(size), len(0) {
+        if (size > 0) buf[0] = '\0';
+    }
+    void put(char c) { write(&c, 1); }
+    void write(const char* text, size_t n) {
+        if (len + 1 < size) {
+            size_t room = size - 1 - len;
+            size_t copy = n < room ? n : room;
+            memcpy(buf + len, text, copy);
+            buf[len + copy] = '\0';
+        }
+        len += n;
+    }
+    size_t length() const { return len; }
+
+private:
+    char* buf;
+    size_t size;
+    size_t len;
+};
+
+//Collects the output and hands it in blocks to anything with write(const void*, size_t): BufferedSerial, FileHandle...
+template <class Port, size_t N = 32>
+class port_sink {
+public:
+    explicit port_sink(Port& port) : port(port), len(0) {}
+    ~port_sink() { flush(); }
+    void put(char c) {
+        if (len == N) flush();
+        buf[len++] = c;
+    }
+    void write(const char* text, size_t n) {
+        while (n--) put(*text++);
+    }
+    void flush() {
+        if (len > 0) port.write(buf, len);
+        len = 0;
+    }
+
+private:
+    Port& port;
+    char buf[N];
+    size_t len;
+};
+
+namespace detail {
+
+//One step of the format string: the literal text before a conversion, and the conversion itself
+struct spec_t {
+    int text_begin;
+    int text_end;
+    char conv;      //'d', 'u', 'x', 'f'... '%' for "%%", 0 at the end of the string
+    bool left;      //'-' flag
+    char pad;       //' ' or '0'
+    int width;
+    int precision;  //-1 when not given
+    int next;       //where the next step starts
+};
+
+constexpr bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+constexpr spec_t parse_at(const char* s, int pos) { //Parses the step that starts at s[pos]
+    spec_t sp{pos, pos, 0, false, ' ', 0, -1, pos};
+    int i = pos;
+    while (s[i] != '\0' && s[i] != '%') i++;
+    sp.text_end = i;
+    if (s[i] == '\0') {
+        sp.next = i;
+        return sp;
+    }
+    i++; //skip '%'
+    if (s[i] == '%') { //"%%" prints the first '%' as part of the text
+        sp.text_end = i;
+        sp.conv = '%';
+        sp.next = i + 1;
+        return sp;
+    }
+    for (; s[i] == '-' || s[i] == '0'; i++) {
+        if (s[i] == '-') sp.left = true;
+        else sp.pad = '0';
+    }
+    for (; is_digit(s[i]); i++) sp.width = sp.width * 10 + (s[i] - '0');
+    if (s[i] == '.') {
+        sp.precision = 0;
+        for (i++; is_digit(s[i]); i++) sp.precision = sp.precision * 10 + (s[i] - '0');
+    }
+    while (s[i] == 'l' || s[i] == 'h' || s[i] == 'z') i++;
+    sp.conv = s[i];
+    sp.next = s[i] ? i + 1 : i;
+    if (sp.left) sp.pad = ' ';
+    return sp;
+}
+
+constexpr bool is_integer_conv(char c) { return c == 'd' || c == 'i' || c == 'u' || c == 'x' || c == 'X' || c == 'c'; }
+
+template <class T> struct is_fixed : std::false_type {};
+template <int F> struct is_fixed<fixed<F>> : std::true_type {};
+
+template <class T>
+constexpr bool accepts(char conv) { //Argument type check for one conversion
+    return is_integer_conv(conv) ? std::is_integral<T>::value
+         : conv == 'f' ? (std::is_floating_point<T>::value || is_fixed<T>::value)
+         : conv == 's' ? std::is_convertible<const T&, const char*>::value
+         : false;
+}
+
+template <class Sink>
+void put_field(Sink& sink, const char* text, int len, bool negative, const spec_t& sp) { //Sign, padding and text
+    int fill = sp.width - len - (negative ? 1 : 0);
+    if (!sp.left && sp.pad == ' ') for (; fill > 0; fill--) sink.put(' ');
+    if (negative) sink.put('-');
+    if (!sp.left && sp.pad == '0') for (; fill > 0; fill--) sink.put('0');
+    sink.write(text, len);
+    for (; fill > 0; fill--) sink.put(' ');
+}
+
+template <class U>
+int unsigned_text(char* end, U value, unsigned base, bool upper) { //Digits written backwards, ending at "end"
+    const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    char* p = end;
+    do {
+        *--p = digits[value % base];
+        value /= base;
+    } while (value);
+    return (int)(end - p);
+}
+
+template <class Sink, class T>
+void put_integer(Sink& sink, const spec_t& sp, T value) {
+    typedef typename std::make_unsigned<typename std::conditional<(sizeof(T) > 4), uint64_t, uint32_t>::type>::type U;
+    if (sp.conv == 'c') {
+        char c = (char)value;
+        put_field(sink, &c, 1, false, sp);
+        return;
+    }
+    bool negative = (sp.conv == 'd' || sp.conv == 'i') && value < 0;
+    U magnitude = negative ? (U)0 - (U)value : (U)value;
+    char buf[24];
+    int len = unsigned_text(buf + sizeof(buf), magnitude, (sp.conv == 'x' || sp.conv == 'X') ? 16 : 10, sp.conv == 'X');
+    put_field(sink, buf + sizeof(buf) - len, len, negative, sp);
+}
+
+static const uint32_t powers_of_ten[10] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+
+template <class Sink>
+void put_decimal(Sink& sink, const spec_t& sp, bool negative, uint32_t integer, uint32_t fraction, int precision) {
+    char buf[24];
+    char* end = buf + sizeof(buf);
+    char* p = end;
+    if (precision > 0) {
+        for (int k = 0; k < precision; k++) {
+            *--p = (char)('0' + fraction % 10);
+            fraction /= 10;
+        }
+        *--p = '.';
+    }
+    p -= unsigned_text(p, integer, 10, false);
+    put_field(sink, p, (int)(end - p), negative, sp);
+}
+
+template <class Sink, class T>
+void put_float(Sink& sink, const spec_t& sp, T value) { //Float math in the type of the argument (single on an M4F)
+    int precision = sp.precision < 0 ? 6 : (sp.precision > 9 ? 9 : sp.precision);
+    if (value != value) {
+        put_field(sink, "nan", 3, false, sp);
+        return;
+    }
+    bool negative = value < 0;
+    if (negative) value = -value;
+    if (value >= (T)4294967295.0) {
+        put_field(sink, value == value * 2 ? "inf" : "ovf", 3, negative, sp);
+        return;
+    }
+    uint32_t scale = powers_of_ten[precision];
+    uint32_t integer = (uint32_t)value;
+    T scaled = (value - (T)integer) * (T)scale;
+    uint32_t fraction = (uint32_t)scaled;
+    T remainder = scaled - (T)fraction;
+    if (remainder > (T)0.5 || (remainder == (T)0.5 && ((precision > 0 ? fraction : integer) & 1))) fraction++; //ties to even, like printf
+    if (fraction >= scale) { //rounding carried into the integer part
+        fraction -= scale;
+        integer++;
+    }
+    put_decimal(sink, sp, negative, integer, fraction, precision);
+}
+
+template <class Sink, int F>
+void put_float(Sink& sink, const spec_t& sp, fixed<F> value) { //Exact conversion, integer math only
+    static_assert(F > 0 && F < 32, "fixed<FracBits> needs 1..31 fractional bits");
+    int precision = sp.precision < 0 ? 6 : (sp.precision > 9 ? 9 : sp.precision);
+    bool negative = value.raw < 0;
+    uint32_t magnitude = negative ? 0u - (uint32_t)value.raw : (uint32_t)value.raw;
+    uint32_t integer = magnitude >> F;
+    uint64_t rest = magnitude & ((1ull << F) - 1);
+    uint64_t scaled = rest * powers_of_ten[precision];
+    uint32_t fraction = (uint32_t)(scaled >> F);
+    uint64_t remainder = scaled & ((1ull << F) - 1);
+    uint64_t half = 1ull << (F - 1);
+    if (remainder > half || (remainder == half && ((precision > 0 ? fraction : integer) & 1))) fraction++;
+    if (fraction >= powers_of_ten[precision]) {
+        fraction -= powers_of_ten[precision];
+        integer++;
+    }
+    put_decimal(sink, sp, negative, integer, fraction, precision);
+}
+
+template <class Sink>
+void put_string(Sink& sink, const spec_t& sp, const char* text) {
+    if (!text) text = "(null)";
+    int len = 0;
+    while (text[len] && (sp.precision < 0 || len < sp.precision)) len++;
+    spec_t plain = sp;
+    plain.pad = ' ';
+    put_field(sink, text, len, false, plain);
+}
+
+//Tag dispatch on the argument type, the conversion letter was already checked against it
+template <class Sink, class T>
+typename std::enable_if<std::is_floating_point<T>::value || is_fixed<T>::value>::type
+put_other(Sink& sink, const spec_t& sp, const T& value) { put_float(sink, sp, value); }
+
+template <class Sink, class T>
+typename std::enable_if<!std::is_floating_point<T>::value && !is_fixed<T>::value>::type
+put_other(Sink& sink, const spec_t& sp, const T& value) { put_string(sink, sp, value); }
+
+template <class Sink, class T>
+void put_arg(Sink& sink, const spec_t& sp, const T& value, std::true_type /*integral*/) { put_integer(sink, sp, value); }
+
+template <class Sink, class T>
+void put_arg(Sink& sink, const spec_t& sp, const T& value, std::false_type) { put_other(sink, sp, value); }
+
+//The emitter for the step at Pos. The format string is only read at compile time.
+template <class F, int Pos, char Conv = parse_at(F::str(), Pos).conv>
+struct emitter {
+    template <class Sink, class Arg, class... Rest>
+    static void run(Sink& sink, const Arg& arg, const Rest&... rest) {
+        constexpr spec_t sp = parse_at(F::str(), Pos);
+        static_assert(sp.conv == 'f' || sp.conv == 's' || is_integer_conv(sp.conv), "unsupported conversion in format string");
+        static_assert(accepts<Arg>(sp.conv), "argument type does not match its conversion in the format string");
+        if (sp.text_end > sp.text_begin) sink.write(F::str() + sp.text_begin, sp.text_end - sp.text_begin);
+        put_arg(sink, sp, arg, std::is_integral<Arg>());
+        emitter<F, sp.next>::run(sink, rest...);
+    }
+
+    template <class Sink>
+    static void run(Sink&) {
+        static_assert(sizeof(Sink) == 0, "format string has more conversions than arguments");
+    }
+};
+
+template <class F, int Pos>
+struct emitter<F, Pos, '%'> {
+    template <class Sink, class... Args>
+    static void run(Sink& sink, const Args&... args) {
+        constexpr spec_t sp = parse_at(F::str(), Pos);
+        sink.write(F::str() + sp.text_begin, sp.text_end - sp.text_begin);
+        emitter<F, sp.next>::run(sink, args...);
+    }
+};
+
+template <class F, int Pos>
+struct emitter<F, Pos, 0> {
+    template <class Sink, class... Args>
+    static void run(Sink& sink, const Args&...) {
+        static_assert(sizeof...(Args) == 0, "more arguments than conversions in the format string");
+        constexpr spec_t sp = parse_at(F::str(), Pos);
+        if (sp.text_end > sp.text_begin) sink.write(F::str() + sp.text_begin, sp.text_end - sp.text_begin);
+    }
+};
+
+} // namespace detail
+
+//Formats into any sink with put(char) and write(const char*, size_t)
+template <class Sink, class Format, class... Args>
+inline void format(Sink& sink, Format, const Args&... args) {
+    detail::emitter<Format, 0>::run(sink, args...);
+}
+
+//Formats into a char array, returns the length the full text would have (like snprintf)
+template <size_t N, class Format, class... Args>
+inline size_t format_to(char (&buffer)[N], Format fmt, const Args&... args) {
+    buffer_sink sink(buffer, N);
+    format(sink, fmt, args...);
+    return sink.length();
+}
+
+//Formats straight to a serial port or file handle
+template <class Port, class Format, class... Args>
+inline void print(Port& port, Format fmt, const Args&... args) {
+    port_sink<Port> sink(port);
+    format(sink, fmt, args...);
+}
+
+} // namespace sfmt
+
+#endif
@@ -0,0 +1,144 @@
+/*Streaming statistics over a window of the last W samples, summarised every "hop" samples: hop == W gives tumbling
+windows (every sample counted once), hop < W sliding windows (they overlap). Each sample is added in O(1) and the
+memory is fixed by W and BINS:
+    - count, mean and variance with Welford's method, which adds and removes samples without the cancellation error
+      of sum(x^2) - sum(x)^2;
+    - exact minimum and maximum with two monotonic queues (the candidates for the minimum are kept increasing, so the
+      oldest one is the minimum; each sample enters and leaves each queue once);
+    - percentiles from a histogram of BINS bins between "low" and "high" (values outside go to the first/last bin),
+      so their resolution is (high - low) / BINS.
+No mbed dependency, so the PC can run it too. */
+
+#ifndef STREAM_STATS_H
+#define STREAM_STATS_H
+#include <stdint.h>
+#include <math.h>
+
+//Summary of one window
+typedef struct {
+    uint32_t count;
+    int32_t min, max;
+    float mean;
+    float stddev;
+    int32_t p50, p90, p99;
+} window_summary_t;
+
+template <uint32_t W, uint32_t BINS = 32>
+class StreamWindow {
+    static_assert(W >= 2, "a window needs at least two samples");
+
+public:
+    StreamWindow(uint32_t hop, int32_t low, int32_t high)
+        : hop(hop < 1 ? 1 : (hop > W ? W : hop)), low(low),
+          bin_width((high - low + (int32_t)BINS - 1) / (int32_t)BINS) {
+        if (bin_width < 1) bin_width = 1;
+        reset();
+    }
+
+    void reset(void) {
+        added = 0;
+        since_summary = 0;
+        mean = m2 = 0;
+        min_first = min_last = max_first = max_last = 0;
+        for (uint32_t i = 0; i < BINS; i++) histogram[i] = 0;
+    }
+
+    //Adds a sample; returns true (and fills *summary) when a window is complete
+    bool add(int32_t x, window_summary_t* summary) {
+        if (added >= W) remove(values[added % W], added - W); //the oldest sample leaves the window
+        values[added % W] = x;
+
+        //Welford: update the mean and the sum of squared differences to it
+        uint32_t n = (added < W ? added : W - 1) + 1; //the oldest sample is already out
+        double delta = x - mean;
+        mean += delta / n;
+        m2 += delta * (x - mean);
+
+        histogram[bin_of(x)]++;
+
+        //Monotonic queues: drop the candidates the new sample beats, then queue it
+        while (min_last != min_first && values[min_index[(min_last - 1) % W] % W] >= x) min_last--;
+        min_index[min_last++ % W] = added;
+        while (max_last != max_first && values[max_index[(max_last - 1) % W] % W] <= x) max_last--;
+        max_index[max_last++ % W] = added;
+
+        added++;
+        if (++since_summary < hop || count() < W) return false;
+        since_summary = 0;
+        summarise(summary);
+        return true;
+    }
+
+    uint32_t count(void) const { return added < W ? added : W; }
+
+private:
+    void remove(int32_t x, uint32_t index) {
+        uint32_t n = W - 1;
+        double delta = x - mean;
+        mean -= delta / n;
+        m2 -= delta * (x - mean);
+        if (m2 < 0) m2 = 0; //rounding
+
+        histogram[bin_of(x)]--;
+        if (min_index[min_first % W] == index) min_first++;
+        if (max_index[max_first % W] == index) max_first++;
+    }
+
+    uint32_t bin_of(int32_t x) const {
+        if (x < low) return 0;
+        uint32_t bin = (uint32_t)(x - low) / (uint32_t)bin_width;
+        return bin < BINS ? bin : BINS - 1;
+    }
+
+    int32_t percentile(uint32_t percent) const { //middle of the bin that holds the given rank
+        uint32_t rank = (count() * percent + 99) / 100, seen = 0;
+        for (uint32_t i = 0; i < BINS; i++) {
+            seen += histogram[i];
+            if (seen >= rank) return low + (int32_t)i * bin_width + bin_width / 2;
+        }
+        return low + (int32_t)BINS * bin_width;
+    }
+
+    void summarise(window_summary_t* s) const {
+        s->count = count();
+        s->min = values[min_index[min_first % W] % W];
+        s->max = values[max_index[max_first % W] % W];
+        s->mean = (float)mean;
+        s->stddev = (float)sqrt(m2 / (count() - 1));
+        s->p50 = percentile(50);
+        s->p90 = percentile(90);
+        s->p99 = percentile(99);
+    }
+
+    uint32_t hop;
+    int32_t low, bin_width;
+    uint32_t added;          //samples ever added, also the index of the next one
+    uint32_t since_summary;
+    double mean, m2;         //double: removing samples must not drift over a long run
+    int32_t values[W];       //the window, oldest sample at added % W
+    uint32_t min_index[W], max_index[W]; //monotonic queues of sample indexes, as rings
+    uint32_t min_first, min_last, max_first, max_last;
+    uint16_t histogram[BINS];
+};
+
+/*Reports when a value leaves or re-enters the range [low, high]. To re-enter it must come back by "hysteresis", so
+noise around a limit does not report a crossing with every sample. */
+class ThresholdDetector {
+public:
+    ThresholdDetector(int32_t low, int32_t high, int32_t hysteresis)
+        : low(low), high(high), hysteresis(hysteresis), outside(false) {}
+
+    bool crossed(int32_t x) { //true when the value just left or just came back into the range
+        bool now_outside = outside ? (x < low + hysteresis || x > high - hysteresis) : (x < low || x > high);
+        bool changed = now_outside != outside;
+        outside = now_outside;
+        return changed;
+    }
+    bool is_outside(void) const { return outside; }
+
+private:
+    int32_t low, high, hysteresis;
+    bool outside;
+};
+
+#endif
@@ -6,6 +6,9 @@
 
  The "4bit_LCD.cpp" file is created reusing the SPI-Communication project, and example songs are taken to create the
  "tunes.h" file.
+
+ + lcd_mutex is a ProfiledMutex ("profiled_mutex.h"): a Mutex that also counts how often a thread had to wait for the
+ LCD, how long it waited and how long each write held it. Every 5 s the main thread prints the measurements on the PC.
  *******************************************************************************************************************
  * Author: Luciano Carricart, https://github.com/lcarricart/
  * Status: Information Engineering student at HAW Hamburg, Germany.
@@ -15,6 +18,7 @@
 #include "mbed.h"
 #include "tunes.h"
 #include "4bit_LCD.h"
+#include "profiled_mutex.h"
 
 PwmOut speaker(D3);         // for piezo sounder
 BusIn choose(D4, D5, D6);     // for select buttons
@@ -24,7 +28,7 @@ BusIn choose(D4, D5, D6);     // for select buttons
 AnalogIn volume(A0);          // for potentiometer
 InterruptIn play(D7);         // for Play button
 
-Mutex lcd_mutex;
+ProfiledMutex lcd_mutex("lcd_mutex"); // a Mutex that measures the waits for it and how long it is held
 
 // These flags indicate state of player
 bool welcome = 1;   // Indicates welcome state
@@ -38,7 +42,7 @@ void Play_tune(void);
 
 //-------------- Threads ----------------//
 
-Thread thread1;   // Displays welcome message on LCD
+Thread thread1(osPriorityNormal, OS_STACK_SIZE, nullptr, "LCD_cont");      // Displays welcome message on LCD
 void LCD_cont() {
     init_lcd();  // initialise the LCD
 
@@ -59,7 +63,7 @@ void LCD_cont() {
     } // end of while(1)
 }
 
-Thread thread2;   // Reads the select buttons and readies the song
+Thread thread2(osPriorityNormal, OS_STACK_SIZE, nullptr, "Tune_select");   // Reads the select buttons and readies the song
 void Tune_select(void const* args) {
     while (1) {
         if (triggered) { // "triggered" is set by Interrupt
@@ -89,7 +93,7 @@ void Tune_select(void const* args) {
     } // end of while(1)
 }
 
-Thread thread3;   // plays the chosen tune
+Thread thread3(osPriorityNormal, OS_STACK_SIZE, nullptr, "Play_tune");     // plays the chosen tune
 void Play_tune(void const* args) {
     while (1) {
         if (playing) {
@@ -131,7 +135,9 @@ int main() {
     thread2.start(callback(Tune_select, &choose));
     thread3.start(callback(Play_tune, &play));
 
+    // The CPU sleeps (idle thread, __WFI()) while main waits for the next report
     while (1) {
-        __WFI(); // wait for interrupt
+        ThisThread::sleep_for(5s);
+        print_mutex_reports(mbed_file_handle(STDOUT_FILENO));
     }
 }
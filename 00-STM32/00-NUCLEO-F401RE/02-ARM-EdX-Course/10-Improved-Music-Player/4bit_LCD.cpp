@@ -1,10 +1,14 @@
 /*A simple set of functions to write to 2x16 LCD, operating in 4-bit mode. */
 
 #include "4bit_LCD.h"
+#include "trace_recorder.h"
 
 DigitalOut CS(D10);
 SPI ser_port(D11, D12, D13); // Initialise SPI, using default settings
 
+static const char trace_clear[] = "LCD clear"; //sections of the trace, by the thread that writes
+static const char trace_write[] = "LCD write";
+
 void init_lcd(void) { //follow designated procedure in data sheet
     thread_sleep_for(40);
     shift_out(0x30); //function set 8-bit
@@ -55,13 +59,19 @@ void write_data(char c) { //Configures LCD data word
 }
 
 void clr_lcd(void) { //Clears display and waits required time
+    uint8_t trace = trace_name(trace_clear);
+    trace_record(TRACE_BEGIN, trace);
     write_cmd(0x01); //display clear
     wait_us(1520);   // Required time after clear
+    trace_record(TRACE_END, trace);
 }
 
 void print_lcd(const char* string) { //Sends character string to LCD
+    uint8_t trace = trace_name(trace_write);
+    trace_record(TRACE_BEGIN, trace);
     while (*string) {
         write_data(*string++);
         wait_us(40);
     }
+    trace_record(TRACE_END, trace);
 }
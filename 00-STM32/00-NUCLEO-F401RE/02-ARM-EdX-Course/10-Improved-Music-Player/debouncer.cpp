@@ -0,0 +1,171 @@
+/*Button debouncer. Each button is a small state machine driven by two interrupts:
+    - the pin interrupt, on both edges: stores the time of the edge. The first edge after a settled level is the
+      press or the release (DEBOUNCE_LEADING_EDGE) and arms the Timeout of the button; the bounces that follow only
+      cost a timestamp and a counter.
+    - the Timeout: if the last edge is less than DEBOUNCE_SETTLE_US old, it waits for the rest of the quiet time;
+      otherwise the pin has settled and its level is read. If it is not the level already reported, the burst was a
+      glitch (or a tap shorter than the quiet time) and the opposite event follows, marked as a glitch, so presses
+      and releases always come in pairs. A press arms the Timeout for the long press, and each long press or repeat
+      arms it for the next repeat, counted from the press so they do not drift.
+A contact that is always settled when it starts to move needs no waiting: the first edge can only be a change. With
+DEBOUNCE_LEADING_EDGE at 0 the event waits for the quiet time instead, and a burst that ends where it started is no
+event at all. The times come from us_ticker_read(), the 32-bit microsecond hardware timer of Mbed (TIM5 on the
+F401RE). The latency of a press or release runs from the timestamp of its first edge to the call of the sink, or to
+get() returning it: a queued event also waits for the thread that reads it. The events that undo a glitch are
+counted apart and not timed, they come after the quiet time by design. */
+
+#include "debouncer.h"
+#include "report_line.h"
+
+Debouncer::Debouncer(sink_t sink) : sink(sink), count(0), head(0), tail(0), lost(0), ready(0) {}
+
+int Debouncer::add(InterruptIn& pin, const char* name, bool active_low) {
+    if (count == DEBOUNCE_MAX_BUTTONS) return -1;
+    Button& b = buttons[count];
+    b.owner = this;
+    b.pin = &pin;
+    b.name = name;
+    b.index = (uint8_t)count;
+    b.active_low = active_low;
+    b.down = (pin.read() == 0) == active_low;   //held at startup: it counts from its release
+    pin.rise(callback(&b, &Button::edge));
+    pin.fall(callback(&b, &Button::edge));
+    return count++;
+}
+
+void Debouncer::Button::edge(void) {
+    uint32_t now = us_ticker_read();
+    int type = -1;
+    {
+        CriticalSectionLock lock;               //the Timeout may have a higher priority than the pin
+        edge_us = now;
+        counts.edges++;
+        if (settling) return;
+        settling = true;
+        first_us = now;
+#if DEBOUNCE_LEADING_EDGE
+        counts.changes++;
+        type = change(!down);                   //out of a settled level: the first edge is the change
+#endif
+        timer.attach(callback(this, &Button::expire), std::chrono::microseconds(DEBOUNCE_SETTLE_US));
+    }
+    if (type >= 0) owner->emit(index, type, 0, first_us);
+}
+
+void Debouncer::Button::expire(void) {
+    int type = -1;
+    uint32_t event_us = first_us;
+    uint16_t event_held = 0;
+    bool glitch = false;
+    {
+        CriticalSectionLock lock;
+        uint32_t now = us_ticker_read();
+        if (settling) {
+            uint32_t quiet = now - edge_us;
+            if (quiet < DEBOUNCE_SETTLE_US) {   //still bouncing
+                timer.attach(callback(this, &Button::expire), std::chrono::microseconds(DEBOUNCE_SETTLE_US - quiet));
+                return;
+            }
+            settling = false;
+            bool level = (pin->read() == 0) == active_low;
+#if DEBOUNCE_LEADING_EDGE
+            if (level != down) {                //back where it started: the first edge was undone
+                counts.glitches++;
+                type = change(level);
+                event_us = edge_us;
+                glitch = true;
+            }
+#else
+            if (level != down) {
+                counts.changes++;
+                type = change(level);
+            } else {
+                counts.glitches++;
+            }
+#endif
+        } else if (down) {                      //a long press or a repeat is due
+            held++;
+            if (held == 1) counts.longs++;
+            else counts.repeats++;
+            type = held == 1 ? BUTTON_LONG : BUTTON_REPEAT;
+            event_held = held;
+            event_us = now;
+            hold_us += DEBOUNCE_REPEAT_MS * 1000;
+        }
+        if (down && !settling) {                //held: on to the next long press / repeat
+            int32_t wait = (int32_t)(hold_us - now);
+            if (wait < 0) wait = 0;
+            timer.attach(callback(this, &Button::expire), std::chrono::microseconds(wait));
+        }
+    }
+    if (type >= 0) owner->emit(index, type, event_held, event_us, glitch);
+}
+
+int Debouncer::Button::change(bool level) { //In a critical section
+    down = level;
+    if (down) {
+        held = 0;
+        hold_us = first_us + DEBOUNCE_LONG_MS * 1000;
+    }
+    return down ? BUTTON_PRESS : BUTTON_RELEASE;
+}
+
+void Debouncer::emit(int button, int type, uint16_t held, uint32_t us, bool glitch) { //In interrupt context
+    button_event_t event = {(uint8_t)button, (uint8_t)type, held, us, glitch};
+    if (sink) {
+        delivered(event);
+        sink(event);
+        return;
+    }
+    {
+        CriticalSectionLock lock;
+        if (head - tail >= DEBOUNCE_QUEUE_SIZE) {
+            lost++;
+            return;
+        }
+        queue[head % DEBOUNCE_QUEUE_SIZE] = event;
+        head++;
+    }
+    ready.release();
+}
+
+void Debouncer::get(button_event_t* event) {
+    ready.acquire();
+    {
+        CriticalSectionLock lock;
+        *event = queue[tail % DEBOUNCE_QUEUE_SIZE];
+        tail++;
+    }
+    delivered(*event);
+}
+
+void Debouncer::delivered(const button_event_t& event) {
+    if (event.type > BUTTON_RELEASE || event.glitch) return; //long presses and repeats come from the Timeout itself
+    uint32_t latency = us_ticker_read() - event.us;
+    CriticalSectionLock lock;
+    Button::Counts& c = buttons[event.button].counts;
+    c.timed++;
+    c.latency_sum_us += latency;
+    if (latency > c.latency_max_us) c.latency_max_us = latency;
+    if (latency > DEBOUNCE_BUDGET_US) c.over_budget++;
+}
+
+/*-------------------------------------------Report---------------------------------------------------------*/
+void Debouncer::print_report(FileHandle* out) {
+    print_line(out, "Buttons: settle %d us, first edge to the sink or get() (budget %d us); %lu events lost\n\r",
+               DEBOUNCE_SETTLE_US, DEBOUNCE_BUDGET_US, (unsigned long)lost);
+    print_line(out, "%-8s %7s %7s %8s %6s %7s %9s %9s %5s\n\r", "BUTTON", "CHANGES", "EDGES", "GLITCHES", "LONG",
+               "REPEATS", "MEAN US", "MAX US", "OVER");
+    for (int i = 0; i < count; i++) {
+        Button::Counts b;
+        {
+            CriticalSectionLock lock;
+            b = buttons[i].counts;
+        }
+        uint32_t mean = b.timed ? (uint32_t)(b.latency_sum_us / b.timed) : 0;
+        print_line(out, "%-8.8s %7lu %7lu %8lu %6lu %7lu %9lu %9lu %5lu\n\r", buttons[i].name,
+                   (unsigned long)b.changes, (unsigned long)b.edges, (unsigned long)b.glitches,
+                   (unsigned long)b.longs, (unsigned long)b.repeats, (unsigned long)mean,
+                   (unsigned long)b.latency_max_us, (unsigned long)b.over_budget);
+    }
+}
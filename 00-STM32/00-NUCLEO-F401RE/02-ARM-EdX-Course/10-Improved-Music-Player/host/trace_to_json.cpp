@@ -0,0 +1,163 @@
+/*******************************************************************************************************************
+ * Host tool (runs on the PC, not on the board): reads a console log saved from the terminal program, finds the last
+ trace printed by trace_dump() (the lines from "@TRACE" to "@END", see "trace_recorder.h") and writes it as a Chrome
+ trace, the JSON format of chrome://tracing and ui.perfetto.dev:
+    - one track for the interrupts, one per thread (named after the thread) with its running time, and on it the
+      LCD writes and the waits for a mutex as slices,
+    - the notes as instant events with their frequency, and a counter track of the frequency.
+ The timestamps are the cycle counter of the board converted to microseconds, wrap-arounds included.
+ Build and run from this folder:
+    g++ -std=c++14 -O2 trace_to_json.cpp -o trace_to_json && ./trace_to_json < console.log > trace.json
+ *******************************************************************************************************************/
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// The event types of trace_recorder.h, in the same order
+enum { ISR_ENTER, ISR_EXIT, SWITCH, WAIT_BEGIN, WAIT_END, BEGIN, END, INSTANT };
+
+static const int INTERRUPTS_TID = 0;
+static const int UNKNOWN_TID = 999;   // events before the first thread switch of the dump
+
+struct event_t {
+    uint32_t cycles;
+    int type, id, arg;
+};
+
+struct dump_t {
+    double clock_hz = 0;
+    unsigned long recorded = 0, cost = 0;
+    std::map<int, std::string> names;
+    std::vector<event_t> events;
+};
+
+static std::string json_string(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') out += '\\';
+        if ((unsigned char)c >= 0x20) out += c;
+    }
+    return out + "\"";
+}
+
+static std::string trimmed(std::string line) {
+    while (!line.empty() && (line.back() == '\r' || line.back() == '\n' || line.back() == ' ')) line.pop_back();
+    return line;
+}
+
+// The last complete dump of the log; false if there is none
+static bool read_dump(std::istream& in, dump_t* result) {
+    dump_t dump;
+    bool inside = false, found = false;
+    std::string line;
+    while (std::getline(in, line)) {
+        line = trimmed(line);
+        size_t at = line.find('@');
+        if (at == std::string::npos) continue;
+        line = line.substr(at);
+
+        if (line.compare(0, 7, "@TRACE ") == 0) {
+            dump = dump_t();
+            int version;
+            unsigned long clock, count;
+            inside = sscanf(line.c_str(), "@TRACE %d %lu %lu %lu %lu", &version, &clock, &count, &dump.recorded,
+                            &dump.cost) == 5 && version == 1;
+            dump.clock_hz = (double)clock;
+        } else if (inside && line.compare(0, 3, "@N ") == 0) {
+            std::istringstream fields(line.substr(3));
+            int id;
+            fields >> id;
+            std::string name;
+            std::getline(fields >> std::ws, name);
+            dump.names[id] = name;
+        } else if (inside && line.compare(0, 3, "@E ") == 0) {
+            std::istringstream fields(line.substr(2));
+            std::string hex;
+            while (fields >> hex) {
+                if (hex.size() != 16) continue;
+                event_t e;
+                e.cycles = (uint32_t)strtoul(hex.substr(0, 8).c_str(), nullptr, 16);
+                e.type = (int)strtol(hex.substr(8, 2).c_str(), nullptr, 16);
+                e.id = (int)strtol(hex.substr(10, 2).c_str(), nullptr, 16);
+                e.arg = (int)strtol(hex.substr(12, 4).c_str(), nullptr, 16);
+                dump.events.push_back(e);
+            }
+        } else if (inside && line == "@END") {
+            *result = dump;
+            found = true;
+            inside = false;
+        }
+    }
+    return found;
+}
+
+int main(int argc, char** argv) {
+    dump_t dump;
+    if (argc > 1) {
+        fprintf(stderr, "usage: %s < console.log > trace.json\n", argv[0]);
+        return 2;
+    }
+    if (!read_dump(std::cin, &dump) || dump.events.empty() || dump.clock_hz <= 0) {
+        fprintf(stderr, "no complete @TRACE ... @END block in the input\n");
+        return 1;
+    }
+
+    auto name_of = [&](int id) {
+        auto it = dump.names.find(id);
+        return it != dump.names.end() ? it->second : "#" + std::to_string(id);
+    };
+    std::vector<std::string> out;
+    auto emit = [&](const std::string& phase, const std::string& name, int tid, double ts, const std::string& extra) {
+        char head[160];
+        snprintf(head, sizeof(head), "{\"ph\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"name\":", phase.c_str(), tid, ts);
+        out.push_back(head + json_string(name) + extra + "}");
+    };
+
+    std::map<int, std::string> tracks = {{INTERRUPTS_TID, "interrupts"}, {UNKNOWN_TID, "(before the first switch)"}};
+    double us_per_cycle = 1e6 / dump.clock_hz, ts = 0;
+    uint32_t previous = dump.events[0].cycles;
+    int running = UNKNOWN_TID, odd = 0;
+
+    for (const event_t& e : dump.events) {
+        ts += (uint32_t)(e.cycles - previous) * us_per_cycle; // unsigned difference: the counter wraps every 51 s
+        previous = e.cycles;
+        std::string name = name_of(e.id);
+        switch (e.type) {
+        case ISR_ENTER: emit("B", name, INTERRUPTS_TID, ts, ""); break;
+        case ISR_EXIT: emit("E", name, INTERRUPTS_TID, ts, ""); break;
+        case SWITCH:
+            if (running != UNKNOWN_TID) emit("E", "running", running, ts, "");
+            running = e.id + 1;
+            tracks[running] = name;
+            emit("B", "running", running, ts, "");
+            break;
+        case WAIT_BEGIN: emit("B", "wait " + name, running, ts, ""); break;
+        case WAIT_END: emit("E", "wait " + name, running, ts, ""); break;
+        case BEGIN: emit("B", name, running, ts, ""); break;
+        case END: emit("E", name, running, ts, ""); break;
+        case INSTANT:
+            emit("i", name, running, ts, ",\"s\":\"t\",\"args\":{\"value\":" + std::to_string(e.arg) + "}");
+            emit("C", name, running, ts, ",\"args\":{\"value\":" + std::to_string(e.arg) + "}");
+            break;
+        default: odd++; break; // a slot that was being written when the dump started
+        }
+    }
+    if (running != UNKNOWN_TID) emit("E", "running", running, ts, "");
+    for (const auto& track : tracks) {
+        emit("M", "thread_name", track.first, 0, ",\"args\":{\"name\":" + json_string(track.second) + "}");
+    }
+
+    printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (size_t i = 0; i < out.size(); i++) printf("%s%s\n", out[i].c_str(), i + 1 < out.size() ? "," : "");
+    printf("]}\n");
+    fprintf(stderr, "%zu events over %.3f ms (%lu recorded on the board, %lu cycles each), %d skipped\n",
+            dump.events.size(), ts / 1000, dump.recorded, dump.cost, odd);
+    return 0;
+}
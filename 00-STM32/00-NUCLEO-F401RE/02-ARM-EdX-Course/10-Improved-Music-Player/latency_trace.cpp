@@ -0,0 +1,120 @@
+/*Latency tracing from a button to the LCD. A stamp is one read of the DWT cycle counter plus a few stores in a short
+critical section, so the tracing itself adds well under a microsecond to each stage.
+
+The events live in a small table until they are complete, indexed by their ID. A press whose flag has not been seen
+yet by the drawing thread does not start a new event: it is merged into the waiting one, because one redraw answers
+both. A press that the thread misses altogether (the flag is cleared after the redraw, not before) stays unseen, and
+the next press merges into it: its latency then runs from the first press, which is what the user waited.
+
+Completed events go into rings of the last LATENCY_SAMPLES durations, one ring per stage and one for the whole
+chain; the report sorts a copy of each ring for the percentiles. */
+
+#include "latency_trace.h"
+#include "report_line.h"
+#include <cstring>
+
+#if LATENCY_TRACE
+typedef struct {
+    uint32_t id;                               //0: free
+    uint32_t reached;                          //bit per stage already stamped
+    uint32_t stamp[LATENCY_STAGES];            //cycle counter at each stage
+} latency_event_t;
+
+static latency_event_t in_flight[LATENCY_IN_FLIGHT];
+static uint32_t next_id = 1;
+static uint32_t unseen = 0;                    //event whose flag the thread has not found yet
+static uint32_t samples[LATENCY_STAGES][LATENCY_SAMPLES]; //[0]: end to end, [stage]: from the stage before, cycles
+static uint32_t completed, merged, lost, over_budget;
+
+static const char* const row_names[LATENCY_STAGES] = {"button to LCD", "ISR to thread", "thread to mutex",
+                                                      "mutex to LCD"};
+
+static uint32_t to_us(uint32_t cycles) {
+    return cycles / (SystemCoreClock / 1000000);
+}
+
+uint32_t latency_begin(void) {
+    uint32_t now = DWT->CYCCNT;
+    CriticalSectionLock lock;
+    if (unseen != 0) {
+        merged++;
+        return unseen;
+    }
+    if (!(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk)) { //first event: the counter has to run
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+    latency_event_t* e = &in_flight[next_id % LATENCY_IN_FLIGHT];
+    if (e->id != 0) lost++;                    //an event that never reached the LCD makes room
+    e->id = next_id;
+    e->reached = 1 << LATENCY_PRESSED;
+    e->stamp[LATENCY_PRESSED] = now;
+    unseen = next_id;
+    if (++next_id == 0) next_id = 1;
+    return unseen;
+}
+
+static void complete(latency_event_t* e) { //A stage that was not stamped takes the time of the one before
+    uint32_t slot = completed % LATENCY_SAMPLES;
+    for (int stage = 1; stage < LATENCY_STAGES; stage++) {
+        if (!(e->reached & (1 << stage))) e->stamp[stage] = e->stamp[stage - 1];
+        samples[stage][slot] = e->stamp[stage] - e->stamp[stage - 1];
+    }
+    samples[0][slot] = e->stamp[LATENCY_SHOWN] - e->stamp[LATENCY_PRESSED];
+    if (to_us(samples[0][slot]) > LATENCY_BUDGET_US) over_budget++;
+    completed++;
+    e->id = 0;
+}
+
+void latency_mark(uint32_t event, latency_stage_t stage) {
+    uint32_t now = DWT->CYCCNT;
+    if (event == 0) return;
+    CriticalSectionLock lock;
+    latency_event_t* e = &in_flight[event % LATENCY_IN_FLIGHT];
+    if (e->id != event) return;                //counted as lost meanwhile
+    e->stamp[stage] = now;
+    e->reached |= 1 << stage;
+    if (stage == LATENCY_SEEN && unseen == event) unseen = 0;
+    if (stage == LATENCY_SHOWN) complete(e);
+}
+
+uint32_t latency_over_budget(void) {
+    return over_budget;
+}
+
+/*-------------------------------------------Report---------------------------------------------------------*/
+static uint32_t percentile(const uint32_t* sorted, uint32_t n, uint32_t p) { //Nearest rank
+    uint32_t rank = (p * n + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+void print_latency_report(FileHandle* out) {
+    uint32_t total, n;
+    {
+        CriticalSectionLock lock;
+        total = completed;
+        print_line(out, "Button to LCD: %lu events (%lu merged, %lu lost), budget %lu us: %lu over\n\r",
+                   (unsigned long)total, (unsigned long)merged, (unsigned long)lost,
+                   (unsigned long)LATENCY_BUDGET_US, (unsigned long)over_budget);
+    }
+    n = total < LATENCY_SAMPLES ? total : LATENCY_SAMPLES;
+    if (n == 0) return;
+    print_line(out, "  %-16s %9s %9s %9s  (last %lu)\n\r", "us", "p50", "p99", "max", (unsigned long)n);
+
+    for (int row = 1; row <= LATENCY_STAGES; row++) { //the stages first, the whole chain last
+        int index = row % LATENCY_STAGES;
+        uint32_t sorted[LATENCY_SAMPLES];
+        {
+            CriticalSectionLock lock; //a copy of one ring at a time, so ISRs are held back only briefly
+            memcpy(sorted, samples[index], n * sizeof(uint32_t));
+        }
+        for (uint32_t i = 1; i < n; i++) { //insertion sort, n is small
+            uint32_t value = sorted[i], j = i;
+            for (; j > 0 && sorted[j - 1] > value; j--) sorted[j] = sorted[j - 1];
+            sorted[j] = value;
+        }
+        print_line(out, "  %-16s %9lu %9lu %9lu\n\r", row_names[index], (unsigned long)to_us(percentile(sorted, n, 50)),
+                   (unsigned long)to_us(percentile(sorted, n, 99)), (unsigned long)to_us(sorted[n - 1]));
+    }
+}
+#endif
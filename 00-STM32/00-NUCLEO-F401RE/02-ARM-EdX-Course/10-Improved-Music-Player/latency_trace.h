@@ -0,0 +1,45 @@
+/*Header file for tracing the time from a button press to the LCD. Each press gets an event ID in its handler, and the
+thread that draws the answer stamps the same ID at every stage with the DWT cycle counter:
+    menu_event = latency_begin();                    //in the ISR, next to next_menu = 1
+    latency_mark(menu_event, LATENCY_SEEN);          //the thread found the flag
+    latency_mark(menu_event, LATENCY_LOCKED);        //it got lcd_mutex
+    latency_mark(menu_event, LATENCY_SHOWN);         //the last byte went out on the SPI bus: the event is complete
+The report gives the median, the 99th percentile and the maximum of every stage and of the whole chain, over the last
+LATENCY_SAMPLES events, and how many of them missed LATENCY_BUDGET_US. With LATENCY_TRACE set to 0 the calls are
+empty. */
+
+#ifndef LATENCY_TRACE_H
+#define LATENCY_TRACE_H
+#include "mbed.h"
+
+#ifndef LATENCY_TRACE
+#define LATENCY_TRACE 1        //0: no tracing, no code, no RAM
+#endif
+#ifndef LATENCY_BUDGET_US
+#define LATENCY_BUDGET_US 5000 //button to pixels
+#endif
+#define LATENCY_SAMPLES   64   //completed events kept for the percentiles
+#define LATENCY_IN_FLIGHT 4    //events pressed but not on the LCD yet
+
+typedef enum {
+    LATENCY_PRESSED,           //handler of the button (stamped by latency_begin)
+    LATENCY_SEEN,              //the drawing thread found the flag
+    LATENCY_LOCKED,            //it holds the LCD mutex
+    LATENCY_SHOWN,             //the text is on the LCD
+    LATENCY_STAGES
+} latency_stage_t;
+
+//Function Prototypes
+#if LATENCY_TRACE
+uint32_t latency_begin(void);                            //ISR: ID of a new event, or of the one still unseen
+void latency_mark(uint32_t event, latency_stage_t stage); //stamps a stage of the event, ID 0 is ignored
+uint32_t latency_over_budget(void);                      //events that missed the budget since the start
+void print_latency_report(FileHandle* out);              //report of the last events, fits rtos_stats_add_report()
+#else
+inline uint32_t latency_begin(void) { return 0; }
+inline void latency_mark(uint32_t, latency_stage_t) {}
+inline uint32_t latency_over_budget(void) { return 0; }
+inline void print_latency_report(FileHandle*) {}
+#endif
+
+#endif
@@ -7,6 +7,39 @@
  Learning outcome: RTOSs program flows are radically different compared to conventional programming code structures. 
  There are different strategies to control the flow safely, and the one imnplemented here is flag-based (or 
  state-variable) thread synchronization.
+
+ + The price of flag-based synchronization shows in the RTOS statistics ("rtos_stats.h", printed on the PC every 5 s
+ or when a key is pressed): the threads keep checking their flags instead of sleeping, so together they take nearly
+ 100 % of the CPU and the time asleep stays near zero even when nothing happens.
+
+ + lcd_mutex is a ProfiledMutex ("profiled_mutex.h"): a Mutex that also measures how often a thread had to wait for
+ the LCD, how long it waited and how long each write held it. Its report comes with the RTOS statistics.
+
+ + The way from a button to the LCD is traced ("latency_trace.h"): the handler stamps the press, and Tune_menu stamps
+ when it finds next_menu, when it gets lcd_mutex and when the menu is on the LCD. The report (median, 99th percentile
+ and maximum of each stage) shows where the time of a press goes, and how many presses missed the 5 ms budget.
+
+ + With SINGLE_THREAD_PLAYER set to 1 the same player runs without the four threads: the button handlers post to one
+ EventQueue, dispatched by main(), and every LCD update and every note is an event of that queue (the next note is
+ scheduled with call_in() for the end of the beat). The events run one after the other on the stack of main, so the
+ LCD needs no mutex, nothing spins on a flag, and the RTOS statistics show the saving: four stacks of OS_STACK_SIZE
+ bytes traded for one queue buffer, and a context switch only when there is something to do.
+
+ + The four threads do not take OS_STACK_SIZE each: their stacks are static buffers sized from their peak use
+ ("stack_budget.h", peaks in "stack_sizes.h") plus a safety margin. With STACK_MEASURE set to 1 the stacks are large
+ and painted, main() presses the buttons itself through every screen and a whole song, and the peaks are printed as
+ the lines of "stack_sizes.h". A normal build checks at startup that no thread has gone past its peak. The peaks are
+ still estimates (STACK_SIZES_MEASURED 0), so the check only warns until a measurement on the board replaces them.
+
+ + Everything also goes into a binary trace ("trace_recorder.h"): the button interrupts, the thread switches, the
+ waits for lcd_mutex, every LCD write and every note, a few cycles per event. Pressing OK while GO is held prints the
+ trace on the PC (a fault prints it too), and "host/trace_to_json.cpp" turns the saved console text into a timeline
+ for chrome://tracing or ui.perfetto.dev.
+
+ + The buttons go through a debouncer ("debouncer.h") instead of bare fall() handlers, which saw the bounces of one
+ press as several and moved the cursor by more than one song. The first edge is the press and calls the handler right
+ away; the edges after it only store their time until the pin has been quiet for 5 ms. Its report comes with the RTOS
+ statistics.
  *******************************************************************************************************************
  * Author: Luciano Carricart, https://github.com/lcarricart/
  * Status: Information Engineering student at HAW Hamburg, Germany.
@@ -14,9 +47,19 @@
  *******************************************************************************************************************/
 
 // Preprocessor directives
+#ifndef SINGLE_THREAD_PLAYER
+#define SINGLE_THREAD_PLAYER 0 //1: one EventQueue in main() instead of the four threads
+#endif
 #include "mbed.h"
 #include "tunes.h"
 #include "4bit_LCD.h"
+#include "rtos_stats.h"
+#include "profiled_mutex.h"
+#include "latency_trace.h"
+#include "trace_recorder.h"
+#include "stack_budget.h"
+#include "stack_sizes.h"
+#include "debouncer.h"
 
 // Object declarations
 PwmOut speaker(D3);           // for piezo sounder
@@ -25,9 +68,17 @@ InterruptIn go(D7);           // button: move to the next menu
 InterruptIn arrow_down(D6);   // button: arrow down
 InterruptIn ok(D5);           // button: OK, select song
 InterruptIn arrow_up(D4);     // button: arrow up
+enum {BTN_GO, BTN_DOWN, BTN_OK, BTN_UP}; // button numbers, in the order they are added to the debouncer
 
+#if SINGLE_THREAD_PLAYER
+// Every event of the player runs in main(), which dispatches this queue
+#define PLAYER_QUEUE_SIZE (16 * EVENTS_EVENT_SIZE) // a few presses and the next note
+EventQueue queue(PLAYER_QUEUE_SIZE);
+int note = 0;       // next note of the song being played
+#else
 // Mutual Exclusive for shared LCD
-Mutex lcd_mutex;
+ProfiledMutex lcd_mutex("lcd_mutex");
+#endif
 
 // These flags indicate state of player
 bool welcome = 1;   // Indicates welcome state
@@ -39,16 +90,84 @@ bool playing = 0;   // tune is playing
 int cursor = 1;
 int ok_button = 0;
 int next_menu = 0;
+uint32_t menu_event = 0; // latency trace of the press behind next_menu
+
+// Names of the button interrupts and of the notes in the trace
+uint8_t trace_go, trace_down, trace_up, trace_ok, trace_note;
 
 // Prototypes
+void select_song(void);
+void draw_welcome(void);
+void draw_menu(void);
+void draw_playing(void);
+void draw_waiting(void);
 void LCD_cont(void);
 void Tune_select(void);
 void Play_tune(void);
 
+//-------------- Screens ----------------//
+
+// Loads the song pointer of the cursor position
+void select_song()
+{
+    switch (cursor)
+    {
+    case 1: song_ptr = &Oranges; break;
+    case 2: song_ptr = &Cielito; break;
+    case 3: song_ptr = &Malaika; break;
+    case 4: song_ptr = &Guten_Abend; break;
+    case 5: song_ptr = &Yankee; break;
+    case 6: song_ptr = &Rasa; break;
+    case 7: song_ptr = &Matilda; break;
+    case 8: song_ptr = &Alouetta; break;
+    case 9: song_ptr = &Twinkle; break;
+    }
+}
+
+// The LCD is shared: the callers hold lcd_mutex (threads) or run one at a time (EventQueue)
+void draw_welcome()
+{
+    clr_lcd();             // Clear the LCD
+    print_lcd("Your MUSIC Player!");
+    write_cmd(0xc0);
+    print_lcd("Press GO to continue");
+    write_cmd(0xD4);
+    print_lcd("Status: Ready");
+}
+
+void draw_menu()
+{
+    clr_lcd();
+    print_lcd("Select a song:");
+    select_song();
+    write_cmd(0xc0);
+    print_lcd(song_ptr->name); // display song name
+    write_cmd(0xD4);
+    print_lcd("Status: Choosing...");
+}
+
+void draw_playing()
+{
+    clr_lcd();
+    print_lcd("Now playing:");
+    write_cmd(0xc0);
+    print_lcd(song_ptr->name); // display song name
+    write_cmd(0xD4);
+    print_lcd("Status: Playing!!");
+}
+
+void draw_waiting()
+{
+    write_cmd(0xD4);
+    print_lcd("Status: Waiting...");
+}
+
+#if !SINGLE_THREAD_PLAYER
 //-------------- Threads ----------------//
 
 // Displays welcome message on LCD
-Thread thread1;
+BUDGETED_STACK(lcd_cont_stack, STACK_LCD_CONT);
+Thread thread1(osPriorityNormal, sizeof(lcd_cont_stack), lcd_cont_stack, "LCD_cont");
 void LCD_cont() 
 {
     init_lcd();
@@ -59,12 +178,7 @@ void LCD_cont()
         if (welcome) 
         {
             lcd_mutex.lock();
-            clr_lcd();             // Clear the LCD
-            print_lcd("Your MUSIC Player!");
-            write_cmd(0xc0);
-            print_lcd("Press GO to continue");
-            write_cmd(0xD4);
-            print_lcd("Status: Ready");
+            draw_welcome();
             lcd_mutex.unlock();
             thread_sleep_for(500);
             welcome = 0;
@@ -73,7 +187,8 @@ void LCD_cont()
 }
 
 // Displays the Song-selection menu
-Thread thread_songs_menu;
+BUDGETED_STACK(tune_menu_stack, STACK_TUNE_MENU);
+Thread thread_songs_menu(osPriorityNormal, sizeof(tune_menu_stack), tune_menu_stack, "Tune_menu");
 void Tune_menu()
 {
     while (1)
@@ -81,27 +196,12 @@ void Tune_menu()
         // Shows the song selection menu if next_menu is high (triggered by interrupts)
         if (next_menu == 1)
         {
+            uint32_t event = menu_event;
+            latency_mark(event, LATENCY_SEEN);
             lcd_mutex.lock();
-            clr_lcd();
-            print_lcd("Select a song:");
-
-            switch (cursor)
-            {
-            case 1: song_ptr = &Oranges; break;
-            case 2: song_ptr = &Cielito; break;
-            case 3: song_ptr = &Malaika; break;
-            case 4: song_ptr = &Guten_Abend; break;
-            case 5: song_ptr = &Yankee; break;
-            case 6: song_ptr = &Rasa; break;
-            case 7: song_ptr = &Matilda; break;
-            case 8: song_ptr = &Alouetta; break;
-            case 9: song_ptr = &Twinkle; break;
-            }
-
-            write_cmd(0xc0);
-            print_lcd(song_ptr->name); // display song name
-            write_cmd(0xD4);
-            print_lcd("Status: Choosing...");
+            latency_mark(event, LATENCY_LOCKED);
+            draw_menu();
+            latency_mark(event, LATENCY_SHOWN);
             lcd_mutex.unlock();
             thread_sleep_for(100);
 
@@ -111,33 +211,18 @@ void Tune_menu()
 }
 
 // Reads the select buttons and prepares the song
-Thread thread2;
+BUDGETED_STACK(tune_select_stack, STACK_TUNE_SELECT);
+Thread thread2(osPriorityNormal, sizeof(tune_select_stack), tune_select_stack, "Tune_select");
 void Tune_select() 
 {
     while (1) 
     {
         if (ok_button)           // "ok_button" is set by Interrupt
         {        
-            switch (cursor)      // read song selection and load song pointer
-            {    
-            case 1: song_ptr = &Oranges; break;
-            case 2: song_ptr = &Cielito; break;
-            case 3: song_ptr = &Malaika; break;
-            case 4: song_ptr = &Guten_Abend; break;
-            case 5: song_ptr = &Yankee; break;
-            case 6: song_ptr = &Rasa; break;
-            case 7: song_ptr = &Matilda; break;
-            case 8: song_ptr = &Alouetta; break;
-            case 9: song_ptr = &Twinkle; break;
-            }
+            select_song();       // read song selection and load song pointer
 
             lcd_mutex.lock();
-            clr_lcd();           
-            print_lcd("Now playing:");
-            write_cmd(0xc0);
-            print_lcd(song_ptr->name); // display song name
-            write_cmd(0xD4);
-            print_lcd("Status: Playing!!");
+            draw_playing();
             lcd_mutex.unlock();
 
             ok_button = 0;
@@ -147,7 +232,8 @@ void Tune_select()
 }
 
 // Plays the chosen tune
-Thread thread3;
+BUDGETED_STACK(play_tune_stack, STACK_PLAY_TUNE);
+Thread thread3(osPriorityNormal, sizeof(play_tune_stack), play_tune_stack, "Play_tune");
 void Play_tune() 
 {
     while (1) 
@@ -158,6 +244,7 @@ void Play_tune()
             speaker.resume();
             for (int i = 0; i <= (song_ptr->length); i++) {
                 speaker.period(1 / (2 * (*song_ptr).freq[i]));  // set PWM period
+                trace_record(TRACE_INSTANT, trace_note, (uint16_t)(*song_ptr).freq[i]);
                 speaker = volume;                               // set duty cycle, hence volume control
                 thread_sleep_for(200 * (*song_ptr).beat[i]);    // hold for beat period
             }
@@ -165,8 +252,7 @@ void Play_tune()
 
             // Indicate end of song
             lcd_mutex.lock();
-            write_cmd(0xD4);
-            print_lcd("Status: Waiting...");
+            draw_waiting();
             lcd_mutex.unlock();
             thread_sleep_for(1000);
 
@@ -177,59 +263,221 @@ void Play_tune()
     }
 }
 
+#else
+//-------------- Events -----------------//
+
+void end_song()
+{
+    playing = false;
+    speaker.suspend();
+    draw_welcome();
+}
+
+// Plays one note and schedules the next one for the end of its beat
+void play_note()
+{
+    if (note <= song_ptr->length)
+    {
+        speaker.period(1 / (2 * (*song_ptr).freq[note]));  // set PWM period
+        trace_record(TRACE_INSTANT, trace_note, (uint16_t)(*song_ptr).freq[note]);
+        speaker = volume;                                  // set duty cycle, hence volume control
+        queue.call_in(std::chrono::milliseconds((int)(200 * (*song_ptr).beat[note])), play_note);
+        note++;
+        return;
+    }
+    speaker = 0;                                           // To shut the sound, volume = 0;
+    draw_waiting();                                        // Indicate end of song
+    queue.call_in(1000ms, end_song);
+}
+
+void start_song()
+{
+    select_song();
+    draw_playing();
+    playing = 1;
+    speaker.resume();      // Resume PWM operation, stopped after last song
+    note = 0;
+    play_note();
+}
+
+// Answers the flags set by the handlers. The flags are cleared before the LCD is drawn, so a press during the drawing
+// posts another event and is answered too.
+void on_buttons()
+{
+    if (next_menu == 1)
+    {
+        uint32_t event = menu_event;
+        next_menu = 0;
+        latency_mark(event, LATENCY_SEEN);
+        latency_mark(event, LATENCY_LOCKED); // no mutex: the LCD is never busy when an event starts
+        draw_menu();
+        latency_mark(event, LATENCY_SHOWN);
+    }
+    if (ok_button)
+    {
+        ok_button = 0;
+        start_song();
+    }
+    trace_dump_if_requested(mbed_file_handle(STDOUT_FILENO));
+}
+
+// The RAM the queue saves, next to the RTOS statistics
+void print_player_report(FileHandle* out)
+{
+    char line[128];
+    int len = snprintf(line, sizeof(line), "Player: one EventQueue of %u bytes instead of 4 threads of %u bytes\n\r",
+                       (unsigned)PLAYER_QUEUE_SIZE, (unsigned)(OS_STACK_SIZE + sizeof(Thread)));
+    if (len > (int)sizeof(line) - 1) len = sizeof(line) - 1;
+    if (len > 0) out->write(line, len);
+}
+#endif
+
 /*-------------- Handlers ---------------*/
 
 // Responds to press of GO button, and sets "next_menu"
 void go_handler() {
+    trace_record(TRACE_ISR_ENTER, trace_go);
     if (playing == 0) // Only set "next_menu" if the song is not playing
+    {
+        menu_event = latency_begin();
         next_menu = 1;
+    }
+    trace_record(TRACE_ISR_EXIT, trace_go);
 }
 
 // Responds to press of DOWN button
 void down_handler()
 {
+    trace_record(TRACE_ISR_ENTER, trace_down);
     if (playing == 0)
     {
         cursor--;
+        menu_event = latency_begin();
         next_menu = 1;      // To show the song selection menu again
         if (cursor < 1) cursor = 9;
     }
+    trace_record(TRACE_ISR_EXIT, trace_down);
 }
 
 // Responds to press of UP button
 void up_handler()
 {
+    trace_record(TRACE_ISR_ENTER, trace_up);
     if (playing == 0)
     {
         cursor++;
+        menu_event = latency_begin();
         next_menu = 1;      // To show the song selection menu again
         if (cursor > 9) cursor = 1;
     }
+    trace_record(TRACE_ISR_EXIT, trace_up);
 }
 
-// Responds to press of OK button
+// Responds to press of OK button. OK while GO is held asks for the trace instead.
 void ok_handler()
 {
-    if (playing == 0) ok_button = 1;
+    trace_record(TRACE_ISR_ENTER, trace_ok);
+    if (go.read() == 0) trace_request_dump();
+    else if (playing == 0) ok_button = 1;
+    trace_record(TRACE_ISR_EXIT, trace_ok);
+}
+
+#if !SINGLE_THREAD_PLAYER && STACK_MEASURE
+// Workload of the stack measurement: every screen and a whole song, the buttons pressed by the program
+void stack_workload()
+{
+    static void (*const presses[])(void) = {go_handler, up_handler, up_handler, down_handler, down_handler, ok_handler};
+    for (unsigned i = 0; i < sizeof(presses) / sizeof(presses[0]); i++)
+    {
+        thread_sleep_for(1000);
+        presses[i]();
+    }
+    while (!playing) thread_sleep_for(100);
+    while (playing) thread_sleep_for(100);
+    print_stack_report(mbed_file_handle(STDOUT_FILENO));
+}
+#endif
+
+// The presses from the debouncer, in interrupt context: the handlers above set the flags. With SINGLE_THREAD_PLAYER
+// the queue answers them in main().
+void button_event(const button_event_t& event)
+{
+    static void (*const handlers[])(void) = {go_handler, down_handler, ok_handler, up_handler}; // by button number
+    if (event.type != BUTTON_PRESS || event.glitch) return; // a glitch press only puts back a held button
+    handlers[event.button]();
+#if SINGLE_THREAD_PLAYER
+    queue.call(on_buttons);
+#endif
+}
+Debouncer buttons(button_event);
+
+// The debouncer counters, next to the RTOS statistics
+void print_button_report(FileHandle* out)
+{
+    buttons.print_report(out);
 }
 
 //--------------- Main ------------------//
 int main() 
 {
-    // Falling edge interrupts for buttons
-    go.fall(&go_handler);      
-    arrow_down.fall(&down_handler);
-    ok.fall(&ok_handler);
-    arrow_up.fall(&up_handler);
+    rtos_stats_init(); // CPU and stack statistics per thread, printed on the PC every 5 s
+    rtos_stats_start_reporter(mbed_file_handle(STDOUT_FILENO), 5000);
+#if SINGLE_THREAD_PLAYER
+    rtos_stats_add_report(print_player_report); // and the RAM of the queue against the threads
+#else
+    rtos_stats_add_report(print_mutex_reports); // and the lcd_mutex measurements with them
+    rtos_stats_add_report(print_stack_report); // and the stacks against their budgets
+#endif
+    rtos_stats_add_report(print_latency_report); // and the button to LCD latencies
+    rtos_stats_add_report(print_button_report); // and the bounces of the buttons
 
-    // Launch the threads
+    trace_init(); // the trace: names of the interrupts and notes, thread switches and lcd_mutex waits
+    trace_go = trace_name("GO");
+    trace_down = trace_name("DOWN");
+    trace_up = trace_name("UP");
+    trace_ok = trace_name("OK");
+    trace_note = trace_name("note");
+    rtos_stats_set_switch_hook(trace_switch_hook);
+    profiled_mutex_set_wait_hook(trace_wait_hook);
+
+    // Both edges of the buttons go to the debouncer, the presses come out in button_event()
+    buttons.add(go, "GO");
+    buttons.add(arrow_down, "DOWN");
+    buttons.add(ok, "OK");
+    buttons.add(arrow_up, "UP");
+
+#if SINGLE_THREAD_PLAYER
+    init_lcd();
+    draw_welcome();
+    queue.dispatch_forever(); // runs the events, sleeping in between
+#else
+    // Paint the stacks, then launch the threads
+    STACK_BUDGET_ADD(lcd_cont_stack, STACK_LCD_CONT);
+    STACK_BUDGET_ADD(tune_menu_stack, STACK_TUNE_MENU);
+    STACK_BUDGET_ADD(tune_select_stack, STACK_TUNE_SELECT);
+    STACK_BUDGET_ADD(play_tune_stack, STACK_PLAY_TUNE);
     thread1.start(callback(LCD_cont));
     thread_songs_menu.start(callback(Tune_menu));
     thread2.start(callback(Tune_select));
     thread3.start(callback(Play_tune));
 
+#if STACK_MEASURE
+    stack_workload();
+#else
+    thread_sleep_for(STACK_CHECK_MS); // Startup check: the first round of the threads stayed within stack_sizes.h
+    bool stacks_ok = stack_budget_check(mbed_file_handle(STDOUT_FILENO));
+#if STACK_SIZES_MEASURED
+    if (!stacks_ok) error("Stacks past their budget, see stack_sizes.h\n");
+#else
+    printf("Warning: the stack sizes are estimates%s, measure them with STACK_MEASURE 1\n\r",
+           stacks_ok ? "" : " and a thread went past one");
+#endif
+#endif
+
     while (1) 
     {
-        __WFI(); // Wait For Interrupt
+        rtos_stats_wfi(); // Wait For Interrupt, counting the time asleep
+        trace_dump_if_requested(mbed_file_handle(STDOUT_FILENO));
     }
+#endif
 }
@@ -0,0 +1,160 @@
+/*A Mutex that measures the waits for it and the time it is held, using the DWT cycle counter (a register read, so
+the measurement adds well under a microsecond to a lock). A lock first tries to take the mutex without waiting; only
+if that fails it counts as contended, and the owner's priority is compared with the caller's to spot a priority
+inversion. Mbed's Mutex has priority inheritance, so the owner is raised while a higher priority thread waits, but the
+wait still lasts as long as the owner holds the mutex: a long hold in the histogram means a slow button response.
+The statistics are only written by the thread that holds the mutex, so the mutex protects them itself: the report
+takes it too for its copy and the reset, a recursive lock if the reporting thread already holds it. */
+
+#include "profiled_mutex.h"
+#include "report_line.h"
+#include <cstdio>
+#include <cstring>
+
+#if MUTEX_PROFILING
+static ProfiledMutex* first_mutex = nullptr;   //all profiled mutexes, newest first
+static void (*wait_hook)(const char* name, bool waiting) = nullptr;
+
+static uint32_t to_us(uint32_t cycles) {
+    return cycles / (SystemCoreClock / 1000000);
+}
+
+static int bin_of(uint32_t us) {
+    int bin = 0;
+    while (bin < MUTEX_HIST_BINS - 1 && us >= ((uint32_t)MUTEX_HIST_FIRST_US << bin)) bin++;
+    return bin;
+}
+
+ProfiledMutex::ProfiledMutex(const char* name) : mutex(name), name(name), depth(0), hold_start(0) {
+    memset(&stats, 0, sizeof(stats));
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    CriticalSectionLock lock;
+    next = first_mutex;
+    first_mutex = this;
+}
+
+bool ProfiledMutex::is_inversion(void) { //The owner runs at a lower priority than the thread that has to wait
+    osThreadId_t owner = mutex.get_owner();
+    return owner != nullptr && osThreadGetPriority(ThisThread::get_id()) > osThreadGetPriority(owner);
+}
+
+void ProfiledMutex::acquired(uint32_t wait_cycles, bool inverted) { //Runs with the mutex held
+    if (depth++ > 0) return;     //a recursive lock, the outermost one is measured
+
+    stats.locks++;
+    if (wait_cycles) {
+        uint32_t wait = to_us(wait_cycles);
+        stats.contended++;
+        if (inverted) stats.inversions++;
+        stats.wait_total += wait;
+        if (wait > stats.wait_max) stats.wait_max = wait;
+        stats.wait_hist[bin_of(wait)]++;
+    } else {
+        stats.wait_hist[0]++;
+    }
+    hold_start = DWT->CYCCNT;
+}
+
+void ProfiledMutex::lock(void) {
+    if (mutex.trylock()) {
+        acquired(0, false);
+        return;
+    }
+    bool inverted = is_inversion();
+    uint32_t start = DWT->CYCCNT;
+    if (wait_hook) wait_hook(name, true);
+    mutex.lock();
+    if (wait_hook) wait_hook(name, false);
+    acquired((DWT->CYCCNT - start) | 1, inverted); //| 1: a wait is never 0 cycles
+}
+
+bool ProfiledMutex::trylock(void) {
+    if (!mutex.trylock()) return false;
+    acquired(0, false);
+    return true;
+}
+
+bool ProfiledMutex::trylock_for(Kernel::Clock::duration_u32 rel_time) {
+    if (mutex.trylock()) {
+        acquired(0, false);
+        return true;
+    }
+    bool inverted = is_inversion();
+    uint32_t start = DWT->CYCCNT;
+    if (wait_hook) wait_hook(name, true);
+    bool locked = mutex.trylock_for(rel_time);
+    if (wait_hook) wait_hook(name, false);
+    if (!locked) return false;
+    acquired((DWT->CYCCNT - start) | 1, inverted);
+    return true;
+}
+
+void ProfiledMutex::unlock(void) {
+    if (--depth == 0) {
+        uint32_t hold = to_us(DWT->CYCCNT - hold_start);
+        stats.hold_total += hold;
+        if (hold >= stats.hold_max) {
+            stats.hold_max = hold;
+            stats.longest_holder = osThreadGetName(ThisThread::get_id());
+        }
+        stats.hold_hist[bin_of(hold)]++;
+    }
+    mutex.unlock();
+}
+
+void ProfiledMutex::get_stats(mutex_stats_t* copy) { //May be one lock behind if a thread is updating them right now
+    CriticalSectionLock lock;
+    *copy = stats;
+}
+
+/*-------------------------------------------Report---------------------------------------------------------*/
+static void print_histogram(FileHandle* out, const char* label, const uint32_t* hist) { //Only the bins in use
+    char line[160];
+    int len = snprintf(line, sizeof(line), "  %s", label);
+    for (int bin = 0; bin < MUTEX_HIST_BINS && len < (int)sizeof(line); bin++) {
+        if (hist[bin] == 0) continue;
+        uint32_t limit = (uint32_t)MUTEX_HIST_FIRST_US << (bin < MUTEX_HIST_BINS - 1 ? bin : bin - 1);
+        bool ms = limit >= 1000;
+        len += snprintf(line + len, sizeof(line) - len, " %s%lu%s:%lu", bin < MUTEX_HIST_BINS - 1 ? "<" : ">=",
+                        (unsigned long)(ms ? limit / 1000 : limit), ms ? "ms" : "us", (unsigned long)hist[bin]);
+    }
+    if (len > (int)sizeof(line) - 3) len = sizeof(line) - 3;
+    line[len++] = '\n';
+    line[len++] = '\r';
+    out->write(line, len);
+}
+
+void ProfiledMutex::print_report(FileHandle* out) {
+    mutex_stats_t s;
+    mutex.lock();                         //not in the middle of a lock() or unlock() of another thread
+    s = stats;
+    memset(&stats, 0, sizeof(stats));     //the next report starts over
+    mutex.unlock();
+
+    uint32_t contended_permille = s.locks ? (uint32_t)((uint64_t)s.contended * 1000 / s.locks) : 0;
+    print_line(out, "%s: %lu locks, %lu waited (%lu.%lu %%), %lu priority inversions\n\r", name,
+               (unsigned long)s.locks, (unsigned long)s.contended, (unsigned long)(contended_permille / 10),
+               (unsigned long)(contended_permille % 10), (unsigned long)s.inversions);
+    if (s.locks == 0) return;
+    print_line(out, "  wait mean %lu us when waited, max %lu us; hold mean %lu us, max %lu us (%s)\n\r",
+               (unsigned long)(s.contended ? s.wait_total / s.contended : 0), (unsigned long)s.wait_max,
+               (unsigned long)(s.hold_total / s.locks), (unsigned long)s.hold_max,
+               s.longest_holder ? s.longest_holder : "no name");
+    print_histogram(out, "wait", s.wait_hist);
+    print_histogram(out, "hold", s.hold_hist);
+}
+
+void print_mutex_reports(FileHandle* out) {
+    for (ProfiledMutex* m = first_mutex; m != nullptr; m = m->next) m->print_report(out);
+}
+
+void profiled_mutex_set_wait_hook(void (*hook)(const char* name, bool waiting)) {
+    wait_hook = hook;
+}
+
+#else
+void print_mutex_reports(FileHandle*) {}
+void profiled_mutex_set_wait_hook(void (*)(const char*, bool)) {}
+#endif
@@ -0,0 +1,15 @@
+/*Report lines, shared by every module that prints a report. */
+
+#include "report_line.h"
+#include <cstdarg>
+#include <cstdio>
+
+void print_line(FileHandle* out, const char* format, ...) {
+    char line[REPORT_LINE_SIZE];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (len > (int)sizeof(line) - 1) len = sizeof(line) - 1;
+    if (len > 0) out->write(line, len);
+}
@@ -0,0 +1,17 @@
+/*Header file for the lines of the reports (RTOS statistics, mutexes, timers, ...). print_line() formats one line into
+a buffer on the stack of the caller and writes it to the FileHandle in a single write(), so a line is never split by
+the output of another thread. A line longer than REPORT_LINE_SIZE - 1 characters is cut.
+The columns of the reports come from printf field widths and precisions (%-16.16s, %4d, %3lu.%lu...), which the
+minimal printf that Mbed OS 6 links by default ignores. That is why the project sets "target.printf_lib": "std" in
+its mbed_app.json. */
+
+#ifndef REPORT_LINE_H
+#define REPORT_LINE_H
+#include "mbed.h"
+
+#define REPORT_LINE_SIZE 128 //bytes, on the stack of the thread that prints
+
+//Function Prototypes
+void print_line(FileHandle* out, const char* format, ...); //printf-like, the line ends with "\n\r" in the format
+
+#endif
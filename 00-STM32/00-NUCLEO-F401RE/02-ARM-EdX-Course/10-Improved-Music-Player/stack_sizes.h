@@ -0,0 +1,19 @@
+/*Stack peaks of the threads, in bytes, as printed by print_stack_report() in a STACK_MEASURE 1 build. Each stack is
+its peak plus the margin of "stack_budget.h". Once the numbers come from the board STACK_SIZES_MEASURED goes to 1, and
+the startup check stops the program when a thread goes past the number below; until then it only prints a warning.
+
+These numbers are NOT measured yet: they are estimates from the call chains (the LCD writes go through SPI::write and
+a mutex, Play_tune also through the float PWM and ADC code) with some room. The threads also changed after they were
+written: trace points, and the buttons now come from the debouncer. */
+
+#ifndef STACK_SIZES_H
+#define STACK_SIZES_H
+
+#define STACK_SIZES_MEASURED     0   //1: the numbers below come from a STACK_MEASURE run on the board
+
+#define STACK_LCD_CONT           560
+#define STACK_TUNE_MENU          560
+#define STACK_TUNE_SELECT        560
+#define STACK_PLAY_TUNE          640
+
+#endif
@@ -0,0 +1,130 @@
+/*Trace recorder. Writers never wait for each other: the atomic increment of trace_head (LDREX/STREX) gives each
+event its own slot, and an interrupt that comes between the increment and the stores of a thread writes its event in
+the next slot. The ring is only read by trace_dump(), which stops the recording first; an event whose slot was taken
+just before may be half written in the dump, which the converter shows as an odd event, never as a crash.
+
+The dump is text, so that it survives any terminal program and can be saved from it (it also leaves the reports of
+rtos_stats readable around it):
+    @TRACE 1 <clock Hz> <events in the dump> <events recorded since the start> <cycles per event>
+    @N <index> <name>                                          one line per name
+    @E <cycles:8 hex><type:2><id:2><arg:4> ...                 eight events per line, oldest first
+    @END */
+
+#include "trace_recorder.h"
+#include <cstdarg>
+#include <cstdio>
+
+#if TRACE_RECORDER
+#define TRACE_VERSION    1
+#define TRACE_PER_LINE   8
+#define TRACE_COST_LOOPS 32
+
+trace_event_t trace_ring[TRACE_EVENTS];
+std::atomic<uint32_t> trace_head(0);
+volatile bool trace_frozen = false;
+
+static const char* names[TRACE_NAMES];
+static std::atomic<uint32_t> name_count(0);
+static volatile bool dump_requested = false;
+static uint32_t cost_cycles = 0;               //of one trace_record(), measured by trace_init()
+
+void trace_init(void) {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    uint32_t start = DWT->CYCCNT;
+    for (int i = 0; i < TRACE_COST_LOOPS; i++) trace_record(TRACE_INSTANT, 0, (uint16_t)i);
+    cost_cycles = (DWT->CYCCNT - start) / TRACE_COST_LOOPS;
+    trace_head.store(0);                       //the measurement is not part of the trace
+}
+
+uint8_t trace_name(const char* name) {
+    uint32_t count = name_count.load();
+    for (uint32_t i = 0; i < count; i++) {
+        if (names[i] == name) return (uint8_t)i;
+    }
+    CriticalSectionLock lock;                  //another caller may have added it meanwhile
+    count = name_count.load();
+    for (uint32_t i = 0; i < count; i++) {
+        if (names[i] == name) return (uint8_t)i;
+    }
+    if (count == TRACE_NAMES) return TRACE_NAMES - 1; //full: the last name stands for the rest
+    names[count] = name;
+    name_count.store(count + 1);
+    return (uint8_t)count;
+}
+
+void trace_switch_hook(const char* thread) { //From the context switch (PendSV)
+    trace_record(TRACE_SWITCH, trace_name(thread ? thread : "(no name)"));
+}
+
+void trace_wait_hook(const char* mutex, bool waiting) {
+    trace_record(waiting ? TRACE_WAIT_BEGIN : TRACE_WAIT_END, trace_name(mutex));
+}
+
+void trace_request_dump(void) {
+    dump_requested = true;
+}
+
+bool trace_dump_if_requested(FileHandle* out) {
+    if (!dump_requested) return false;
+    dump_requested = false;
+    trace_dump(out);
+    return true;
+}
+
+/*-------------------------------------------Dump-----------------------------------------------------------*/
+typedef void (*emit_t)(FileHandle* out, const char* line, int len); //out: nullptr from the fault handler
+
+static void emit_file(FileHandle* out, const char* line, int len) {
+    out->write(line, len);
+}
+
+static void emit_error(FileHandle*, const char* line, int len) { //The console of the fault handler: no mutex
+    mbed_error_printf("%.*s", len, line);
+}
+
+static void print_line(emit_t emit, FileHandle* out, const char* format, ...) {
+    char line[TRACE_PER_LINE * 17 + 8];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (len > (int)sizeof(line) - 1) len = sizeof(line) - 1;
+    if (len > 0) emit(out, line, len);
+}
+
+static void dump(emit_t emit, FileHandle* out) {
+    trace_frozen = true;
+    uint32_t head = trace_head.load();
+    uint32_t count = head < TRACE_EVENTS ? head : TRACE_EVENTS;
+
+    print_line(emit, out, "\n\r@TRACE %d %lu %lu %lu %lu\n\r", TRACE_VERSION, (unsigned long)SystemCoreClock,
+               (unsigned long)count, (unsigned long)head, (unsigned long)cost_cycles);
+    for (uint32_t i = 0; i < name_count.load(); i++) print_line(emit, out, "@N %lu %s\n\r", (unsigned long)i, names[i]);
+
+    for (uint32_t first = head - count; first != head;) {
+        char line[TRACE_PER_LINE * 17 + 8] = "@E";
+        int len = 2;
+        for (int n = 0; n < TRACE_PER_LINE && first != head; n++, first++) {
+            const trace_event_t& e = trace_ring[first & (TRACE_EVENTS - 1)];
+            len += snprintf(line + len, sizeof(line) - len, " %08lx%02x%02x%04x", (unsigned long)e.cycles, e.type, e.id,
+                            e.arg);
+        }
+        line[len++] = '\n';
+        line[len++] = '\r';
+        emit(out, line, len);
+    }
+    print_line(emit, out, "@END\n\r");
+    trace_frozen = false;
+}
+
+void trace_dump(FileHandle* out) {
+    dump(emit_file, out);
+}
+
+//Called by Mbed OS on a fatal error or a fault, before it halts: the last events before the crash
+extern "C" void mbed_error_hook(const mbed_error_ctx*) {
+    dump(emit_error, nullptr);
+}
+#endif
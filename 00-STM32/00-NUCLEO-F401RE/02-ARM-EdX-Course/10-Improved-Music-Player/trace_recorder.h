@@ -0,0 +1,76 @@
+/*Header file for a binary trace recorder: interrupts, thread switches, mutex waits and markers of the program on one
+timeline. An event is 8 bytes (cycle counter, type, name, argument) written into a RAM ring by an inline function:
+one read of the DWT cycle counter, one atomic increment of the ring index and three stores, with no lock, so it can
+be called from interrupts and threads alike:
+    uint8_t go_id = trace_name("GO");       //once: the names go into the dump, not into the ring
+    trace_record(TRACE_ISR_ENTER, go_id);   //in the handler
+    trace_record(TRACE_ISR_EXIT, go_id);
+The ring keeps the last TRACE_EVENTS events. trace_dump() prints them on the console as lines of hex, with the
+names and the clock; a fault prints them too (mbed_error_hook). "host/trace_to_json.cpp" turns a captured console
+log into a Chrome trace (chrome://tracing or ui.perfetto.dev). With TRACE_RECORDER set to 0 the calls are empty. */
+
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+#include "mbed.h"
+#include <atomic>
+
+#ifndef TRACE_RECORDER
+#define TRACE_RECORDER 1      //0: no recording, no code, no RAM
+#endif
+#define TRACE_EVENTS   512    //events in the ring, a power of 2: 4 KB
+#define TRACE_NAMES    32     //names of trace points, threads and mutexes
+
+typedef enum {
+    TRACE_ISR_ENTER,          //id: the interrupt
+    TRACE_ISR_EXIT,
+    TRACE_SWITCH,             //id: the thread switched in
+    TRACE_WAIT_BEGIN,         //id: the mutex the running thread waits for
+    TRACE_WAIT_END,
+    TRACE_BEGIN,              //id: a section of the running thread, e.g. an LCD write
+    TRACE_END,
+    TRACE_INSTANT,            //id: a point in time, arg: a value, e.g. the frequency of a note
+    TRACE_TYPES
+} trace_type_t;
+
+typedef struct {
+    uint32_t cycles;          //DWT->CYCCNT
+    uint8_t type;             //trace_type_t
+    uint8_t id;               //index of the name
+    uint16_t arg;
+} trace_event_t;
+
+#if TRACE_RECORDER
+extern trace_event_t trace_ring[TRACE_EVENTS];
+extern std::atomic<uint32_t> trace_head;      //events ever recorded, the slot is head % TRACE_EVENTS
+extern volatile bool trace_frozen;             //while the ring is dumped
+
+inline void trace_record(trace_type_t type, uint8_t id, uint16_t arg = 0) {
+    uint32_t now = DWT->CYCCNT;
+    if (trace_frozen) return;
+    trace_event_t& e = trace_ring[trace_head.fetch_add(1, std::memory_order_relaxed) & (TRACE_EVENTS - 1)];
+    e.cycles = now;
+    e.type = (uint8_t)type;
+    e.id = id;
+    e.arg = arg;
+}
+
+//Function Prototypes
+void trace_init(void);                        //starts the cycle counter and measures the cost of an event
+uint8_t trace_name(const char* name);         //index of a name, the same pointer gives the same index; ISR-safe
+void trace_switch_hook(const char* thread);   //for rtos_stats_set_switch_hook()
+void trace_wait_hook(const char* mutex, bool waiting); //for profiled_mutex_set_wait_hook()
+void trace_request_dump(void);                //ISR-safe: trace_dump_if_requested() will dump
+bool trace_dump_if_requested(FileHandle* out);
+void trace_dump(FileHandle* out);             //the ring, oldest event first; recording pauses meanwhile
+#else
+inline void trace_record(trace_type_t, uint8_t, uint16_t = 0) {}
+inline void trace_init(void) {}
+inline uint8_t trace_name(const char*) { return 0; }
+inline void trace_switch_hook(const char*) {}
+inline void trace_wait_hook(const char*, bool) {}
+inline void trace_request_dump(void) {}
+inline bool trace_dump_if_requested(FileHandle*) { return false; }
+inline void trace_dump(FileHandle*) {}
+#endif
+
+#endif
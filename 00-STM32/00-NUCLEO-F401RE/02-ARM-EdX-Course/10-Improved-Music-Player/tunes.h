@@ -69,11 +69,10 @@ struct Songs Alouetta = {
     .beat = {3,1,2,2,1.5,0.5,1.5,0.5,2,2,3,1,2,2,1.5,0.5,1.5,0.5,2}
 };
 
-/*A spare song!
+//A spare song!
 struct Songs Twinkle = {
     .name = "Twinkle",
     .length = 13,
     .freq = {440,440,659,659,740,740,659,587,587,554,554,494,494,440}, //frequency array
     .beat = {2,2,2,2,2,2,4,2,2,2,2,2,2,4} //beat array
-};
-*/
\ No newline at end of file
+};
\ No newline at end of file
@@ -0,0 +1,216 @@
+/*A simple terminal renderer using ANSI escape sequences. Two copies of the screen are kept: "shown" holds what the
+terminal is displaying right now and "wanted" what the program asked for. A refresh compares both and only sends the
+characters that differ, moving the cursor with the shortest sequence available. Navigating the menu then costs a
+handful of bytes instead of redrawing every line (and the terminal does not scroll anymore). */
+
+#include "ansi_screen.h"
+#include <cstdio>
+#include <cstring>
+
+static char shown[SCREEN_ROWS][SCREEN_COLS];   // what the terminal displays
+static char wanted[SCREEN_ROWS][SCREEN_COLS];  // what the program wants to display
+static int cur_row = -1;                       // terminal cursor position, -1 when unknown
+static int cur_col = -1;
+
+static screen_sink_t screen_sink;
+static unsigned long bytes_sent = 0;
+
+static char out_buf[256];                      // output is collected here and handed to the sink in one go
+static int out_len = 0;
+
+static void flush_out(void) { //Hands the collected bytes to the sink
+    if (out_len > 0) {
+        screen_sink(out_buf, out_len);
+        bytes_sent += out_len;
+        out_len = 0;
+    }
+}
+
+static void put_bytes(const char* data, int length) { //Queues bytes for the terminal
+    if (out_len + length > (int)sizeof(out_buf)) flush_out();
+    memcpy(out_buf + out_len, data, length);
+    out_len += length;
+}
+
+static int arrow_seq(char* seq, int count, char direction) { //ESC[nX, where n can be left out when it is 1
+    if (count == 1) return sprintf(seq, "\033[%c", direction);
+    return sprintf(seq, "\033[%d%c", count, direction);
+}
+
+static int reprint(char* seq, int row, int from, int to) { //Moves right by re-sending the characters already shown
+    memcpy(seq, &shown[row][from], to - from);
+    return to - from;
+}
+
+static int move_horizontal(char* seq, int row, int from, int to) { //Cheapest way to go from column "from" to "to"
+    char option[SCREEN_COLS + 8];
+    int best, len;
+
+    if (to == from) return 0;
+
+    if (to > from) {
+        best = reprint(seq, row, from, to);
+        len = arrow_seq(option, to - from, 'C');
+    } else {
+        best = arrow_seq(seq, from - to, 'D');
+        len = from - to; //one backspace per column
+        memset(option, '\b', len);
+    }
+    if (len < best) {
+        memcpy(seq, option, len);
+        best = len;
+    }
+
+    //Carriage return, then move right from column 0
+    option[0] = '\r';
+    len = 1;
+    if (to > 0) {
+        char tail[SCREEN_COLS];
+        int tail_len = reprint(tail, row, 0, to);
+        char arrow[8];
+        int arrow_len = arrow_seq(arrow, to, 'C');
+        if (arrow_len < tail_len) {
+            memcpy(tail, arrow, arrow_len);
+            tail_len = arrow_len;
+        }
+        memcpy(option + 1, tail, tail_len);
+        len += tail_len;
+    }
+    if (len < best) {
+        memcpy(seq, option, len);
+        best = len;
+    }
+    return best;
+}
+
+static int cursor_seq(char* seq, int row, int col) { //Picks between absolute positioning and a relative move
+    int len = sprintf(seq, "\033[%d;%dH", row + 1, col + 1); //absolute, rows and columns start at 1
+
+    if (cur_row >= 0) {
+        char rel[SCREEN_COLS + 16];
+        int rel_len = 0;
+        if (row == cur_row + 1) rel[rel_len++] = '\v';                   //vertical tab: one row down, same column
+        else if (row > cur_row) rel_len = arrow_seq(rel, row - cur_row, 'B');
+        else if (row == cur_row - 1) rel_len = sprintf(rel, "\033M");   //reverse index: one row up, same column
+        else if (row < cur_row) rel_len = arrow_seq(rel, cur_row - row, 'A');
+        rel_len += move_horizontal(rel + rel_len, row, cur_col, col);
+        if (rel_len < len) {
+            memcpy(seq, rel, rel_len);
+            len = rel_len;
+        }
+    }
+    return len;
+}
+
+static void move_cursor(int row, int col) { //Sends the cursor to (row, col)
+    char seq[SCREEN_COLS + 16];
+    put_bytes(seq, cursor_seq(seq, row, col));
+    cur_row = row;
+    cur_col = col;
+}
+
+void init_screen(screen_sink_t sink) { //Clears the terminal once and hides the cursor
+    screen_sink = sink;
+    memset(shown, ' ', sizeof(shown));
+    memset(wanted, ' ', sizeof(wanted));
+    put_bytes("\033[2J\033[H\033[?25l", 13);
+    cur_row = 0;
+    cur_col = 0;
+    flush_out();
+}
+
+void clear_screen(void) { //Blanks the virtual screen, nothing is sent until the next refresh
+    memset(wanted, ' ', sizeof(wanted));
+}
+
+void print_screen(int row, const char* text) { //Replaces one row of the virtual screen
+    if (row < 0 || row >= SCREEN_ROWS) return;
+    int col = 0;
+    while (col < SCREEN_COLS && text[col]) {
+        wanted[row][col] = text[col];
+        col++;
+    }
+    memset(&wanted[row][col], ' ', SCREEN_COLS - col);
+}
+
+struct span_t {  //a run of changed characters in one row
+    int row;
+    int start;
+    int end;
+    bool erase;  //the run ends with an erase to the end of the line
+};
+
+static span_t spans[SCREEN_ROWS * (SCREEN_COLS / 4 + 1)];
+
+void redraw_row(int row) { //Forgets what the terminal shows on a row, so the next refresh sends all of it
+    if (row < 0 || row >= SCREEN_ROWS) return;
+    memset(shown[row], 0, SCREEN_COLS);
+}
+
+void forget_cursor(void) { //Something else moved the terminal cursor, the next move has to be absolute
+    cur_row = -1;
+    cur_col = -1;
+}
+
+void refresh_screen(void) { //Sends the differences between the virtual screen and the terminal
+    int count = 0;
+
+    //First find the runs of changed characters
+    for (int row = 0; row < SCREEN_ROWS; row++) {
+        int col = 0;
+        while (col < SCREEN_COLS) {
+            if (shown[row][col] == wanted[row][col]) {
+                col++;
+                continue;
+            }
+
+            //Grow the run while the unchanged gaps are shorter than a cursor move (3 bytes)
+            int end = col + 1;
+            for (int k = col + 1; k < SCREEN_COLS && k - end < 3; k++) {
+                if (shown[row][k] != wanted[row][k]) end = k + 1;
+            }
+
+            //If the run reaches the blank end of the row, erasing to the end of line is cheaper than spaces
+            int text_end = SCREEN_COLS;
+            while (text_end > col && wanted[row][text_end - 1] == ' ') text_end--;
+
+            span_t* span = &spans[count++];
+            span->row = row;
+            span->start = col;
+            span->erase = (text_end < end && end - text_end > 3);
+            span->end = span->erase ? text_end : end;
+            col = span->erase ? SCREEN_COLS : end;
+        }
+    }
+
+    //Then send them, always continuing with the run that is cheapest to reach from the cursor
+    while (count > 0) {
+        char seq[SCREEN_COLS + 16];
+        int best = 0;
+        int best_len = cursor_seq(seq, spans[0].row, spans[0].start);
+        for (int i = 1; i < count; i++) {
+            int len = cursor_seq(seq, spans[i].row, spans[i].start);
+            if (len < best_len) {
+                best = i;
+                best_len = len;
+            }
+        }
+
+        span_t span = spans[best];
+        spans[best] = spans[--count];
+
+        move_cursor(span.row, span.start);
+        put_bytes(&wanted[span.row][span.start], span.end - span.start);
+        memcpy(&shown[span.row][span.start], &wanted[span.row][span.start], span.end - span.start);
+        if (span.erase) {
+            put_bytes("\033[K", 3);
+            memset(&shown[span.row][span.end], ' ', SCREEN_COLS - span.end);
+        }
+        cur_col = span.end;
+    }
+    flush_out();
+}
+
+unsigned long screen_bytes_sent(void) { //Total bytes handed to the sink since init_screen()
+    return bytes_sent;
+}
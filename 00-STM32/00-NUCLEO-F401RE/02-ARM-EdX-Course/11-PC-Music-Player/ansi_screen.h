@@ -0,0 +1,22 @@
+/*Header file for a small terminal renderer. The program writes lines into a virtual screen, and refresh_screen()
+sends only the characters that changed since the last refresh, positioning the cursor with ANSI escape sequences. */
+
+#ifndef ANSI_SCREEN_H
+#define ANSI_SCREEN_H
+
+#define SCREEN_ROWS 14   //rows of the virtual screen
+#define SCREEN_COLS 32   //columns of the virtual screen, keep it narrower than the terminal to avoid line wrapping
+
+//Function that receives the bytes produced by the renderer (e.g. a write to the UART)
+typedef void (*screen_sink_t)(const char* data, int length);
+
+//Function Prototypes
+void init_screen(screen_sink_t sink);
+void clear_screen(void);
+void print_screen(int row, const char* text);
+void redraw_row(int row);
+void forget_cursor(void);
+void refresh_screen(void);
+unsigned long screen_bytes_sent(void);
+
+#endif
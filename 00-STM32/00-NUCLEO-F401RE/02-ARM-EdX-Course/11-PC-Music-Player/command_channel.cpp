@@ -0,0 +1,86 @@
+/*Command channel on the PC UART. BufferedSerial receives in its interrupt into its own ring buffer and sigio() tells
+us (still in interrupt context) that bytes arrived, so the command thread sleeps until then instead of polling. The
+thread reads the bytes straight into the line buffer and splits each complete line in place: no extra copy and no
+heap. The ring buffer of the driver is set with "drivers.uart-serial-rxbuf-size" in mbed_app.json; 1024 bytes give
+room for ~90 ms of input at 115200 baud while the thread is busy.
+The handler runs on the command thread, so its stack has to hold the deepest command. In the music player those are
+"top", "trace" and "buttons": rtos_stats_report() keeps two snapshots of the counters (~700 bytes) and every report
+line goes through vsnprintf() into a 128-byte buffer. That adds up to an estimated 2 KB; COMMAND_STACK_SIZE leaves a
+margin over it, and the STACK USED column of "top" shows the peak of the "commands" thread on the board. */
+
+#include "command_channel.h"
+#include <cstring>
+
+#define RX_FLAG 0x01 //thread flag set by the serial interrupt
+
+static BufferedSerial* serial_port;
+static command_handler_t command_handler;
+//Above the player threads, so input is served at once
+static Thread command_thread(osPriorityAboveNormal, COMMAND_STACK_SIZE, nullptr, "commands");
+
+static char line[COMMAND_LINE_SIZE];
+static int line_len = 0;
+static bool skipping = false; //the current line was too long, ignore it until its end
+static command_stats_t stats;
+
+static void rx_handler(void) { //Interrupt context: only wake the thread up
+    command_thread.flags_set(RX_FLAG);
+}
+
+static void run_line(char* text) { //Splits "name argument" in place and runs it
+    while (*text == ' ') text++;
+    if (*text == '\0') return; //empty line, e.g. the '\n' of a "\r\n" pair
+
+    char* arg = strchr(text, ' ');
+    if (arg) {
+        *arg++ = '\0';
+        while (*arg == ' ') arg++;
+        if (*arg == '\0') arg = nullptr;
+    }
+
+    stats.commands++;
+    if (!command_handler(text, arg)) stats.errors++;
+}
+
+static void command_loop(void) {
+    while (true) {
+        ThisThread::flags_wait_any(RX_FLAG);
+
+        while (serial_port->readable()) {
+            ssize_t n = serial_port->read(line + line_len, COMMAND_LINE_SIZE - line_len);
+            if (n <= 0) break;
+            stats.bytes += n;
+
+            int start = 0; //first character of the line being assembled
+            for (int i = line_len; i < line_len + n; i++) {
+                if (line[i] == '\n' || line[i] == '\r') {
+                    line[i] = '\0';
+                    if (!skipping) run_line(&line[start]);
+                    skipping = false;
+                    start = i + 1;
+                }
+            }
+            line_len += n - start;
+            memmove(line, line + start, line_len); //keep the unfinished line at the start of the buffer
+
+            if (line_len == COMMAND_LINE_SIZE) { //no end of line in sight, drop it
+                if (!skipping) stats.lost++;
+                skipping = true;
+                line_len = 0;
+            }
+        }
+    }
+}
+
+void start_command_channel(BufferedSerial* serial, command_handler_t handler) {
+    serial_port = serial;
+    command_handler = handler;
+    command_thread.start(callback(command_loop));
+    serial_port->sigio(callback(rx_handler));
+    command_thread.flags_set(RX_FLAG); //bytes may have arrived before sigio() was attached
+}
+
+void get_command_stats(command_stats_t* copy) {
+    CriticalSectionLock lock;
+    *copy = stats;
+}
@@ -0,0 +1,26 @@
+/*Header file for a line-oriented command channel on the PC UART. Every line is "name" or "name argument", ended by
+'\n' or '\r', and is handed to the command handler of the program. */
+
+#ifndef COMMAND_CHANNEL_H
+#define COMMAND_CHANNEL_H
+#include "mbed.h"
+
+#define COMMAND_LINE_SIZE 64 //longest accepted line, longer ones are dropped and counted as lost
+#define COMMAND_STACK_SIZE 3072 //the handler runs on the command thread, reports included (see command_channel.cpp)
+
+//Runs one command, returns false if the name or the argument is not valid. "arg" is nullptr when there is none.
+typedef bool (*command_handler_t)(char* name, char* arg);
+
+//Counters of the command channel
+typedef struct {
+    unsigned long bytes;     //bytes received
+    unsigned long commands;  //lines handed to the handler
+    unsigned long errors;    //lines rejected by the handler
+    unsigned long lost;      //lines dropped because they were too long
+} command_stats_t;
+
+//Function Prototypes
+void start_command_channel(BufferedSerial* serial, command_handler_t handler);
+void get_command_stats(command_stats_t* stats);
+
+#endif
@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+"""Load test for the command channel of the PC music player (runs on the PC, not on the board).
+
+Sends a burst of menu commands at the requested rate, then asks for "stats" and checks that the board counted every
+command. A command whose event found the queue of the player full counts as an error on the board, so a burst that
+overflows the state machine fails the check too. Needs pyserial (pip install pyserial).
+
+    python3 send_commands.py /dev/ttyACM0 --count 2000 --rate 500
+"""
+import argparse
+import re
+import sys
+import time
+
+import serial
+
+STATS = re.compile(rb"Cmds ok=(\d+) err=(\d+) lost=(\d+)")
+COMMANDS = [b"up\n", b"next\n", b"down\n", b"prev\n", b"tempo 100\n"]
+
+
+def read_stats(port, timeout=2.0):
+    """Sends "stats" and returns (ok, err, lost) read back from the screen output."""
+    port.reset_input_buffer()
+    port.write(b"stats\n")
+    received = b""
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        received += port.read(256)
+        match = STATS.search(received)
+        if match:
+            return tuple(int(value) for value in match.groups())
+    sys.exit("no answer to 'stats', check the port and the baud rate")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("port", help="serial port of the board, e.g. /dev/ttyACM0 or COM5")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--count", type=int, default=1000, help="number of commands to send")
+    parser.add_argument("--rate", type=float, default=500, help="commands per second, 0 sends as fast as possible")
+    args = parser.parse_args()
+
+    port = serial.Serial(args.port, args.baud, timeout=0.05)
+    ok_before, err_before, lost_before = read_stats(port)
+
+    start = time.time()
+    for i in range(args.count):
+        port.write(COMMANDS[i % len(COMMANDS)])
+        if args.rate > 0:
+            delay = start + (i + 1) / args.rate - time.time()
+            if delay > 0:
+                time.sleep(delay)
+    port.flush()
+    elapsed = time.time() - start
+
+    ok, err, lost = read_stats(port)
+    # Both "stats" commands count themselves as ok
+    received = ok - ok_before - 1
+    print(f"sent {args.count} commands in {elapsed:.2f} s ({args.count / elapsed:.0f}/s)")
+    print(f"board counted {received} ok, {err - err_before} errors, {lost - lost_before} lost")
+    return 0 if received == args.count and err == err_before and lost == lost_before else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
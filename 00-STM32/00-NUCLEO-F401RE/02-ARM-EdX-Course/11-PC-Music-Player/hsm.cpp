@@ -0,0 +1,157 @@
+/*Hierarchical state machine engine. The tables are constant, so the engine only keeps the current leaf state, the
+event queue and the trace: a few hundred bytes of RAM for a whole player.
+
+An event is looked up in the folded table of the current state. If the guard of that transition refuses, the other
+transitions for the event are tried in the same order the table was built with (the state first, then its parents).
+A transition exits the states from the current one up to the innermost state around the target, runs its action,
+and enters the states from there down to the target and on through the initial children to a leaf.
+
+The queue is a ring of HSM_QUEUE_SIZE events written in a critical section, so an ISR can post between two
+instructions of the thread; a Semaphore counts the events, so the machine thread sleeps while there is nothing to do.
+The actions always run in the machine thread, one event at a time: they can sleep, lock mutexes and draw. */
+
+#include "hsm.h"
+#include "report_line.h"
+
+Hsm::Hsm(const HsmMachine& machine) : machine(machine), current(HSM_NONE), head(0), tail(0), lost(0), pending(0) {
+#if HSM_TRACE_SIZE
+    traced = 0;
+#endif
+}
+
+bool Hsm::post(int event, int param) {
+    {
+        CriticalSectionLock lock;
+        if (head - tail >= HSM_QUEUE_SIZE) {
+            lost++;
+            return false;
+        }
+        queue[head % HSM_QUEUE_SIZE].event = (int8_t)event;
+        queue[head % HSM_QUEUE_SIZE].param = (int16_t)param;
+        head++;
+    }
+    pending.release();
+    return true;
+}
+
+void Hsm::run(void) {
+    enter(0, HSM_NONE); //the top state is the first entry of the table
+    while (1) {
+        pending.acquire();
+        HsmEvent event;
+        {
+            CriticalSectionLock lock;
+            event = queue[tail % HSM_QUEUE_SIZE];
+            tail++;
+        }
+        dispatch(event);
+    }
+}
+
+void Hsm::dispatch(const HsmEvent& event) {
+    int from = current;
+    int t = (event.event >= 0 && event.event < machine.event_count) ? find(event.event, event.param) : HSM_NONE;
+    if (t != HSM_NONE) transit(machine.transitions[t], event.param);
+    record(from, event.event, t != HSM_NONE ? current : HSM_NONE);
+}
+
+int Hsm::find(int event, int param) {
+    int first = machine.table[current * machine.event_count + event];
+    if (first == HSM_NONE) return HSM_NONE;
+    const HsmTransition& t = machine.transitions[first];
+    if (t.guard == nullptr || t.guard(param)) return first;
+
+    bool passed = false; //the guard refused: the candidates after it
+    for (int owner = current; owner != HSM_NONE; owner = machine.states[owner].parent) {
+        for (int i = 0; i < machine.transition_count; i++) {
+            const HsmTransition& c = machine.transitions[i];
+            if (c.source != owner || c.event != event) continue;
+            if (!passed) {
+                passed = (i == first);
+                continue;
+            }
+            if (c.guard == nullptr || c.guard(param)) return i;
+        }
+    }
+    return HSM_NONE;
+}
+
+bool Hsm::contains(int outer, int state) const { //state is outer or nested in it
+    for (; state != HSM_NONE; state = machine.states[state].parent) {
+        if (state == outer) return true;
+    }
+    return false;
+}
+
+void Hsm::transit(const HsmTransition& t, int param) {
+    if (t.target == HSM_NONE) { //internal: no state is left
+        if (t.action) t.action(param);
+        return;
+    }
+    int common = machine.states[t.target].parent; //innermost state around the target and the current state
+    while (common != HSM_NONE && !contains(common, current)) common = machine.states[common].parent;
+
+    for (int s = current; s != common; s = machine.states[s].parent) {
+        if (machine.states[s].exit) machine.states[s].exit();
+    }
+    if (t.action) t.action(param);
+    enter(t.target, common);
+}
+
+void Hsm::enter(int target, int above) { //Enters the states below "above" down to target, then its initial children
+    int path[HSM_MAX_DEPTH];
+    int depth = 0;
+    for (int s = target; s != above && s != HSM_NONE && depth < HSM_MAX_DEPTH; s = machine.states[s].parent) {
+        path[depth++] = s;
+    }
+    while (depth > 0) {
+        const HsmState& state = machine.states[path[--depth]];
+        if (state.entry) state.entry();
+    }
+    current = target;
+    while (machine.states[current].initial != HSM_NONE) {
+        current = machine.states[current].initial;
+        if (machine.states[current].entry) machine.states[current].entry();
+    }
+}
+
+/*-------------------------------------------Trace----------------------------------------------------------*/
+#if HSM_TRACE_SIZE
+void Hsm::record(int from, int event, int to) {
+    CriticalSectionLock lock; //print_trace() reads from another thread
+    HsmRecord& r = trace[traced % HSM_TRACE_SIZE];
+    r.ms = (uint32_t)Kernel::Clock::now().time_since_epoch().count();
+    r.from = (int8_t)from;
+    r.event = (int8_t)event;
+    r.to = (int8_t)to;
+    traced++;
+}
+
+void Hsm::print_trace(FileHandle* out) {
+    uint32_t total;
+    {
+        CriticalSectionLock lock;
+        total = traced;
+    }
+    uint32_t first = total > HSM_TRACE_SIZE ? total - HSM_TRACE_SIZE : 0;
+    print_line(out, "State machine: %lu events, %lu lost\n\r", (unsigned long)total, (unsigned long)lost);
+    for (uint32_t i = first; i < total; i++) {
+        HsmRecord r;
+        {
+            CriticalSectionLock lock;
+            r = trace[i % HSM_TRACE_SIZE];
+        }
+        const char* event = (r.event >= 0 && r.event < machine.event_count) ? machine.event_names[r.event] : "?";
+        if (r.to == HSM_NONE) {
+            print_line(out, "%7lu.%03lu %-10s %-8s ignored\n\r", (unsigned long)(r.ms / 1000),
+                       (unsigned long)(r.ms % 1000), machine.states[r.from].name, event);
+        } else {
+            print_line(out, "%7lu.%03lu %-10s %-8s -> %s\n\r", (unsigned long)(r.ms / 1000),
+                       (unsigned long)(r.ms % 1000), machine.states[r.from].name, event, machine.states[r.to].name);
+        }
+    }
+}
+#else
+void Hsm::record(int, int, int) {}
+void Hsm::print_trace(FileHandle*) {}
+#endif
@@ -0,0 +1,128 @@
+/*Header file for a hierarchical state machine defined by two constant tables: the states (each with its parent, the
+child entered first, and entry/exit actions) and the transitions (source state, event, guard, action, target). A
+state handles the events of its parents too, unless it has a transition of its own for them. e.g.:
+    constexpr HsmState states[] = {
+        {"TOP",  HSM_NONE, ST_IDLE,  nullptr, nullptr},
+        {"IDLE", ST_TOP,   HSM_NONE, draw_idle, nullptr}, ...};
+    constexpr HsmTransition transitions[] = {
+        {ST_IDLE, EV_GO, nullptr, nullptr, ST_MENU}, ...};
+    constexpr HsmTable<ST_COUNT, EV_COUNT> table = hsm_table<ST_COUNT, EV_COUNT>(states, transitions);
+The compiler folds the inheritance into one table cell per (state, event), so a dispatch is one lookup plus the guard.
+Events are posted to a queue, from threads or interrupts, and run one at a time in the thread that calls run(). */
+
+#ifndef HSM_H
+#define HSM_H
+#include "mbed.h"
+
+#define HSM_NONE        -1   //no state / no transition; as a target: an internal transition, nothing is left
+#define HSM_MAX_DEPTH    8   //nesting levels of states
+#define HSM_QUEUE_SIZE  16   //events waiting to be dispatched
+#ifndef HSM_TRACE_SIZE
+#define HSM_TRACE_SIZE  32   //dispatches kept for print_trace(), 0: no trace
+#endif
+
+typedef struct {
+    const char* name;
+    int parent;                  //HSM_NONE for the top state
+    int initial;                 //child entered when the state is the target, HSM_NONE for a leaf
+    void (*entry)(void);
+    void (*exit)(void);
+} HsmState;
+
+typedef struct {
+    int source;
+    int event;
+    bool (*guard)(int param);    //nullptr: always taken. A false guard tries the next transition for the event.
+    void (*action)(int param);   //runs after the exits and before the entries
+    int target;                  //HSM_NONE: internal transition. A state around both ends is not left (local).
+} HsmTransition;
+
+template <int STATES, int EVENTS>
+struct HsmTable {
+    int8_t first[STATES][EVENTS];   //first transition to try, HSM_NONE if the event is ignored
+};
+
+//The innermost state wins: the transitions of the state itself, then those of its parent, and so on.
+template <int STATES, int EVENTS, int TRANSITIONS>
+constexpr HsmTable<STATES, EVENTS> hsm_table(const HsmState (&states)[STATES],
+                                              const HsmTransition (&transitions)[TRANSITIONS]) {
+    HsmTable<STATES, EVENTS> table = {};
+    for (int s = 0; s < STATES; s++) {
+        for (int e = 0; e < EVENTS; e++) {
+            table.first[s][e] = HSM_NONE;
+            for (int owner = s; owner != HSM_NONE && table.first[s][e] == HSM_NONE; owner = states[owner].parent) {
+                for (int t = 0; t < TRANSITIONS; t++) {
+                    if (transitions[t].source == owner && transitions[t].event == e) {
+                        table.first[s][e] = t;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    return table;
+}
+
+//The state tables are indexed by state: a parent and an initial child have to be other entries of the table
+template <int STATES>
+constexpr bool hsm_valid(const HsmState (&states)[STATES]) {
+    for (int s = 0; s < STATES; s++) {
+        if (states[s].parent < HSM_NONE || states[s].parent >= STATES || states[s].parent == s) return false;
+        if (states[s].initial < HSM_NONE || states[s].initial >= STATES) return false;
+        if (states[s].initial != HSM_NONE && states[states[s].initial].parent != s) return false;
+    }
+    return true;
+}
+
+//Everything a machine needs, in flash
+typedef struct {
+    const HsmState* states;
+    int state_count;
+    const HsmTransition* transitions;
+    int transition_count;
+    const int8_t* table;         //state_count x event_count, from hsm_table()
+    int event_count;
+    const char* const* event_names;
+} HsmMachine;
+
+class Hsm {
+public:
+    Hsm(const HsmMachine& machine);
+
+    bool post(int event, int param = 0);      //from threads and ISRs; false if the queue was full
+    void run(void);                           //enters the top state, then dispatches the events, forever
+    int state(void) const { return current; } //the current leaf state
+    uint32_t lost_events(void) const { return lost; }
+    void print_trace(FileHandle* out);        //the last dispatches, oldest first
+
+private:
+    typedef struct {
+        int8_t event;
+        int16_t param;
+    } HsmEvent;
+
+    typedef struct {
+        uint32_t ms;
+        int8_t from, event, to;               //to: HSM_NONE when the event was ignored
+    } HsmRecord;
+
+    void dispatch(const HsmEvent& event);
+    int find(int event, int param);
+    bool contains(int outer, int state) const;
+    void transit(const HsmTransition& t, int param);
+    void enter(int state, int above);
+    void record(int from, int event, int to);
+
+    const HsmMachine& machine;
+    int current;
+    HsmEvent queue[HSM_QUEUE_SIZE];
+    uint32_t head, tail;                      //written by post() / by run(), under a critical section
+    uint32_t lost;
+    Semaphore pending;                        //one token per queued event
+#if HSM_TRACE_SIZE
+    HsmRecord trace[HSM_TRACE_SIZE];
+    uint32_t traced;
+#endif
+};
+
+#endif
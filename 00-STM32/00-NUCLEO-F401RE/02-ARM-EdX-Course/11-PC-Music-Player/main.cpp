@@ -1,7 +1,35 @@
 /*******************************************************************************************************************
- * Objective of the program: Simplify "Improved-Music-Player" file by implementing the same solution using the PC 
+ * Objective of the program: Simplify "Improved-Music-Player" file by implementing the same solution using the PC
  display instead of the LCD.
  *******************************************************************************************************************
+ * Theory: Printing "\n\n\n\n" to "clear" the terminal and then redrawing every line scrolls the screen and sends the
+ whole menu through the UART on each button press. The "ansi_screen" renderer keeps a copy of what the terminal shows
+ and uses ANSI escape sequences (ESC[row;colH and friends) to rewrite only the characters that changed. Moving the
+ cursor in the song list costs 110 bytes over the whole list down and back instead of 960, 8.7x less (about 6 bytes
+ per step instead of 53). Set SCREEN_BENCHMARK to 1 to print the comparison.
+
+ + The player can also be driven from the PC: each line typed in the terminal (or sent by host/send_commands.py) is a
+ command such as "play 3", "next", "tempo 150" or "stats". The commands call the same handlers as the buttons, so the
+ rest of the program cannot tell a command from a button press. The terminal has to be set to 115200 baud.
+
+ + The "top" command prints the RTOS statistics ("rtos_stats.h") below the player screen: CPU time, context switches
+ and stack use of every thread since the previous "top", and how long the CPU slept. pc_screen_mutex is a ProfiledMutex
+ ("profiled_mutex.h"), so "top" also shows how often a thread had to wait for the screen, for how long, and how long
+ each redraw held it.
+
+ + The player is a hierarchical state machine ("hsm.h") instead of four threads polling the flags welcome, playing,
+ next_menu and ok_button. The buttons, the commands and a Timeout only post events (GO, UP, DOWN, OK, PLAY, TIMEOUT),
+ and one thread runs them through the constant tables below: IDLE (WELCOME, MENU) and ACTIVE (PLAYING, FINISHED). The
+ buttons are ignored in ACTIVE simply because it has no transition for them. The thread sleeps between events, so the
+ CPU is free while nothing happens, and there is no flag written by an ISR and read by a thread at the same time. The
+ "trace" command prints the last events with the state before and after.
+
+ + The buttons are debounced ("debouncer.h"): a contact bounces for a few ms, and a bare fall() handler moved the
+ cursor by two or three songs per press. Now the first edge is the press, posted at once, and the bounces after it
+ only store their time until the pin has been quiet for 5 ms. Holding UP or DOWN scrolls through the list (a long
+ press after 0.8 s, then a repeat every 0.2 s). The "buttons" command prints the edges per press, the glitches and the
+ latency from the first edge to button_event() for each button.
+ *******************************************************************************************************************
  * Author: Luciano Carricart, https://github.com/lcarricart/
  * Status: Information Engineering student at HAW Hamburg, Germany.
  * Profile: https://www.linkedin.com/in/lucianocarricart/
@@ -10,9 +38,28 @@
 // Preprocessor directives
 #include "mbed.h"
 #include "tunes.h"
+#include "ansi_screen.h"
+#include "command_channel.h"
+#include "rtos_stats.h"
+#include "profiled_mutex.h"
+#include "hsm.h"
+#include "debouncer.h"
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define SCREEN_BENCHMARK 0  // 1: count the bytes per menu navigation instead of running the player
+
+// Rows of the PC screen
+#define ROW_TITLE     0
+#define ROW_SONGS     2     // first row of the song list, one row per song
+#define ROW_PROGRESS  3
+#define ROW_NOTE      4
+#define ROW_STATUS    12
+#define ROW_COMMANDS  13    // command channel counters, shown by "stats"
 
 // Object declarations
+BufferedSerial pc(USBTX, USBRX, 115200); // USB UART, shared by printf, the screen and the command channel
 PwmOut speaker(D3);           // for piezo sounder
 AnalogIn volume(A0);          // for potentiometer
 InterruptIn go(D7);           // button: move to the next menu
@@ -20,193 +67,442 @@ InterruptIn arrow_down(D6);   // button: arrow down
 InterruptIn ok(D5);           // button: OK, select song
 InterruptIn arrow_up(D4);     // button: arrow up
 
-// Mutual Exclusive for shared PC display
-Mutex pc_screen_mutex;
+// Button numbers, in the order they are added to the debouncer
+enum {BTN_GO, BTN_DOWN, BTN_OK, BTN_UP};
 
-// These flags indicate state of player
-bool welcome = 1;   // Indicates welcome state
-bool waiting = 0;   // waiting for tune selection
-bool triggered = 0; // tune is selected but hasn't started yet
-bool playing = 0;   // tune is playing
+// Mutual Exclusive for shared PC display
+ProfiledMutex pc_screen_mutex("pc_screen_mutex");
 
 // Song selection mechanism
 int cursor = 1;
-int ok_button = 0;
-int next_menu = 0;
+int tempo = 100;    // playback speed in percent, set with the "tempo" command
+int note = 0;       // note of the current song being played
+
+// Songs in menu order (cursor 1 is the first one)
+struct Songs* const song_list[] = {&Oranges, &Cielito, &Malaika, &Guten_Abend, &Yankee, &Rasa, &Matilda, &Alouetta, &Twinkle};
+const int song_count = sizeof(song_list) / sizeof(song_list[0]);
+
+// Events and states of the player
+enum { EV_GO, EV_UP, EV_DOWN, EV_OK, EV_PLAY, EV_TIMEOUT, EV_COUNT };
+enum { ST_TOP, ST_IDLE, ST_WELCOME, ST_MENU, ST_ACTIVE, ST_PLAYING, ST_FINISHED, ST_COUNT };
+
+Timeout player_timer;         // end of a note, end of the "Waiting..." pause
+extern Hsm player;            // the state machine, defined after its tables
 
 // Prototypes
-void pc_cont(void);
-void Tune_select(void);
-void Play_tune(void);
+void play_note(void);
 
-//-------------- Threads ----------------//
+//-------------- Screens ----------------//
 
-// Displays welcome message on LCD
-Thread thread1;
-void pc_cont() {
+// Makes printf use the same UART object as the command channel (otherwise both would claim USBTX/USBRX)
+FileHandle* mbed::mbed_override_console(int)
+{
+    return &pc;
+}
 
-    // Waiting for song
-    while (1) {
-        if (welcome) {
-            pc_screen_mutex.lock();
-            printf("\n\n\n\n");
-            printf("Your MUSIC Player!\n");
-            printf("Press GO to continue\n");
-            printf("Status: Ready\n");
-            pc_screen_mutex.unlock();
-            thread_sleep_for(500);
-            welcome = 0;
-        }
-    } 
-}
-
-// Displays the Song-selection menu
-Thread thread_songs_menu;
-void Tune_menu()
-{
-    while (1)
-    {
-        // Shows the song selection menu if next_menu is high (triggered by interrupts)
-        if (next_menu == 1)
-        {
-            pc_screen_mutex.lock();
-            printf("\n\n\n\n");
-            printf("Select a song:\n");
-
-            switch (cursor)
-            {
-            case 1: song_ptr = &Oranges; break;
-            case 2: song_ptr = &Cielito; break;
-            case 3: song_ptr = &Malaika; break;
-            case 4: song_ptr = &Guten_Abend; break;
-            case 5: song_ptr = &Yankee; break;
-            case 6: song_ptr = &Rasa; break;
-            case 7: song_ptr = &Matilda; break;
-            case 8: song_ptr = &Alouetta; break;
-            case 9: song_ptr = &Twinkle; break;
-            }
-
-            printf("- %s\n", song_ptr->name);
-            printf("Country: %s\n", song_ptr->country);
-            printf("Status: Choosing...\n");
-            pc_screen_mutex.unlock();
-            thread_sleep_for(500);
-
-            next_menu = 0;  // Turn off song selection menu variable to avoid infinite displays of the menu (flags flow control)
-        }
-    }
+// Sends the renderer output to the PC
+void pc_write(const char* data, int length)
+{
+    pc.write(data, length);
 }
 
-// Reads the select buttons and prepares the song
-Thread thread2;
-void Tune_select() {
-    while (1) {
-        if (ok_button) { // "ok_button" is set by Interrupt
-            switch (cursor) { // read song selection and load song pointer
-            case 1: song_ptr = &Oranges; break;
-            case 2: song_ptr = &Cielito; break;
-            case 3: song_ptr = &Malaika; break;
-            case 4: song_ptr = &Guten_Abend; break;
-            case 5: song_ptr = &Yankee; break;
-            case 6: song_ptr = &Rasa; break;
-            case 7: song_ptr = &Matilda; break;
-            case 8: song_ptr = &Alouetta; break;
-            case 9: song_ptr = &Twinkle; break;
-            }
-
-            pc_screen_mutex.lock();
-            printf("\n\n\n\n");
-            printf("Now playing:\n");
-            printf("%s \n", song_ptr->name); // display song name
-            printf("Status: Playing!!\n");
-            pc_screen_mutex.unlock();
-
-            ok_button = 0;
-            playing = 1;
-        } 
+void draw_welcome()
+{
+    clear_screen();
+    print_screen(ROW_TITLE, "Your MUSIC Player!");
+    print_screen(ROW_TITLE + 1, "Press GO to continue");
+    print_screen(ROW_STATUS, "Status: Ready");
+}
+
+// The whole list is drawn, so moving the cursor only changes the '>' marker of two rows
+void draw_menu(int selected)
+{
+    char line[SCREEN_COLS + 1];
+
+    clear_screen();
+    print_screen(ROW_TITLE, "Select a song:");
+    for (int i = 0; i < song_count; i++) {
+        snprintf(line, sizeof(line), "%c %s", (i + 1 == selected) ? '>' : ' ', song_list[i]->name);
+        print_screen(ROW_SONGS + i, line);
     }
+    print_screen(ROW_STATUS, "Status: Choosing...");
 }
 
-// Plays the chosen tune
-Thread thread3;
-void Play_tune() {
-    while (1) {
-        if (playing) {
-            // Resume PWM operation, stopped after last song
-            speaker.resume();
-            for (int i = 0; i <= (song_ptr->length); i++) {
-                speaker.period(1 / (2 * (*song_ptr).freq[i])); // set PWM period
-                speaker = volume; // set duty cycle, hence volume control
-                thread_sleep_for(200 * (*song_ptr).beat[i]); // hold for beat period
-            }
-            speaker = 0; // To shut the sound, volume = 0;
-
-            // Indicate end of song
-            pc_screen_mutex.lock();
-            printf("\n\n\n\n"); // "Clears the screen"
-            printf("Status: Waiting...\n");
-            pc_screen_mutex.unlock();
-            thread_sleep_for(1000);
-
-            playing = false;
-            welcome = 1;
-            speaker.suspend();
-        } 
-    } 
+void draw_playing(const struct Songs* song)
+{
+    clear_screen();
+    print_screen(ROW_TITLE, "Now playing:");
+    print_screen(ROW_TITLE + 1, song->name);
+    print_screen(ROW_STATUS, "Status: Playing!!");
+}
+
+// Progress bar and current note. From one note to the next only a '#' and the counters change.
+void draw_progress(int note, int total, float freq, float beat)
+{
+    const int width = 20;
+    char line[SCREEN_COLS + 1];
+    int filled = (note * width) / total;
+
+    line[0] = '[';
+    for (int k = 0; k < width; k++) line[1 + k] = (k < filled) ? '#' : '-';
+    snprintf(line + 1 + width, sizeof(line) - 1 - width, "] %d/%d", note, total);
+    print_screen(ROW_PROGRESS, line);
+
+    // Minimal printf has no %f, the beat is printed as integer and tenths
+    int tenths = (int)(beat * 10);
+    snprintf(line, sizeof(line), "Note: %d Hz, %d.%d beats", (int)freq, tenths / 10, tenths % 10);
+    print_screen(ROW_NOTE, line);
+}
+
+//-------------- Actions ----------------//
+
+void post_timeout()
+{
+    player.post(EV_TIMEOUT);
+}
+
+void show_welcome()
+{
+    pc_screen_mutex.lock();
+    draw_welcome();
+    refresh_screen();
+    pc_screen_mutex.unlock();
+}
+
+void show_menu()
+{
+    song_ptr = song_list[cursor - 1];
+
+    pc_screen_mutex.lock();
+    draw_menu(cursor);
+    refresh_screen();
+    pc_screen_mutex.unlock();
+}
+
+void start_song()
+{
+    song_ptr = song_list[cursor - 1]; // read song selection and load song pointer
+
+    pc_screen_mutex.lock();
+    draw_playing(song_ptr);
+    refresh_screen();
+    pc_screen_mutex.unlock();
+
+    // Resume PWM operation, stopped after last song
+    speaker.resume();
+    note = 0;
+    play_note();
+}
+
+// Plays the current note and sets the timer for its end
+void play_note()
+{
+    pc_screen_mutex.lock();
+    draw_progress(note + 1, song_ptr->length + 1, (*song_ptr).freq[note], (*song_ptr).beat[note]);
+    refresh_screen();
+    pc_screen_mutex.unlock();
+
+    speaker.period(1 / (2 * (*song_ptr).freq[note])); // set PWM period
+    speaker = volume; // set duty cycle, hence volume control
+    int beat_ms = 200 * (*song_ptr).beat[note] * 100 / tempo;
+    player_timer.attach(&post_timeout, std::chrono::milliseconds(beat_ms)); // hold for beat period
+}
+
+void stop_song()
+{
+    player_timer.detach();
+    speaker = 0; // To shut the sound, volume = 0;
+}
+
+// Indicate end of song
+void show_waiting()
+{
+    pc_screen_mutex.lock();
+    print_screen(ROW_STATUS, "Status: Waiting...");
+    refresh_screen();
+    pc_screen_mutex.unlock();
+    player_timer.attach(&post_timeout, 1000ms);
+}
+
+void end_waiting()
+{
+    player_timer.detach();
+    speaker.suspend();
+}
+
+bool more_notes(int)
+{
+    return note < song_ptr->length;
+}
+
+void next_note(int)
+{
+    note++;
+    play_note();
+}
+
+void cursor_up(int)
+{
+    cursor++;
+    if (cursor > song_count) cursor = 1;
+}
+
+void cursor_down(int)
+{
+    cursor--;
+    if (cursor < 1) cursor = song_count;
+}
+
+bool valid_song(int song)
+{
+    return song >= 1 && song <= song_count;
+}
+
+void select_song(int song)
+{
+    cursor = song;
+}
+
+//------------ State machine ------------//
+
+constexpr HsmState player_states[ST_COUNT] = {
+    // name         parent      initial       entry          exit
+    {"TOP",         HSM_NONE,   ST_IDLE,      nullptr,       nullptr},
+    {"IDLE",        ST_TOP,     ST_WELCOME,   nullptr,       nullptr},
+    {"WELCOME",     ST_IDLE,    HSM_NONE,     show_welcome,  nullptr},
+    {"MENU",        ST_IDLE,    HSM_NONE,     show_menu,     nullptr},
+    {"ACTIVE",      ST_TOP,     ST_PLAYING,   nullptr,       end_waiting},
+    {"PLAYING",     ST_ACTIVE,  HSM_NONE,     start_song,    stop_song},
+    {"FINISHED",    ST_ACTIVE,  HSM_NONE,     show_waiting,  nullptr},
+};
+static_assert(hsm_valid(player_states), "a parent or initial state of player_states is wrong");
+
+constexpr HsmTransition player_transitions[] = {
+    // source       event        guard        action        target
+    {ST_IDLE,       EV_GO,       nullptr,     nullptr,      ST_MENU},     // MENU to MENU: drawn again
+    {ST_IDLE,       EV_UP,       nullptr,     cursor_up,    ST_MENU},
+    {ST_IDLE,       EV_DOWN,     nullptr,     cursor_down,  ST_MENU},
+    {ST_IDLE,       EV_OK,       nullptr,     nullptr,      ST_PLAYING},
+    {ST_IDLE,       EV_PLAY,     valid_song,  select_song,  ST_PLAYING},
+    {ST_PLAYING,    EV_TIMEOUT,  more_notes,  next_note,    HSM_NONE},    // internal: the song goes on
+    {ST_PLAYING,    EV_TIMEOUT,  nullptr,     nullptr,      ST_FINISHED},
+    {ST_FINISHED,   EV_TIMEOUT,  nullptr,     nullptr,      ST_WELCOME},
+};
+
+constexpr HsmTable<ST_COUNT, EV_COUNT> player_table = hsm_table<ST_COUNT, EV_COUNT>(player_states, player_transitions);
+const char* const player_events[EV_COUNT] = {"GO", "UP", "DOWN", "OK", "PLAY", "TIMEOUT"};
+
+const HsmMachine player_machine = {player_states, ST_COUNT, player_transitions,
+                                   sizeof(player_transitions) / sizeof(player_transitions[0]),
+                                   &player_table.first[0][0], EV_COUNT, player_events};
+Hsm player(player_machine);
+
+// Runs the player: entry and exit actions, guards and actions all run in this thread
+Thread player_thread(osPriorityNormal, OS_STACK_SIZE, nullptr, "player");
+void run_player()
+{
+    player.run();
 }
 
 /*-------------- Handlers ---------------*/
 
-// Responds to press of GO button, and sets "next_menu"
-void go_handler() {
-    if (playing == 0)       // Only set "next_menu" if song not playing
-        next_menu = 1;
+// The buttons only post their event, the state machine decides what it means. false: the event queue was full
+bool go_handler()
+{
+    return player.post(EV_GO);
 }
 
-// Responds to press of DOWN button
-void down_handler()
+bool down_handler()
 {
-    if (playing == 0)
-    {
-        cursor--;
-        next_menu = 1;      // To show the song selection menu again
-        if (cursor < 1) cursor = 9;
+    return player.post(EV_DOWN);
+}
+
+bool up_handler()
+{
+    return player.post(EV_UP);
+}
+
+bool ok_handler()
+{
+    return player.post(EV_OK);
+}
+
+// Clean events from the debouncer, in interrupt context. Holding UP or DOWN steps on with each repeat.
+void button_event(const button_event_t& event)
+{
+    static bool (*const handlers[])(void) = {go_handler, down_handler, ok_handler, up_handler}; // by button number
+    bool scroll = event.button == BTN_UP || event.button == BTN_DOWN;
+    bool press = event.type == BUTTON_PRESS && !event.glitch; // a glitch press only puts back a held button
+
+    if (press || (scroll && (event.type == BUTTON_LONG || event.type == BUTTON_REPEAT))) {
+        handlers[event.button]();
     }
 }
+Debouncer buttons(button_event);
+
+/*-------------- Commands ---------------*/
+
+// Shows the command channel counters on the bottom row
+void show_command_stats()
+{
+    command_stats_t stats;
+    char line[SCREEN_COLS + 1];
+
+    get_command_stats(&stats);
+    snprintf(line, sizeof(line), "Cmds ok=%lu err=%lu lost=%lu", stats.commands - stats.errors, stats.errors, stats.lost);
+
+    pc_screen_mutex.lock();
+    print_screen(ROW_COMMANDS, line);
+    redraw_row(ROW_COMMANDS);   // sent whole, so a script can read it from the output
+    refresh_screen();
+    pc_screen_mutex.unlock();
+}
 
-// Responds to press of UP button
-void up_handler()
+// Prints the RTOS statistics under the player screen
+void show_rtos_stats()
 {
-    if (playing == 0)
-    {
-        cursor++;
-        next_menu = 1;      // To show the song selection menu again
-        if (cursor > 9) cursor = 1;
+    char seq[16];
+    int len = snprintf(seq, sizeof(seq), "\033[%d;1H\033[J", SCREEN_ROWS + 2); // below the screen, erase to the end
+
+    pc_screen_mutex.lock();
+    pc.write(seq, len);
+    rtos_stats_report(&pc);
+    forget_cursor();            // the report moved the cursor behind the renderer's back
+    pc_screen_mutex.unlock();
+}
+
+// Prints the last events of the state machine under the player screen
+void show_trace()
+{
+    char seq[16];
+    int len = snprintf(seq, sizeof(seq), "\033[%d;1H\033[J", SCREEN_ROWS + 2);
+
+    pc_screen_mutex.lock();
+    pc.write(seq, len);
+    player.print_trace(&pc);
+    forget_cursor();
+    pc_screen_mutex.unlock();
+}
+
+// Prints the debouncer counters under the player screen
+void show_buttons()
+{
+    char seq[16];
+    int len = snprintf(seq, sizeof(seq), "\033[%d;1H\033[J", SCREEN_ROWS + 2);
+
+    pc_screen_mutex.lock();
+    pc.write(seq, len);
+    buttons.print_report(&pc);
+    forget_cursor();
+    pc_screen_mutex.unlock();
+}
+
+// Runs a line received from the PC. The commands post the same events as the buttons; one that finds the event queue
+// of the player full is lost, and is answered as an error so that the sender can see it.
+bool run_command(char* name, char* arg)
+{
+    int value = arg ? atoi(arg) : 0;
+
+    if (strcmp(name, "stats") == 0) {
+        show_command_stats();
+        return true;
     }
+    if (strcmp(name, "top") == 0) {
+        show_rtos_stats();
+        return true;
+    }
+    if (strcmp(name, "trace") == 0) {
+        show_trace();
+        return true;
+    }
+    if (strcmp(name, "buttons") == 0) {
+        show_buttons();
+        return true;
+    }
+
+    bool posted = true;
+    if (strcmp(name, "go") == 0) posted = go_handler();
+    else if (strcmp(name, "up") == 0 || strcmp(name, "next") == 0) posted = up_handler();
+    else if (strcmp(name, "down") == 0 || strcmp(name, "prev") == 0) posted = down_handler();
+    else if (strcmp(name, "ok") == 0) posted = ok_handler();
+    else if (strcmp(name, "play") == 0 && valid_song(value)) posted = player.post(EV_PLAY, value);
+    else if (strcmp(name, "tempo") == 0 && value >= 25 && value <= 400) tempo = value;
+    else return false;
+    return posted;
 }
 
-// Responds to press of OK button
-void ok_handler()
+/*-------------- Benchmark --------------*/
+#if SCREEN_BENCHMARK
+unsigned long counted_bytes = 0;
+
+// Counts the bytes instead of sending them
+void count_write(const char*, int length)
 {
-    if (playing == 0) ok_button = 1;
+    counted_bytes += length;
 }
 
+// Browses the whole list down and back up, counting the bytes of the old full redraw and of the renderer
+void screen_benchmark()
+{
+    const int steps = 2 * song_count;
+    unsigned long legacy_bytes = 0;
+    char line[64];
+    int selected = 1;
+
+    init_screen(count_write);
+    draw_menu(selected);
+    refresh_screen();
+    unsigned long start = screen_bytes_sent();
+
+    for (int step = 0; step < steps; step++) {
+        if (step < song_count) selected = (selected % song_count) + 1;                  // UP
+        else selected = ((selected + song_count - 2) % song_count) + 1;                 // DOWN
+
+        // Old output of Tune_menu (the "Country:" line is left out, so the old count is on the low side)
+        legacy_bytes += snprintf(line, sizeof(line), "\n\n\n\n");
+        legacy_bytes += snprintf(line, sizeof(line), "Select a song:\n");
+        legacy_bytes += snprintf(line, sizeof(line), "- %s\n", song_list[selected - 1]->name);
+        legacy_bytes += snprintf(line, sizeof(line), "Status: Choosing...\n");
+
+        draw_menu(selected);
+        refresh_screen();
+    }
+    unsigned long renderer_bytes = screen_bytes_sent() - start;
+
+    printf("Menu navigations: %d\n", steps);
+    printf("Full redraw: %lu bytes (%lu per step)\n", legacy_bytes, legacy_bytes / steps);
+    printf("ANSI renderer: %lu bytes (%lu per step)\n", renderer_bytes, renderer_bytes / steps);
+    printf("Reduction: %lu.%lux\n", legacy_bytes / renderer_bytes, (legacy_bytes * 10 / renderer_bytes) % 10);
+}
+#endif
+
 //--------------- Main ------------------//
 int main() {
+    rtos_stats_init(); // CPU and stack statistics per thread, shown by the "top" command
+    rtos_stats_add_report(print_mutex_reports); // with the pc_screen_mutex measurements
+
+#if SCREEN_BENCHMARK
+    screen_benchmark();
+    while (1) {
+        __WFI(); // Wait For Interrupt
+    }
+#endif
+
+    init_screen(pc_write);
 
-    // Falling edge interrupts for buttons
-    go.fall(&go_handler);
-    arrow_down.fall(&down_handler);
-    ok.fall(&ok_handler);
-    arrow_up.fall(&up_handler);
+    // Both edges of the buttons go to the debouncer, the presses come out in button_event()
+    buttons.add(go, "GO");
+    buttons.add(arrow_down, "DOWN");
+    buttons.add(ok, "OK");
+    buttons.add(arrow_up, "UP");
 
-    // Launch the threads
-    thread1.start(callback(pc_cont));
-    thread_songs_menu.start(callback(Tune_menu));
-    thread2.start(callback(Tune_select));
-    thread3.start(callback(Play_tune));
+    // Commands from the PC
+    start_command_channel(&pc, run_command);
+
+    // Launch the player
+    player_thread.start(callback(run_player));
 
     while (1) {
-        __WFI(); // Wait For Interrupt
+        rtos_stats_wfi(); // Wait For Interrupt, counting the time asleep
     }
 }
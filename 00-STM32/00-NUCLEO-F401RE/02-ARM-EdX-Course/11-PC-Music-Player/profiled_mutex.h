@@ -0,0 +1,69 @@
+/*Header file for a Mutex that measures itself. ProfiledMutex has the same lock()/unlock()/trylock() calls as Mutex,
+so only the type of the declaration changes (the name is optional, Mutex takes one too):
+    ProfiledMutex lcd_mutex("lcd_mutex");
+For every lock it counts how often a thread had to wait, how long it waited and how long the mutex was then held
+(histograms, mean and maximum), which thread held it the longest, and the priority inversions: a thread that had to
+wait for an owner of lower priority. With MUTEX_PROFILING set to 0 it is a plain Mutex again. */
+
+#ifndef PROFILED_MUTEX_H
+#define PROFILED_MUTEX_H
+#include "mbed.h"
+
+#ifndef MUTEX_PROFILING
+#define MUTEX_PROFILING 1     //0: ProfiledMutex is a plain Mutex, the reports print nothing
+#endif
+#define MUTEX_HIST_BINS     12 //histogram bins: below 16 us, then doubling up to 16 ms, and the rest
+#define MUTEX_HIST_FIRST_US 16 //upper limit of the first bin
+
+//Measurements of one mutex. Times in microseconds, only the outermost lock of a recursive lock is counted.
+typedef struct {
+    uint32_t locks;                          //acquisitions
+    uint32_t contended;                      //of those, the mutex was taken and the thread had to wait
+    uint32_t inversions;                     //of those, the owner had a lower priority than the waiting thread
+    uint32_t wait_max, hold_max;
+    uint64_t wait_total, hold_total;
+    const char* longest_holder;              //thread that held it for hold_max
+    uint32_t wait_hist[MUTEX_HIST_BINS];
+    uint32_t hold_hist[MUTEX_HIST_BINS];
+} mutex_stats_t;
+
+//Function Prototypes
+void print_mutex_reports(FileHandle* out);    //report of every ProfiledMutex since its last report
+void profiled_mutex_set_wait_hook(void (*hook)(const char* name, bool waiting)); //around every wait, e.g. a trace
+
+#if MUTEX_PROFILING
+class ProfiledMutex {
+public:
+    ProfiledMutex(const char* name = "mutex");
+
+    void lock(void);
+    bool trylock(void);
+    bool trylock_for(Kernel::Clock::duration_u32 rel_time);
+    void unlock(void);
+    osThreadId_t get_owner(void) { return mutex.get_owner(); }
+
+    const char* get_name(void) const { return name; }
+    void get_stats(mutex_stats_t* copy);
+    void print_report(FileHandle* out);       //the measurements since the previous report, then starts over
+
+private:
+    void acquired(uint32_t wait_cycles, bool inverted);
+    bool is_inversion(void);
+
+    Mutex mutex;
+    const char* name;
+    ProfiledMutex* next;                      //list of all profiled mutexes, for print_mutex_reports()
+    uint32_t depth;                           //recursive locks by the owner
+    uint32_t hold_start;                      //cycle counter when the owner got it
+    mutex_stats_t stats;
+    friend void print_mutex_reports(FileHandle* out);
+};
+#else
+class ProfiledMutex : public Mutex {
+public:
+    ProfiledMutex(const char* name = "mutex") : Mutex(name) {}
+    void print_report(FileHandle*) {}
+};
+#endif
+
+#endif
@@ -0,0 +1,230 @@
+/*RTOS statistics service. RTX calls osRtxThreadStackCheck() on every context switch to check the stack of the thread
+that is switched out; it is a weak function, so this file replaces it with a version that also does the accounting:
+the cycles since the previous switch (DWT cycle counter) are added to the outgoing thread, its stack pointer is
+compared to the lowest one seen, and the incoming thread gets a switch counted. That is a few dozen cycles per switch
+and nothing in between.
+
+The cycle counter stops while the core sleeps, so the time asleep is the wall time (microsecond ticker) minus all the
+cycles counted. A report shows the interval since the previous one, like "top". Requires the RTX stack check, which
+is on by default (OS_STACK_CHECK). */
+
+#include "rtos_stats.h"
+#include "report_line.h"
+#if RTOS_STATS
+#include "rtx_os.h"
+
+#define REQUEST_FLAG  0x01
+#define POLL_MS       200   //how often the reporter looks at the console for a key press
+
+typedef struct {
+    const osRtxThread_t* thread; //nullptr: free line
+    uint64_t cycles;             //CPU cycles while it was running
+    uint32_t switches;           //times it was switched in
+    uint32_t lowest_sp;          //lowest stack pointer seen when it was switched out
+} thread_stats_t;
+
+typedef struct {
+    thread_stats_t threads[RTOS_STATS_THREADS + 1]; //the last line collects the threads that did not fit
+    uint64_t total_cycles;       //all threads together
+    uint64_t hook_cycles;        //time spent in the accounting itself
+    uint64_t wfi_us;             //time asleep in rtos_stats_wfi()
+    uint32_t switches;
+    uint32_t time_us;            //microsecond ticker when the snapshot was taken
+} stats_t;
+
+static stats_t stats;            //live counters, written by the hook
+static stats_t reported;         //counters at the previous report
+static uint32_t last_switch;     //cycle counter at the previous switch
+static bool counting = false;
+static void (*extra_reports[RTOS_STATS_REPORTS])(FileHandle* out);
+static void (*switch_hook)(const char* thread) = nullptr;
+
+static thread_stats_t* find(const osRtxThread_t* thread) { //Line of a thread, new threads take a free one
+    for (int i = 0; i < RTOS_STATS_THREADS; i++) {
+        if (stats.threads[i].thread == thread) return &stats.threads[i];
+        if (stats.threads[i].thread == nullptr) {
+            stats.threads[i].thread = thread;
+            stats.threads[i].lowest_sp = UINT32_MAX;
+            return &stats.threads[i];
+        }
+    }
+    return &stats.threads[RTOS_STATS_THREADS];
+}
+
+static void count_switch(const osRtxThread_t* out, const osRtxThread_t* in) { //Runs in the PendSV/SVC handler
+    uint32_t now = DWT->CYCCNT;
+    if (!counting) return;
+
+    thread_stats_t* s = find(out);
+    uint32_t elapsed = now - last_switch;
+    s->cycles += elapsed;
+    stats.total_cycles += elapsed;
+    if (out->sp < s->lowest_sp) s->lowest_sp = out->sp;
+    find(in)->switches++;
+    stats.switches++;
+    if (switch_hook) switch_hook(in->name);
+
+    last_switch = DWT->CYCCNT;
+    stats.hook_cycles += last_switch - now;
+}
+
+static bool stack_ok(const osRtxThread_t* thread) { //The check RTX does in its own version of the function
+    return thread->sp > (uint32_t)thread->stack_mem && *(const uint32_t*)thread->stack_mem == osRtxStackMagicWord;
+}
+
+//RTX 5.5.3 passes the outgoing thread, older versions leave it in run.curr. The incoming one is always run.next.
+#if (osRtxVersionKernel >= 50050003)
+extern "C" uint8_t osRtxThreadStackCheck(const osRtxThread_t* thread) {
+    count_switch(thread, osRtxInfo.thread.run.next);
+    return stack_ok(thread);
+}
+#else
+extern "C" uint8_t osRtxThreadStackCheck(void) {
+    const osRtxThread_t* thread = osRtxInfo.thread.run.curr;
+    count_switch(thread, osRtxInfo.thread.run.next);
+    return stack_ok(thread);
+}
+#endif
+
+void rtos_stats_init(void) {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    CriticalSectionLock lock;
+    last_switch = DWT->CYCCNT;
+    stats.time_us = us_ticker_read();
+    reported = stats;
+    counting = true;
+}
+
+void rtos_stats_wfi(void) {
+    uint32_t start = us_ticker_read();
+    __WFI();
+    uint32_t slept = us_ticker_read() - start;
+    CriticalSectionLock lock;
+    stats.wfi_us += slept;
+}
+
+static uint32_t permille(uint64_t part, uint64_t whole) {
+    return whole ? (uint32_t)(part * 1000 / whole) : 0;
+}
+
+void rtos_stats_report(FileHandle* out) {
+    static const char state_letter[] = { 'I', 'r', 'R', 'B', 'T' }; //Inactive, ready, Running, Blocked, Terminated
+    stats_t now, before;
+    {
+        CriticalSectionLock lock;
+        stats.time_us = us_ticker_read();
+        now = stats;
+        before = reported;
+        reported = stats;
+    }
+
+    uint32_t cycles_per_us = SystemCoreClock / 1000000;
+    uint64_t interval_us = now.time_us - before.time_us;
+    uint64_t interval_cycles = interval_us * cycles_per_us;
+    uint64_t awake_cycles = (now.total_cycles - before.total_cycles) + (now.hook_cycles - before.hook_cycles);
+    uint64_t asleep_cycles = interval_cycles > awake_cycles ? interval_cycles - awake_cycles : 0;
+    uint32_t switches = now.switches - before.switches;
+    uint32_t p;
+
+    print_line(out, "\n\rRTOS stats over %lu ms: %lu context switches (%lu/s), accounting %lu.%02lu %%\n\r",
+               (unsigned long)(interval_us / 1000), (unsigned long)switches,
+               (unsigned long)(interval_us ? (uint64_t)switches * 1000000 / interval_us : 0),
+               (unsigned long)(permille(now.hook_cycles - before.hook_cycles, interval_cycles * 10) / 100),
+               (unsigned long)(permille(now.hook_cycles - before.hook_cycles, interval_cycles * 10) % 100));
+    print_line(out, "%-16s %s %4s %7s %8s %13s\n\r", "THREAD", "S", "PRIO", "CPU", "SWITCHES", "STACK USED");
+
+    osThreadId_t ids[RTOS_STATS_THREADS + 4];
+    uint32_t count = osThreadEnumerate(ids, sizeof(ids) / sizeof(ids[0]));
+    for (uint32_t i = 0; i < count; i++) {
+        const osRtxThread_t* thread = (const osRtxThread_t*)ids[i];
+        const thread_stats_t* a = nullptr;
+        const thread_stats_t* b = nullptr;
+        for (int j = 0; j < RTOS_STATS_THREADS; j++) {
+            if (now.threads[j].thread == thread) a = &now.threads[j];
+            if (before.threads[j].thread == thread) b = &before.threads[j];
+        }
+        uint64_t cycles = a ? a->cycles - (b ? b->cycles : 0) : 0;
+        uint32_t thread_switches = a ? a->switches - (b ? b->switches : 0) : 0;
+
+        //Stack: the watermark if RTX keeps one, otherwise the deepest point seen at a switch
+        uint32_t size = osThreadGetStackSize(ids[i]);
+        uint32_t space = osThreadGetStackSpace(ids[i]);
+        uint32_t used = space ? size - space : 0;
+        if (a && a->lowest_sp != UINT32_MAX) {
+            uint32_t sampled = (uint32_t)thread->stack_mem + size - a->lowest_sp;
+            if (sampled > used) used = sampled;
+        }
+
+        const char* name = osThreadGetName(ids[i]);
+        osThreadState_t state = osThreadGetState(ids[i]);
+        p = permille(cycles, interval_cycles);
+        print_line(out, "%-16.16s %c %4d %3lu.%lu %% %8lu %6lu/%-6lu\n\r", name ? name : "(no name)",
+                   (state >= 0 && state <= 4) ? state_letter[state] : '?', (int)osThreadGetPriority(ids[i]),
+                   (unsigned long)(p / 10), (unsigned long)(p % 10), (unsigned long)thread_switches,
+                   (unsigned long)used, (unsigned long)size);
+    }
+
+    const thread_stats_t* others = &now.threads[RTOS_STATS_THREADS];
+    if (others->switches) {
+        p = permille(others->cycles - before.threads[RTOS_STATS_THREADS].cycles, interval_cycles);
+        print_line(out, "%-16s %11lu.%lu %%\n\r", "(other threads)", (unsigned long)(p / 10), (unsigned long)(p % 10));
+    }
+    p = permille(asleep_cycles, interval_cycles);
+    print_line(out, "%-16s %11lu.%lu %%\n\r", "(asleep)", (unsigned long)(p / 10), (unsigned long)(p % 10));
+    p = permille(now.wfi_us - before.wfi_us, interval_us);
+    print_line(out, "%-16s %11lu.%lu %%\n\r", "(of it in main)", (unsigned long)(p / 10), (unsigned long)(p % 10));
+
+    for (int i = 0; i < RTOS_STATS_REPORTS && extra_reports[i]; i++) extra_reports[i](out);
+}
+
+void rtos_stats_add_report(void (*report)(FileHandle* out)) { //Set up in main(), before the reporter prints
+    for (int i = 0; i < RTOS_STATS_REPORTS; i++) {
+        if (extra_reports[i] == nullptr) {
+            extra_reports[i] = report;
+            return;
+        }
+    }
+}
+
+void rtos_stats_set_switch_hook(void (*hook)(const char* thread)) {
+    switch_hook = hook;
+}
+
+/*-------------------------------------------Reporter thread------------------------------------------------*/
+//Above normal: some threads of these projects never sleep, a lower priority would never get to print
+static Thread reporter(osPriorityAboveNormal, 1536, nullptr, "rtos_stats");
+static FileHandle* report_out;
+static uint32_t report_period_ms;
+
+static void reporter_loop(void) {
+    FileHandle* console = mbed_file_handle(STDIN_FILENO);
+    uint32_t waited_ms = 0;
+    while (true) {
+        uint32_t flags = ThisThread::flags_wait_any_for(REQUEST_FLAG, std::chrono::milliseconds(POLL_MS));
+        bool requested = (flags & osFlagsError) == 0;
+        waited_ms += POLL_MS;
+
+        while (console->readable()) { //any key asks for a report
+            char c;
+            console->read(&c, 1);
+            requested = true;
+        }
+        if (requested || (report_period_ms && waited_ms >= report_period_ms)) {
+            rtos_stats_report(report_out);
+            waited_ms = 0;
+        }
+    }
+}
+
+void rtos_stats_start_reporter(FileHandle* out, uint32_t period_ms) {
+    report_out = out;
+    report_period_ms = period_ms;
+    reporter.start(callback(reporter_loop));
+}
+
+void rtos_stats_request(void) {
+    reporter.flags_set(REQUEST_FLAG);
+}
+
+#endif
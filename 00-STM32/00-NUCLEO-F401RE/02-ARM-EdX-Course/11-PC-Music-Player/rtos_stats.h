@@ -0,0 +1,34 @@
+/*Header file for the RTOS statistics service: CPU time and context switches per thread, stack high-water marks, time
+in the idle thread and time asleep, printed as a "top"-like table. With RTOS_STATS set to 0 nothing of it is compiled:
+the functions below become empty and rtos_stats_wfi() is a plain __WFI(). */
+
+#ifndef RTOS_STATS_H
+#define RTOS_STATS_H
+#include "mbed.h"
+
+#ifndef RTOS_STATS
+#define RTOS_STATS 1          //0: no statistics, no code, no RAM
+#endif
+#define RTOS_STATS_THREADS 12 //threads that get their own line, later ones are added up as "others"
+#define RTOS_STATS_REPORTS 4  //reports of other modules printed after the table, in the order they were added
+
+#if RTOS_STATS
+//Function Prototypes
+void rtos_stats_init(void);                                   //start counting, call first thing in main()
+void rtos_stats_start_reporter(FileHandle* out, uint32_t period_ms); //print every period_ms (0: only on request)
+void rtos_stats_request(void);                                //print now (from the reporter thread), ISR-safe
+void rtos_stats_report(FileHandle* out);                      //print now, from the calling thread
+void rtos_stats_wfi(void);                                    //__WFI() that counts the time asleep
+void rtos_stats_add_report(void (*report)(FileHandle* out));  //printed after every report, e.g. of other modules
+void rtos_stats_set_switch_hook(void (*hook)(const char* thread)); //called at every switch (PendSV), e.g. a trace
+#else
+inline void rtos_stats_init(void) {}
+inline void rtos_stats_start_reporter(FileHandle*, uint32_t) {}
+inline void rtos_stats_request(void) {}
+inline void rtos_stats_report(FileHandle*) {}
+inline void rtos_stats_wfi(void) { __WFI(); }
+inline void rtos_stats_add_report(void (*)(FileHandle*)) {}
+inline void rtos_stats_set_switch_hook(void (*)(const char*)) {}
+#endif
+
+#endif
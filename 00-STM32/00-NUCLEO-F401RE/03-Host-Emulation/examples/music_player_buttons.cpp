@@ -0,0 +1,16 @@
+/*Hooks for 10-Improved-Music-Player: a user who opens the menu, moves the cursor to the second song and plays it.
+    make PROJECT=../02-ARM-EdX-Course/10-Improved-Music-Player HOOKS=examples/music_player_buttons.cpp run
+The buttons are active low (pressed = 0) and held for 100 ms; the notes show up with HOST_TRACE=1 as PWM changes. */
+
+#include "host_hooks.h"
+
+static void press(uint32_t ms, PinName button) {
+    host_at(ms, [button] { host_set_pin(button, 0); });
+    host_at(ms + 100, [button] { host_set_pin(button, 1); });
+}
+
+void host_setup(void) {
+    press(1000, D7); //GO: song menu
+    press(2000, D4); //UP: next song
+    press(3000, D5); //OK: play it
+}
@@ -0,0 +1,39 @@
+/*Header file for the "outside world" of the host build: what a test or a demo uses to press buttons, turn
+potentiometers and type on the PC terminal while a course project runs unmodified on the PC. The hooks live in their
+own .cpp, given to the Makefile with HOOKS=..., which defines host_setup() to schedule the inputs, e.g.:
+    void host_setup(void) {
+        host_at(1000, [] { host_set_pin(D7, 0); });  //press the button on D7 after 1 s...
+        host_at(1100, [] { host_set_pin(D7, 1); });  //...and release it 100 ms later
+    }
+Everything scheduled with host_at() runs as an interrupt, so its InterruptIn handlers run right away. The functions
+can also be called from a std::thread of the hooks file.
+
+The same inputs can be written as a scenario file instead, loaded with HOST_SCENARIO=file (scenario.cpp), and checked
+with host_check(). Both are meant for HOST_VIRTUAL=1, where the times are exact and every run is the same. */
+
+#ifndef HOST_HOOKS_H
+#define HOST_HOOKS_H
+#include "mbed.h"
+
+//Function Prototypes
+void host_setup(void);                                      //defined by the hooks file, runs before main()
+
+void host_set_pin(PinName pin, int value);                  //drives an input, edges run the InterruptIn handlers
+int host_get_pin(PinName pin);                              //level of any pin, input or output
+void host_set_analog(PinName pin, float value);             //what AnalogIn reads, 0.0 to 1.0 (default 0.5)
+void host_serial_input(const char* data, size_t length);    //bytes "typed" on the PC terminal
+
+void host_at(uint32_t ms, Callback<void()> action);          //runs action as an interrupt, ms after the start
+void host_at_us(uint64_t us, Callback<void()> action);       //the same in us, for bounces and short pulses
+void host_watch_pins(Callback<void(PinName, int)> observer); //called on every change of a DigitalOut
+void host_watch_pwm(Callback<void(PinName, float, float)> observer); //every PwmOut change: period (s) and duty
+void host_set_spi_device(Callback<int(int)> device);        //replaces the LCD on the SPI bus: byte in, byte out
+
+const char* host_lcd_row(int row);                          //text on a row of the 20x4 LCD, 0 to 3
+const char* host_pin_name(PinName pin);                     //"D7", "A0", or "PC_13" without an Arduino name
+uint64_t host_time_us(void);                                //time since the start
+void host_stop(int code);                                   //flushes the output and ends the program
+void host_check(bool ok, const char* what);                 //reports a failed check, the exit code becomes 1
+bool host_load_scenario(const char* path);                  //schedules the steps of a scenario file, see scenario.cpp
+
+#endif
@@ -0,0 +1,686 @@
+/*Host version of "mbed.h": the part of the Mbed OS 6 API that the course projects use, implemented on a Linux PC
+(mbed_host.cpp) so the projects can be built and run without a board. The RTOS objects behave like the RTX ones:
+only one thread runs at a time (the one with the highest priority, round-robin between equal priorities), and
+interrupts (Ticker, InterruptIn, the UART) run in between. The pins are variables: outputs can be watched and inputs
+are driven from host_hooks.h. The SPI bus has the 4-bit LCD of the course attached, which is printed on stderr.
+
+Only what the projects need is here; the signatures follow Mbed OS 6 so the same source builds for both. */
+
+#ifndef MBED_HOST_H
+#define MBED_HOST_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <chrono>
+#include <functional>
+#include <new>
+#include <type_traits>
+
+/*-------------------------------------------Pins-----------------------------------------------------------*/
+//Port pins as PA_0 = 0x00 ... PC_15 = 0x2F, like the STM32 targets, and the Arduino names of the NUCLEO-F401RE
+typedef enum {
+    PA_0 = 0x00, PA_1, PA_2, PA_3, PA_4, PA_5, PA_6, PA_7, PA_8, PA_9, PA_10, PA_11, PA_12, PA_13, PA_14, PA_15,
+    PB_0 = 0x10, PB_1, PB_2, PB_3, PB_4, PB_5, PB_6, PB_7, PB_8, PB_9, PB_10, PB_11, PB_12, PB_13, PB_14, PB_15,
+    PC_0 = 0x20, PC_1, PC_2, PC_3, PC_4, PC_5, PC_6, PC_7, PC_8, PC_9, PC_10, PC_11, PC_12, PC_13, PC_14, PC_15,
+
+    D0 = PA_3, D1 = PA_2, D2 = PA_10, D3 = PB_3, D4 = PB_5, D5 = PB_4, D6 = PB_10, D7 = PA_8,
+    D8 = PA_9, D9 = PC_7, D10 = PB_6, D11 = PA_7, D12 = PA_6, D13 = PA_5, D14 = PB_9, D15 = PB_8,
+    A0 = PA_0, A1 = PA_1, A2 = PA_4, A3 = PB_0, A4 = PC_1, A5 = PC_0,
+    LED1 = PA_5, BUTTON1 = PC_13, USBTX = PA_2, USBRX = PA_3,
+
+    PIN_COUNT = 0x30,
+    NC = -1
+} PinName;
+
+typedef enum { PullNone = 0, PullUp = 1, PullDown = 2, OpenDrain = 3, PullDefault = PullNone } PinMode;
+
+/*-------------------------------------------CMSIS-RTOS types-----------------------------------------------*/
+typedef void* osThreadId_t;
+typedef int32_t osStatus_t;
+typedef osStatus_t osStatus;
+
+#define osOK               0
+#define osError           -1
+#define osErrorTimeout    -2
+#define osErrorResource   -3
+#define osErrorParameter  -4
+
+#define osWaitForever      0xFFFFFFFFU
+#define osFlagsWaitAny     0x00000000U
+#define osFlagsWaitAll     0x00000001U
+#define osFlagsNoClear     0x00000002U
+#define osFlagsError       0x80000000U
+#define osFlagsErrorTimeout 0xFFFFFFFEU
+#define osFlagsErrorResource 0xFFFFFFFDU
+
+typedef enum {
+    osPriorityNone = 0, osPriorityIdle = 1, osPriorityLow = 8, osPriorityBelowNormal = 16, osPriorityNormal = 24,
+    osPriorityAboveNormal = 32, osPriorityHigh = 40, osPriorityRealtime = 48, osPriorityISR = 56, osPriorityError = -1
+} osPriority_t;
+typedef osPriority_t osPriority;
+
+typedef enum {
+    osThreadInactive = 0, osThreadReady = 1, osThreadRunning = 2, osThreadBlocked = 3, osThreadTerminated = 4,
+    osThreadError = -1
+} osThreadState_t;
+
+#define OS_STACK_SIZE 4096
+
+uint32_t osThreadFlagsSet(osThreadId_t thread_id, uint32_t flags);
+osThreadId_t osThreadGetId(void);
+const char* osThreadGetName(osThreadId_t thread_id);
+osPriority_t osThreadGetPriority(osThreadId_t thread_id);
+osThreadState_t osThreadGetState(osThreadId_t thread_id);
+
+/*-------------------------------------------Callbacks------------------------------------------------------*/
+namespace mbed {
+
+template <typename Signature>
+class Callback;
+
+//Any function, function object, or (object, method) pair, like mbed::Callback
+template <typename R, typename... Args>
+class Callback<R(Args...)> : public std::function<R(Args...)> {
+public:
+    Callback() {}
+    Callback(std::nullptr_t) {}
+    template <typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type,
+                                                                           Callback>::value>::type>
+    Callback(F f) : std::function<R(Args...)>(f) {}
+    template <typename T, typename U>
+    Callback(U* object, R (T::*method)(Args...))
+        : std::function<R(Args...)>([=](Args... a) { return (object->*method)(a...); }) {}
+    template <typename T, typename U>
+    Callback(U* object, R (T::*method)(Args...) const)
+        : std::function<R(Args...)>([=](Args... a) { return (object->*method)(a...); }) {}
+};
+
+template <typename R>
+Callback<R()> callback(R (*function)(void)) { return Callback<R()>(function); }
+
+//Old style: a function taking one pointer, and the pointer to pass it
+template <typename R, typename P, typename T>
+Callback<R()> callback(R (*function)(P), T* argument) {
+    return Callback<R()>([=]() { return function((P)argument); });
+}
+
+template <typename R, typename T, typename U>
+Callback<R()> callback(U* object, R (T::*method)()) { return Callback<R()>(object, method); }
+
+template <typename R, typename T, typename U>
+Callback<R()> callback(U* object, R (T::*method)() const) { return Callback<R()>(object, method); }
+
+template <typename F>
+auto callback(F function) -> Callback<decltype(function())()> { return Callback<decltype(function())()>(function); }
+
+} //namespace mbed
+
+/*-------------------------------------------Kernel internals-----------------------------------------------*/
+//Used by the classes below, implemented in mbed_host.cpp
+namespace host {
+
+struct HostThread;
+struct TimerEvent;
+
+struct WaitQueue {                   //threads blocked on an object, highest priority first
+    HostThread* first = nullptr;
+};
+
+const uint64_t NEVER = UINT64_MAX;
+
+class Lock {                         //the kernel lock: keeps interrupts and kernel calls of other threads out
+public:
+    Lock();
+    ~Lock();
+    Lock(const Lock&) = delete;
+    Lock& operator=(const Lock&) = delete;
+};
+
+uint64_t now_us(void);
+uint64_t deadline_ms(uint32_t ms);              //NEVER for osWaitForever
+HostThread* current(void);                      //nullptr in interrupts
+bool block_on(WaitQueue& queue, uint64_t deadline); //with the Lock held once; false: timed out
+HostThread* wake_one(WaitQueue& queue);          //nullptr if nobody was waiting
+void wake_all(WaitQueue& queue);
+
+TimerEvent* timer_new(void);
+void timer_start(TimerEvent* timer, mbed::Callback<void()> action, uint64_t delay_us, uint64_t period_us);
+void timer_stop(TimerEvent* timer);
+void timer_delete(TimerEvent* timer);
+
+void wfi(void);
+void critical_enter(void);
+void critical_exit(void);
+
+} //namespace host
+
+/*-------------------------------------------Cortex-M registers---------------------------------------------*/
+//DWT->CYCCNT counts at SystemCoreClock, derived from the clock of the host (or the simulated one)
+struct host_cyccnt_t {
+    operator uint32_t() const;
+    host_cyccnt_t& operator=(uint32_t value);
+};
+struct DWT_Type {
+    volatile uint32_t CTRL;
+    host_cyccnt_t CYCCNT;
+};
+struct CoreDebug_Type {
+    volatile uint32_t DEMCR;
+};
+extern DWT_Type host_dwt;
+extern CoreDebug_Type host_core_debug;
+extern uint32_t SystemCoreClock;
+
+#define DWT (&host_dwt)
+#define CoreDebug (&host_core_debug)
+#define DWT_CTRL_CYCCNTENA_Msk       (1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk   (1UL << 24)
+
+inline void __WFI(void) { host::wfi(); }
+inline void __disable_irq(void) { host::critical_enter(); }
+inline void __enable_irq(void) { host::critical_exit(); }
+inline void core_util_critical_section_enter(void) { host::critical_enter(); }
+inline void core_util_critical_section_exit(void) { host::critical_exit(); }
+bool core_util_is_isr_active(void);
+
+#define MBED_ASSERT(expr) ((expr) ? (void)0 : host_assert_failed(#expr, __FILE__, __LINE__))
+void host_assert_failed(const char* expr, const char* file, int line);
+void error(const char* format, ...) __attribute__((noreturn, format(printf, 1, 2))); //prints and halts, as in Mbed OS
+void mbed_error_printf(const char* format, ...) __attribute__((format(printf, 1, 2))); //console of the fault handler
+typedef struct {
+    int error_status;
+} mbed_error_ctx;
+extern "C" void mbed_error_hook(const mbed_error_ctx* error_context); //weak, called by error()
+
+uint32_t us_ticker_read(void);
+void wait_us(int us);
+void wait_ns(unsigned int ns);
+void thread_sleep_for(uint32_t millisec);
+void rtos_attach_idle_hook(void (*hook)(void));
+
+/*-------------------------------------------RTOS-----------------------------------------------------------*/
+namespace rtos {
+
+namespace Kernel {
+struct Clock {
+    using rep = int64_t;
+    using period = std::milli;
+    using duration = std::chrono::duration<rep, period>;
+    using time_point = std::chrono::time_point<Clock, duration>;
+    using duration_u32 = std::chrono::duration<uint32_t, period>;
+    static const bool is_steady = true;
+    static time_point now() { return time_point(duration((rep)(host::now_us() / 1000))); }
+};
+const Clock::duration_u32 wait_for_u32_forever(osWaitForever);
+const Clock::duration_u32 wait_for_u32_max(osWaitForever - 1);
+inline uint64_t get_ms_count(void) { return host::now_us() / 1000; }
+} //namespace Kernel
+
+class Mutex {
+public:
+    Mutex(const char* name = nullptr) : name(name), owner(nullptr), count(0) {}
+    void lock(void);
+    bool trylock(void);
+    bool trylock_for(Kernel::Clock::duration_u32 rel_time);
+    void unlock(void);
+    osThreadId_t get_owner(void);
+
+private:
+    const char* name;
+    host::HostThread* owner;
+    uint32_t count;
+    host::WaitQueue waiters;
+};
+
+class Semaphore {
+public:
+    Semaphore(int32_t count = 0, uint16_t max_count = 0xFFFF) : tokens(count), max_count(max_count) {}
+    void acquire(void);
+    bool try_acquire(void);
+    bool try_acquire_for(Kernel::Clock::duration_u32 rel_time);
+    osStatus release(void);
+
+private:
+    int32_t tokens;
+    uint16_t max_count;
+    host::WaitQueue waiters;
+};
+
+class EventFlags {
+public:
+    EventFlags(const char* name = nullptr) : flags(0) { (void)name; }
+    uint32_t set(uint32_t flags);
+    uint32_t clear(uint32_t flags = 0x7fffffff);
+    uint32_t get(void) const { return flags; }
+    uint32_t wait_all(uint32_t flags = 0, uint32_t millisec = osWaitForever, bool clear = true);
+    uint32_t wait_any(uint32_t flags = 0, uint32_t millisec = osWaitForever, bool clear = true);
+    uint32_t wait_all_for(uint32_t flags, Kernel::Clock::duration_u32 rel_time, bool clear = true);
+    uint32_t wait_any_for(uint32_t flags, Kernel::Clock::duration_u32 rel_time, bool clear = true);
+
+private:
+    uint32_t wait(uint32_t flags, uint32_t options, uint64_t deadline);
+    uint32_t flags;
+    host::WaitQueue waiters;
+};
+
+//Fixed ring of pointers, the part of Queue that does not depend on the type
+class QueueCore {
+public:
+    QueueCore(void** slots, uint32_t size) : slots(slots), size(size), first(0), used(0) {}
+    bool put(void* data, uint64_t deadline);
+    bool get(void** data, uint64_t deadline);
+    uint32_t count(void) const { return used; }
+
+private:
+    void** slots;
+    uint32_t size, first, used;
+    host::WaitQueue getters, putters;
+};
+
+template <typename T, uint32_t N>
+class Queue {
+public:
+    Queue() : core(slots, N) {}
+    bool try_put(T* data, uint8_t prio = 0) { (void)prio; return core.put(data, 0); }
+    bool try_put_for(Kernel::Clock::duration_u32 rel_time, T* data, uint8_t prio = 0) {
+        (void)prio;
+        return core.put(data, host::deadline_ms(rel_time.count()));
+    }
+    bool try_get(T** data) { return core.get((void**)data, 0); }
+    bool try_get_for(Kernel::Clock::duration_u32 rel_time, T** data) {
+        return core.get((void**)data, host::deadline_ms(rel_time.count()));
+    }
+    uint32_t count(void) const { return core.count(); }
+    bool empty(void) const { return core.count() == 0; }
+    bool full(void) const { return core.count() == N; }
+
+private:
+    void* slots[N];
+    QueueCore core;
+};
+
+//Free list of fixed blocks, the part of MemoryPool that does not depend on the type
+class PoolCore {
+public:
+    PoolCore(void* blocks, size_t block_size, uint32_t count);
+    void* alloc(uint64_t deadline);
+    osStatus free(void* block);
+
+private:
+    char* blocks;
+    size_t block_size;
+    uint32_t count;
+    void* free_list;
+    host::WaitQueue waiters;
+};
+
+template <typename T, uint32_t N>
+class MemoryPool {
+public:
+    MemoryPool() : core(blocks, sizeof(block_t), N) {}
+    T* try_alloc(void) { return (T*)core.alloc(0); }
+    T* try_alloc_for(Kernel::Clock::duration_u32 rel_time) {
+        return (T*)core.alloc(host::deadline_ms(rel_time.count()));
+    }
+    T* try_calloc(void) {
+        T* block = try_alloc();
+        if (block) memset((void*)block, 0, sizeof(T));
+        return block;
+    }
+    T* alloc(void) { return try_alloc(); }
+    osStatus free(T* block) { return core.free(block); }
+
+private:
+    union block_t {
+        void* next;
+        alignas(T) char data[sizeof(T)];
+    };
+    block_t blocks[N];
+    PoolCore core;
+};
+
+class Thread {
+public:
+    Thread(osPriority priority = osPriorityNormal, uint32_t stack_size = OS_STACK_SIZE,
+           unsigned char* stack_mem = nullptr, const char* name = nullptr);
+    ~Thread();
+    osStatus start(mbed::Callback<void()> task);
+    osStatus join(void);
+    osStatus terminate(void);
+    osStatus set_priority(osPriority priority);
+    osPriority get_priority(void) const;
+    uint32_t flags_set(uint32_t flags);
+    osThreadState_t get_state(void) const;
+    uint32_t stack_size(void) const { return size; }
+    const char* get_name(void) const { return name; }
+    osThreadId_t get_id(void) const { return (osThreadId_t)thread; }
+
+private:
+    host::HostThread* thread;
+    osPriority priority;
+    uint32_t size;
+    const char* name;
+    Thread(const Thread&) = delete;
+};
+
+namespace ThisThread {
+void sleep_for(uint32_t millisec);
+void sleep_for(Kernel::Clock::duration_u32 rel_time);
+void sleep_until(Kernel::Clock::time_point abs_time);
+void yield(void);
+osThreadId_t get_id(void);
+const char* get_name(void);
+uint32_t flags_get(void);
+uint32_t flags_clear(uint32_t flags);
+uint32_t flags_wait_any(uint32_t flags, bool clear = true);
+uint32_t flags_wait_all(uint32_t flags, bool clear = true);
+uint32_t flags_wait_any_for(uint32_t flags, Kernel::Clock::duration_u32 rel_time, bool clear = true);
+uint32_t flags_wait_all_for(uint32_t flags, Kernel::Clock::duration_u32 rel_time, bool clear = true);
+} //namespace ThisThread
+
+} //namespace rtos
+
+/*-------------------------------------------Drivers--------------------------------------------------------*/
+namespace mbed {
+
+class CriticalSectionLock {
+public:
+    CriticalSectionLock() { host::critical_enter(); }
+    ~CriticalSectionLock() { host::critical_exit(); }
+    static void enable(void) { host::critical_enter(); }
+    static void disable(void) { host::critical_exit(); }
+};
+
+class DigitalOut {
+public:
+    DigitalOut(PinName pin, int value = 0) : pin(pin) { write(value); }
+    void write(int value);
+    int read(void);
+    int is_connected(void) { return pin != NC; }
+    DigitalOut& operator=(int value) { write(value); return *this; }
+    DigitalOut& operator=(DigitalOut& other) { write(other.read()); return *this; }
+    operator int() { return read(); }
+
+private:
+    PinName pin;
+};
+
+class DigitalIn {
+public:
+    DigitalIn(PinName pin, PinMode mode = PullDefault) : pin(pin) { this->mode(mode); }
+    int read(void);
+    void mode(PinMode pull);
+    int is_connected(void) { return pin != NC; }
+    operator int() { return read(); }
+
+private:
+    PinName pin;
+};
+
+class BusIn {
+public:
+    BusIn(PinName p0, PinName p1 = NC, PinName p2 = NC, PinName p3 = NC, PinName p4 = NC, PinName p5 = NC,
+          PinName p6 = NC, PinName p7 = NC);
+    int read(void);
+    void mode(PinMode pull);
+    operator int() { return read(); }
+
+private:
+    PinName pins[8];
+};
+
+class InterruptIn {
+public:
+    InterruptIn(PinName pin, PinMode mode = PullDefault);
+    ~InterruptIn();
+    int read(void);
+    void mode(PinMode pull);
+    void rise(Callback<void()> handler);
+    void fall(Callback<void()> handler);
+    void enable_irq(void) { enabled = true; }
+    void disable_irq(void) { enabled = false; }
+    operator int() { return read(); }
+
+    //Called by the pin model on an edge, in interrupt context
+    void edge(int value) {
+        if (!enabled) return;
+        if (value && rise_handler) rise_handler();
+        if (!value && fall_handler) fall_handler();
+    }
+
+private:
+    PinName pin;
+    bool enabled;
+    Callback<void()> rise_handler, fall_handler;
+};
+
+class AnalogIn {
+public:
+    AnalogIn(PinName pin, float vref = 3.3f) : pin(pin), vref(vref) {}
+    float read(void);
+    unsigned short read_u16(void);
+    float read_voltage(void) { return read() * vref; }
+    void set_reference_voltage(float vref) { this->vref = vref; }
+    operator float() { return read(); }
+
+private:
+    PinName pin;
+    float vref;
+};
+
+class PwmOut {
+public:
+    PwmOut(PinName pin) : pin(pin), period_s(0.02f), duty(0), suspended(false) {}
+    void write(float value);
+    float read(void) { return duty; }
+    void period(float seconds);
+    void period_ms(int ms) { period(ms / 1000.0f); }
+    void period_us(int us) { period(us / 1000000.0f); }
+    void pulsewidth(float seconds) { write(period_s > 0 ? seconds / period_s : 0); }
+    void pulsewidth_ms(int ms) { pulsewidth(ms / 1000.0f); }
+    void pulsewidth_us(int us) { pulsewidth(us / 1000000.0f); }
+    void suspend(void);
+    void resume(void);
+    PwmOut& operator=(float value) { write(value); return *this; }
+    PwmOut& operator=(PwmOut& other) { write(other.read()); return *this; }
+    operator float() { return read(); }
+
+private:
+    void update(void);
+    PinName pin;
+    float period_s, duty;
+    bool suspended;
+};
+
+class SPI {
+public:
+    SPI(PinName mosi, PinName miso, PinName sclk, PinName ssel = NC) {
+        (void)mosi;
+        (void)miso;
+        (void)sclk;
+        (void)ssel;
+    }
+    void format(int bits, int mode = 0) { (void)bits; (void)mode; }
+    void frequency(int hz = 1000000) { (void)hz; }
+    int write(int value);
+    int write(const char* tx_buffer, int tx_length, char* rx_buffer, int rx_length);
+    void lock(void) {}
+    void unlock(void) {}
+};
+
+class I2C {
+public:
+    I2C(PinName sda, PinName scl) { (void)sda; (void)scl; }
+    void frequency(int hz) { (void)hz; }
+    int read(int address, char* data, int length, bool repeated = false);
+    int write(int address, const char* data, int length, bool repeated = false);
+    int write(int data) { (void)data; return 1; }
+    int read(int ack) { (void)ack; return 0xFF; }
+    void start(void) {}
+    void stop(void) {}
+    void lock(void) {}
+    void unlock(void) {}
+};
+
+class FileHandle {
+public:
+    virtual ~FileHandle() {}
+    virtual ssize_t read(void* buffer, size_t size) { (void)buffer; (void)size; return -1; }
+    virtual ssize_t write(const void* buffer, size_t size) { (void)buffer; (void)size; return -1; }
+    virtual off_t seek(off_t offset, int whence = SEEK_SET) { (void)offset; (void)whence; return -1; }
+    virtual int close(void) { return 0; }
+    virtual int sync(void) { return 0; }
+    virtual int isatty(void) { return 1; }
+    virtual off_t size(void) { return -1; }
+    virtual int set_blocking(bool blocking) { return blocking ? 0 : -1; }
+    virtual bool is_blocking() const { return true; }
+    virtual bool readable() const { return false; }
+    virtual bool writable() const { return true; }
+    virtual void sigio(Callback<void()> func) { (void)func; }
+};
+
+//The PC UART: writes go to stdout, reads come from stdin (or host_serial_input())
+class BufferedSerial : public FileHandle {
+public:
+    BufferedSerial(PinName tx, PinName rx, int baud = 9600);
+    ~BufferedSerial();
+    ssize_t read(void* buffer, size_t size) override;
+    ssize_t write(const void* buffer, size_t size) override;
+    int set_blocking(bool blocking) override { this->blocking = blocking; return 0; }
+    bool is_blocking() const override { return blocking; }
+    bool readable() const override;
+    void sigio(Callback<void()> func) override;
+    void set_baud(int baud) { (void)baud; }
+    void set_format(int bits = 8, int parity = 0, int stop_bits = 1) { (void)bits; (void)parity; (void)stop_bits; }
+
+private:
+    bool blocking;
+};
+
+FileHandle* mbed_file_handle(int fd);
+FileHandle* mbed_override_console(int fd);
+
+class Timer {
+public:
+    Timer() : running(false), start_us(0), total_us(0) {}
+    void start(void);
+    void stop(void);
+    void reset(void);
+    std::chrono::microseconds elapsed_time(void) const;
+    int read_us(void) const { return (int)elapsed_time().count(); }
+    int read_ms(void) const { return (int)(elapsed_time().count() / 1000); }
+    float read(void) const { return elapsed_time().count() / 1000000.0f; }
+
+private:
+    bool running;
+    uint64_t start_us, total_us;
+};
+
+class Timeout {
+public:
+    Timeout() : event(host::timer_new()) {}
+    ~Timeout() { host::timer_delete(event); }
+    void attach(Callback<void()> func, std::chrono::microseconds t) { host::timer_start(event, func, t.count(), 0); }
+    void attach_us(Callback<void()> func, uint64_t t) { host::timer_start(event, func, t, 0); }
+    void detach(void) { host::timer_stop(event); }
+
+private:
+    host::TimerEvent* event;
+};
+
+class Ticker {
+public:
+    Ticker() : event(host::timer_new()) {}
+    ~Ticker() { host::timer_delete(event); }
+    void attach(Callback<void()> func, std::chrono::microseconds t) {
+        host::timer_start(event, func, t.count(), t.count());
+    }
+    void attach_us(Callback<void()> func, uint64_t t) { host::timer_start(event, func, t, t); }
+    void detach(void) { host::timer_stop(event); }
+
+private:
+    host::TimerEvent* event;
+};
+
+} //namespace mbed
+
+/*-------------------------------------------Events---------------------------------------------------------*/
+//EventQueue: calls deferred to the thread that dispatches the queue, now, later or periodically
+namespace events {
+
+#define EVENTS_EVENT_SIZE (sizeof(mbed::Callback<void()>) + 4 * sizeof(void*)) //RAM of one pending call
+#define EVENTS_QUEUE_SIZE (32 * EVENTS_EVENT_SIZE)
+
+class EventQueue;
+
+template <typename Signature>
+class Event;
+
+template <>
+class Event<void()> {                //queue.event(f): posts f to the queue each time it is called, e.g. from an ISR
+public:
+    Event(EventQueue* queue, mbed::Callback<void()> f) : queue(queue), f(f) {}
+    int post(void) const;
+    int call(void) const { return post(); }
+    void operator()(void) const { post(); }
+
+private:
+    EventQueue* queue;
+    mbed::Callback<void()> f;
+};
+
+class EventQueue {
+public:
+    EventQueue(unsigned size = EVENTS_QUEUE_SIZE, unsigned char* buffer = nullptr);
+    ~EventQueue();
+    EventQueue(const EventQueue&) = delete;
+
+    template <typename F, typename... Args>
+    int call(F f, Args... args) { return post(bind(f, args...), 0, 0); }
+    template <typename F, typename... Args>
+    int call_in(std::chrono::milliseconds ms, F f, Args... args) { return post(bind(f, args...), ms.count(), 0); }
+    template <typename F, typename... Args>
+    int call_every(std::chrono::milliseconds ms, F f, Args... args) {
+        return post(bind(f, args...), ms.count(), ms.count());
+    }
+    template <typename F, typename... Args>
+    Event<void()> event(F f, Args... args) { return Event<void()>(this, bind(f, args...)); }
+
+    bool cancel(int id);
+    void dispatch_forever(void);
+    void dispatch_for(std::chrono::milliseconds ms);
+    void break_dispatch(void);
+    int post(mbed::Callback<void()> f, uint64_t delay_ms, uint64_t period_ms); //id, 0 if the queue is full
+
+private:
+    template <typename F, typename... Args>
+    static mbed::Callback<void()> bind(F f, Args... args) { return [=]() { std::invoke(f, args...); }; }
+    void dispatch(uint64_t end_us);
+
+    struct Entry;
+    Entry* entries;
+    unsigned capacity;
+    int next_id;
+    uint32_t sequence;                //calls due at the same time run in the order they were posted
+    bool broken;
+    host::WaitQueue dispatchers;
+};
+
+inline int Event<void()>::post(void) const { return queue->post(f, 0, 0); }
+
+} //namespace events
+
+using namespace mbed;
+using namespace rtos;
+using namespace events;
+using namespace std::chrono_literals;
+
+//The program's main() runs as the "main" thread of the emulated RTOS, started by the real main() of the host
+#define main mbed_app_main
+int mbed_app_main(void);
+
+#endif
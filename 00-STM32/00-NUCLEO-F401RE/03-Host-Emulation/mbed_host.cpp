@@ -0,0 +1,1706 @@
+/*The host side of "mbed.h": a small RTOS kernel on top of POSIX threads, plus models of the board's peripherals.
+
+Kernel: every mbed Thread is a std::thread, but only the one holding the CPU (running) may execute; the others wait
+on their own condition variable. All kernel state is protected by one lock, which is also what __disable_irq() and
+CriticalSectionLock take. The scheduling rules are those of RTX: the highest priority ready thread runs, a thread
+that is preempted goes back to the head of its priority, and threads of equal priority share the CPU in 5 ms slices.
+A context switch only happens when a thread calls the kernel (any RTOS object, driver or wait), so a thread that
+spins without any call keeps its host core after its slice: it is still given the round-robin turn, but runs on in
+parallel. Programs whose threads block (sleep, wait for flags, semaphores...) behave exactly like on the board.
+
+Interrupts: the process main thread is the interrupt controller. It fires the timers (Ticker, Timeout, thread
+timeouts and host_at() events) as interrupts, holding the kernel lock, and keeps the round-robin slices. Hook threads
+and the terminal reader also raise their interrupts under the lock. Every interrupt wakes the threads sleeping in
+__WFI().
+
+Virtual time (HOST_VIRTUAL=1): the clock is a counter that only the program moves. Every kernel call of a thread costs
+CALL_COST_NS, a busy wait costs its length, and when no thread is ready the clock jumps straight to the next timer. The
+interrupts are then run by the thread that moved the clock, at the same point of the program every time, so a run
+(and the order of the threads in it) repeats exactly, and hours of sleeping take no time at all. Only a thread that
+spins without kernel calls needs the interrupt thread: after STALL_US without progress it is given the time up to
+the end of its slice or the next timer. */
+
+#include "mbed.h"
+#include "host_hooks.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdlib>
+#include <list>
+#include <map>
+#include <mutex>
+#include <signal.h>
+#include <termios.h>
+#include <thread>
+#include <vector>
+
+#undef main
+
+#define SLICE_US        5000    //round-robin time slice of RTX in Mbed OS (5 ticks)
+#define SPIN_LIMIT_US   200     //shorter wait_us() are busy waits, longer ones sleep on the host
+#define CONSOLE_RX_SIZE 1024    //like drivers.uart-serial-rxbuf-size
+#define LCD_DUMP_US     20000   //the LCD is printed when the writes pause, not after every character
+#define LCD_DUMP_MAX_US 100000
+#define CALL_COST_NS    1000    //virtual time: cost of one kernel call, about an RTX call at 84 MHz
+#define STALL_US        100     //virtual time: wall time without progress after which a thread counts as spinning
+
+namespace host {
+
+struct TimerEvent {
+    mbed::Callback<void()> action;
+    uint64_t when;
+    uint64_t period;                                   //0: one shot
+    bool armed;
+    bool kernel_owned;                                 //host_at() events are deleted after they fire
+    std::multimap<uint64_t, TimerEvent*>::iterator pos;
+};
+
+struct HostThread {
+    const char* name;
+    int priority, base_priority;                       //base: without priority inheritance
+    osThreadState_t state;
+    std::condition_variable_any cv;                    //signalled when the thread gets the CPU
+    mbed::Callback<void()> task;
+    TimerEvent timeout;
+    bool timed_out;
+    WaitQueue* waiting_on;
+    HostThread* next_waiter;
+    void* wait_ptr;                                    //message or block handed over by a Queue or MemoryPool
+    uint32_t flags;                                    //thread flags
+    bool in_flags_wait;
+    uint32_t wait_flags, wait_options, wait_result;
+    WaitQueue joiners;
+    bool terminating;
+    bool wants_cpu;                                    //waiting for the CPU in wait_cpu(), not spinning on
+    uint64_t slice_start;
+};
+
+struct ThreadExit {};                                  //thrown in a thread that is terminated, caught by its start
+
+typedef mbed::Callback<void(PinName, int)> pin_observer_t;
+typedef mbed::Callback<void(PinName, float, float)> pwm_observer_t;
+
+struct Lcd {                                           //HD44780 behind a 74HC595: E = 0x08, RS = 0x04, D7-D4 on top
+    uint8_t ddram[128];
+    uint8_t addr;
+    uint8_t last_byte;
+    bool second_nibble;
+    uint8_t first_nibble;
+    TimerEvent dump_timer;
+    uint64_t first_change;                             //of the changes not printed yet
+    char printed[4][21];
+};
+
+struct KernelState {
+    std::recursive_mutex lock;
+    std::condition_variable_any irq_cv;                //wakes the interrupt thread: a new timer or a stop
+    std::chrono::steady_clock::time_point start;
+    HostThread* running = nullptr;
+    std::list<HostThread*> ready;                      //highest priority first, FIFO among equals
+    std::multimap<uint64_t, TimerEvent*> timers;
+    WaitQueue wfi;
+    uint64_t run_for = NEVER;
+
+    bool virtual_time = false;
+    std::atomic<uint64_t> virtual_ns{0};
+    uint64_t kernel_calls = 0;                         //a sign of life of the threads, for the stall check
+    int failed_checks = 0;                             //host_check(), the exit code becomes 1
+
+    int trace = 0;                                     //1: outputs, 2: also every context switch
+    bool show_lcd = true;
+    int level[PIN_COUNT];
+    bool driven[PIN_COUNT];                            //set by the host, the pull resistor no longer decides
+    float analog[PIN_COUNT];
+    std::vector<mbed::InterruptIn*> irq_pins[PIN_COUNT];
+    std::vector<pin_observer_t> pin_observers;
+    std::vector<pwm_observer_t> pwm_observers;
+    mbed::Callback<int(int)> spi_device;
+    Lcd lcd;
+
+    char rx[CONSOLE_RX_SIZE];
+    uint32_t rx_first = 0, rx_used = 0;
+    WaitQueue rx_waiters;
+    mbed::Callback<void()> rx_sigio;
+    bool console_input = false;
+    bool raw_terminal = false;
+    struct termios saved_terminal;
+
+    KernelState() {
+        start = std::chrono::steady_clock::now();
+        for (int p = 0; p < PIN_COUNT; p++) {
+            level[p] = 1;                              //buttons are active low, released by default
+            driven[p] = false;
+            analog[p] = 0.5f;
+        }
+        memset(lcd.ddram, ' ', sizeof(lcd.ddram));
+        memset(lcd.printed, ' ', sizeof(lcd.printed));
+        for (int row = 0; row < 4; row++) lcd.printed[row][20] = 0;
+        lcd.addr = 0;
+        lcd.last_byte = 0;
+        lcd.second_nibble = false;
+        lcd.dump_timer.armed = false;
+        lcd.dump_timer.kernel_owned = false;
+
+        const char* env = getenv("HOST_TRACE");
+        trace = env ? atoi(env) : 0;
+        env = getenv("HOST_LCD");
+        show_lcd = !env || atoi(env);
+        env = getenv("HOST_RUN_FOR");
+        if (env) run_for = (uint64_t)(atof(env) * 1e6);
+        env = getenv("HOST_VIRTUAL");
+        virtual_time = env && atoi(env);
+    }
+};
+
+static KernelState& K(void) { //Built on first use, so global constructors of the program can already use it
+    static KernelState* kernel = new KernelState();
+    return *kernel;
+}
+
+static thread_local HostThread* self = nullptr;        //the mbed thread this host thread runs, if any
+static thread_local int lock_depth = 0;
+static thread_local int isr_depth = 0;
+
+/*-------------------------------------------Time-----------------------------------------------------------*/
+static uint64_t now_ns(void) {
+    if (K().virtual_time) return K().virtual_ns;
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                                          K().start).count();
+}
+
+uint64_t now_us(void) {
+    return now_ns() / 1000;
+}
+
+uint64_t deadline_ms(uint32_t ms) {
+    if (ms == osWaitForever) return NEVER;
+    return now_us() + (uint64_t)ms * 1000;
+}
+
+static void trace(const char* format, ...) {
+    if (!K().trace) return;
+    char line[160];
+    int len = snprintf(line, sizeof(line), "[%12.6f] ", now_us() / 1e6);
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line + len, sizeof(line) - len, format, args);
+    va_end(args);
+    fprintf(stderr, "%s\n", line);
+}
+
+/*-------------------------------------------Scheduler------------------------------------------------------*/
+HostThread* current(void) {
+    return isr_depth ? nullptr : self;
+}
+
+static void insert_ready(HostThread* t, bool at_head) {
+    std::list<HostThread*>& ready = K().ready;
+    auto it = ready.begin();
+    while (it != ready.end() && ((*it)->priority > t->priority || (!at_head && (*it)->priority == t->priority))) it++;
+    ready.insert(it, t);
+    t->state = osThreadReady;
+}
+
+static void switch_to(HostThread* t) {
+    KernelState& k = K();
+    k.running = t;
+    t->state = osThreadRunning;
+    t->slice_start = now_us();
+    t->cv.notify_one();
+    if (k.trace >= 2) trace("run %s", t->name);
+    if (!k.virtual_time) k.irq_cv.notify_one(); //the time slice of the new thread has to be watched
+}
+
+static void dispatch(void) { //The CPU is free: the first ready thread gets it
+    KernelState& k = K();
+    if (k.running != nullptr || k.ready.empty()) return;
+    HostThread* t = k.ready.front();
+    k.ready.pop_front();
+    switch_to(t);
+}
+
+static void make_ready(HostThread* t) {
+    KernelState& k = K();
+    if (k.running != nullptr && t->priority > k.running->priority) {
+        insert_ready(k.running, true); //preempted: first of its priority
+        switch_to(t);
+        return;
+    }
+    insert_ready(t, false);
+    dispatch();
+}
+
+static void wait_cpu(HostThread* t) { //Blocks the host thread until the mbed thread gets the CPU
+    KernelState& k = K();
+    t->wants_cpu = true;
+    while (k.running != t) t->cv.wait(k.lock);
+    t->wants_cpu = false;
+}
+
+static bool slice_shared(HostThread* t) { //Another thread of the same priority waits for the CPU
+    for (HostThread* other : K().ready) {
+        if (other->priority < t->priority) break;
+        if (other->priority == t->priority && (other->wants_cpu || !K().virtual_time)) return true;
+    }
+    return false;
+}
+
+static void rotate(HostThread* t) { //Round robin: t used up its slice and goes behind the others of its priority
+    KernelState& k = K();
+    k.running = nullptr;
+    insert_ready(t, false);
+    dispatch();
+}
+
+static void idle_advance(void);
+static void advance_to(uint64_t target);
+
+static void set_priority(HostThread* t, int priority);
+
+static void enqueue(WaitQueue& queue, HostThread* t) { //By priority, FIFO among equals
+    HostThread** link = &queue.first;
+    while (*link != nullptr && (*link)->priority >= t->priority) link = &(*link)->next_waiter;
+    t->next_waiter = *link;
+    *link = t;
+    t->waiting_on = &queue;
+}
+
+static void unlink(HostThread* t) {
+    HostThread** link = &t->waiting_on->first;
+    while (*link != t) link = &(*link)->next_waiter;
+    *link = t->next_waiter;
+    t->waiting_on = nullptr;
+    t->next_waiter = nullptr;
+}
+
+static void timer_arm(TimerEvent* timer, uint64_t when);
+static void timer_disarm(TimerEvent* timer);
+
+static void wake(HostThread* t, bool timed_out) {
+    if (t->state != osThreadBlocked) return;
+    if (t->waiting_on) unlink(t);
+    timer_disarm(&t->timeout);
+    t->timed_out = timed_out;
+    t->in_flags_wait = false;
+    make_ready(t);
+}
+
+static bool block(HostThread* t, uint64_t deadline) { //t is running and holds the lock once; false: timed out
+    if (lock_depth != 1) host_assert_failed("no blocking call in a critical section", __FILE__, __LINE__);
+    KernelState& k = K();
+    t->state = osThreadBlocked;
+    t->timed_out = false;
+    if (deadline != NEVER) timer_arm(&t->timeout, deadline);
+    k.running = nullptr;
+    dispatch();
+    idle_advance();
+    wait_cpu(t);
+    if (t->terminating) throw ThreadExit();
+    return !t->timed_out;
+}
+
+static bool sleep_until_us(uint64_t deadline) {
+    HostThread* t = current();
+    if (t == nullptr || deadline <= now_us()) return false;
+    return block(t, deadline);
+}
+
+bool block_on(WaitQueue& queue, uint64_t deadline) {
+    HostThread* t = current();
+    if (t == nullptr || deadline <= now_us()) return false; //interrupts never wait
+    enqueue(queue, t);
+    return block(t, deadline);
+}
+
+HostThread* wake_one(WaitQueue& queue) {
+    HostThread* t = queue.first;
+    if (t != nullptr) wake(t, false);
+    return t;
+}
+
+void wake_all(WaitQueue& queue) {
+    while (queue.first != nullptr) wake(queue.first, false);
+}
+
+static void set_priority(HostThread* t, int priority) {
+    KernelState& k = K();
+    t->priority = priority;
+    if (t->state == osThreadReady) {
+        k.ready.remove(t);
+        make_ready(t);
+    } else if (t->waiting_on != nullptr) {
+        WaitQueue* queue = t->waiting_on;
+        unlink(t);
+        enqueue(*queue, t);
+    }
+}
+
+void critical_enter(void) {
+    KernelState& k = K();
+    k.lock.lock();
+    if (++lock_depth == 1 && self != nullptr && isr_depth == 0) {
+        k.kernel_calls++;
+        if (k.running != self) wait_cpu(self); //preempted, or our slice went to another thread
+        if (k.virtual_time) {
+            advance_to(k.virtual_ns + CALL_COST_NS); //interrupts due meanwhile run now, and may preempt us
+            if (k.running == self && slice_shared(self) && now_us() - self->slice_start >= SLICE_US) rotate(self);
+            if (k.running != self) wait_cpu(self);
+        }
+        if (self->terminating && std::uncaught_exceptions() == 0) {
+            lock_depth--;
+            k.lock.unlock();
+            throw ThreadExit();
+        }
+    }
+}
+
+void critical_exit(void) {
+    KernelState& k = K();
+    if (lock_depth == 1 && self != nullptr && isr_depth == 0) {
+        HostThread* t = self;
+        if (k.running == t && !k.ready.empty() && k.ready.front()->priority > t->priority) {
+            k.running = nullptr; //e.g. after lowering its own priority
+            insert_ready(t, true);
+            dispatch();
+        }
+        if (t->state != osThreadTerminated) wait_cpu(t);
+    }
+    lock_depth--;
+    k.lock.unlock();
+}
+
+Lock::Lock() {
+    critical_enter();
+}
+
+Lock::~Lock() {
+    critical_exit();
+}
+
+void wfi(void) { //Sleeps until the next interrupt
+    Lock lock;
+    block_on(K().wfi, NEVER);
+}
+
+static void run_isr(const mbed::Callback<void()>& handler) { //Under the lock
+    isr_depth++;
+    if (handler) handler();
+    isr_depth--;
+    wake_all(K().wfi);
+}
+
+/*-------------------------------------------Threads--------------------------------------------------------*/
+static void thread_exit(HostThread* t) { //The task returned or was terminated
+    KernelState& k = K();
+    k.lock.lock();
+    lock_depth = 1;
+    if (k.running == t) {
+        k.running = nullptr;
+    } else {
+        k.ready.remove(t); //a spinning thread that ended while another one had the CPU
+    }
+    if (t->waiting_on) unlink(t);
+    timer_disarm(&t->timeout);
+    wake_all(t->joiners);
+    t->state = osThreadTerminated;
+    dispatch();
+    lock_depth = 0;
+    k.lock.unlock();
+}
+
+static void thread_start(HostThread* t) {
+    KernelState& k = K();
+    self = t;
+    k.lock.lock();
+    lock_depth = 1;
+    wait_cpu(t);
+    bool terminated = t->terminating;
+    lock_depth = 0;
+    k.lock.unlock();
+
+    if (!terminated) {
+        try {
+            t->task();
+        } catch (ThreadExit&) {
+        }
+    }
+    thread_exit(t);
+}
+
+static HostThread* spawn(const char* name, int priority, mbed::Callback<void()> task) { //Under the lock
+    HostThread* t = new HostThread();
+    t->name = name;
+    t->priority = t->base_priority = priority;
+    t->state = osThreadInactive;
+    t->task = task;
+    t->timeout.armed = false;
+    t->timeout.kernel_owned = false;
+    t->timeout.action = [t]() { wake(t, true); };
+    t->timed_out = false;
+    t->waiting_on = nullptr;
+    t->next_waiter = nullptr;
+    t->flags = 0;
+    t->in_flags_wait = false;
+    t->terminating = false;
+    t->wants_cpu = true;
+    std::thread(thread_start, t).detach();
+    make_ready(t);
+    return t;
+}
+
+/*-------------------------------------------Timers---------------------------------------------------------*/
+static void timer_arm(TimerEvent* timer, uint64_t when) {
+    KernelState& k = K();
+    timer_disarm(timer);
+    timer->when = when;
+    timer->pos = k.timers.insert(std::make_pair(when, timer)); //after the ones due at the same time
+    timer->armed = true;
+    if (timer->pos == k.timers.begin() && !k.virtual_time) k.irq_cv.notify_one();
+}
+
+static void timer_disarm(TimerEvent* timer) {
+    if (!timer->armed) return;
+    K().timers.erase(timer->pos);
+    timer->armed = false;
+}
+
+TimerEvent* timer_new(void) {
+    TimerEvent* timer = new TimerEvent();
+    timer->armed = false;
+    timer->kernel_owned = false;
+    return timer;
+}
+
+void timer_start(TimerEvent* timer, mbed::Callback<void()> action, uint64_t delay_us, uint64_t period_us) {
+    Lock lock;
+    timer->action = action;
+    timer->period = period_us;
+    timer_arm(timer, now_us() + delay_us);
+}
+
+void timer_stop(TimerEvent* timer) {
+    Lock lock;
+    timer_disarm(timer);
+}
+
+void timer_delete(TimerEvent* timer) {
+    Lock lock;
+    timer_disarm(timer);
+    delete timer;
+}
+
+static void fire_timers(uint64_t now) {
+    KernelState& k = K();
+    while (!k.timers.empty() && k.timers.begin()->first <= now) {
+        TimerEvent* timer = k.timers.begin()->second;
+        k.timers.erase(k.timers.begin());
+        timer->armed = false;
+        mbed::Callback<void()> action = timer->action; //the handler may attach it again, or delete it
+        if (timer->period) timer_arm(timer, timer->when + timer->period);
+        bool owned = timer->kernel_owned;
+        run_isr(action);
+        if (owned) delete timer;
+    }
+}
+
+[[noreturn]] static void stop(int code) {
+    KernelState& k = K();
+    fflush(stdout);
+    if (k.virtual_time) {
+        double simulated = k.virtual_ns / 1e9;
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - k.start).count();
+        fprintf(stderr, "\nSimulated %.3f s in %.3f s of real time: %.0f times faster\n", simulated, wall,
+                simulated / wall);
+    }
+    if (k.failed_checks) {
+        fprintf(stderr, "%d check(s) failed\n", k.failed_checks);
+        if (code == 0) code = 1;
+    }
+    fflush(stderr);
+    if (k.raw_terminal) tcsetattr(STDIN_FILENO, TCSANOW, &k.saved_terminal);
+    _exit(code);
+}
+
+/*-------------------------------------------Virtual time---------------------------------------------------*/
+static uint64_t run_for_ns(void) {
+    uint64_t run_for = K().run_for;
+    return run_for == NEVER ? NEVER : run_for * 1000;
+}
+
+static void advance_to(uint64_t target) { //Moves the clock to target (ns), running the timers due on the way
+    KernelState& k = K();
+    uint64_t end = std::min(target, run_for_ns());
+    while (!k.timers.empty() && k.timers.begin()->first * 1000 <= end) {
+        uint64_t due = k.timers.begin()->first;
+        if (due * 1000 > k.virtual_ns) k.virtual_ns = due * 1000;
+        fire_timers(due);
+    }
+    if (end > k.virtual_ns) k.virtual_ns = end;
+    if (k.virtual_ns >= run_for_ns()) stop(0);
+}
+
+static void idle_advance(void) { //No thread is ready: the clock jumps to the next timer, in the thread that went idle
+    KernelState& k = K();
+    while (k.virtual_time && k.running == nullptr && k.ready.empty()) {
+        if (!k.timers.empty()) advance_to(k.timers.begin()->first * 1000);
+        else if (k.run_for != NEVER) advance_to(run_for_ns());
+        else return; //only input from outside can change something now
+    }
+}
+
+static void busy_wait(uint64_t ns) { //wait_us() in virtual time: the clock moves, the thread keeps the CPU
+    KernelState& k = K();
+    Lock lock;
+    HostThread* t = current();
+    if (t == nullptr) { //in an interrupt, nothing else can run meanwhile
+        k.virtual_ns += ns;
+        return;
+    }
+    uint64_t end = now_ns() + ns;
+    while (now_ns() < end) {
+        uint64_t step = end;
+        if (!k.timers.empty()) step = std::min(step, k.timers.begin()->first * 1000);
+        if (slice_shared(t)) step = std::min(step, (t->slice_start + SLICE_US) * 1000);
+        advance_to(std::max(step, now_ns()));
+        if (k.running == t && slice_shared(t) && now_us() - t->slice_start >= SLICE_US) rotate(t);
+        if (k.running != t) wait_cpu(t);
+    }
+}
+
+static void virtual_loop(void) { //Only steps in when the clock stands still: a thread spinning without kernel calls
+    KernelState& k = K();
+    uint64_t calls = k.kernel_calls;
+    uint64_t clock = k.virtual_ns;
+    while (true) {
+        k.irq_cv.wait_for(k.lock, std::chrono::microseconds(STALL_US));
+        if (k.kernel_calls == calls && k.virtual_ns == clock) {
+            HostThread* t = k.running;
+            if (t == nullptr) {
+                idle_advance();
+            } else { //it is given a slice, up to the next timer: other spinning threads may be about to call
+                uint64_t target = now_ns() + SLICE_US * 1000;
+                if (!k.timers.empty()) target = std::min(target, k.timers.begin()->first * 1000);
+                if (slice_shared(t)) target = std::min(target, (t->slice_start + SLICE_US) * 1000);
+                advance_to(std::max(target, now_ns()));
+                if (k.running == t && slice_shared(t) && now_us() - t->slice_start >= SLICE_US) rotate(t);
+            }
+        }
+        calls = k.kernel_calls;
+        clock = k.virtual_ns;
+    }
+}
+
+static void interrupt_loop(void) { //The process main thread, from main()
+    KernelState& k = K();
+    k.lock.lock();
+    lock_depth = 1;
+    if (k.virtual_time) {
+        idle_advance();
+        virtual_loop();
+    }
+    while (true) {
+        uint64_t now = now_us();
+        if (now >= k.run_for) stop(0);
+        fire_timers(now);
+
+        //Round robin: a thread that used up its slice goes behind the others of its priority
+        uint64_t next = k.run_for;
+        HostThread* t = k.running;
+        if (t != nullptr && !k.ready.empty() && k.ready.front()->priority == t->priority) {
+            if (now - t->slice_start >= SLICE_US) {
+                rotate(t);
+                t = k.running;
+            }
+            next = std::min(next, t->slice_start + SLICE_US);
+        }
+        if (!k.timers.empty()) next = std::min(next, k.timers.begin()->first);
+
+        if (next == NEVER) {
+            k.irq_cv.wait(k.lock);
+        } else {
+            k.irq_cv.wait_until(k.lock, k.start + std::chrono::microseconds(next));
+        }
+    }
+}
+
+} //namespace host
+
+using namespace host;
+
+/*-------------------------------------------CMSIS-RTOS-----------------------------------------------------*/
+static uint32_t flags_check(uint32_t* flags, uint32_t wanted, uint32_t options, bool* done) {
+    uint32_t match = *flags & wanted;
+    *done = (options & osFlagsWaitAll) ? match == wanted : match != 0;
+    uint32_t before = *flags;
+    if (*done && !(options & osFlagsNoClear)) *flags &= ~match;
+    return before;
+}
+
+static uint32_t flags_wait(uint32_t wanted, uint32_t options, uint64_t deadline) { //Thread flags of the caller
+    Lock lock;
+    HostThread* t = current();
+    if (t == nullptr) return osFlagsErrorResource;
+    bool done;
+    uint32_t result = flags_check(&t->flags, wanted, options, &done);
+    if (done) return result;
+    t->wait_flags = wanted;
+    t->wait_options = options;
+    t->in_flags_wait = true;
+    if (!sleep_until_us(deadline)) {
+        t->in_flags_wait = false;
+        return osFlagsErrorTimeout;
+    }
+    return t->wait_result;
+}
+
+uint32_t osThreadFlagsSet(osThreadId_t thread_id, uint32_t flags) {
+    Lock lock;
+    HostThread* t = (HostThread*)thread_id;
+    if (t == nullptr || t->state == osThreadTerminated) return osFlagsErrorResource;
+    t->flags |= flags;
+    uint32_t result = t->flags;
+    if (t->in_flags_wait) {
+        bool done;
+        uint32_t before = flags_check(&t->flags, t->wait_flags, t->wait_options, &done);
+        if (done) {
+            t->wait_result = before;
+            wake(t, false);
+        }
+    }
+    return result;
+}
+
+osThreadId_t osThreadGetId(void) {
+    return (osThreadId_t)current();
+}
+
+const char* osThreadGetName(osThreadId_t thread_id) {
+    return thread_id ? ((HostThread*)thread_id)->name : nullptr;
+}
+
+osPriority_t osThreadGetPriority(osThreadId_t thread_id) {
+    return thread_id ? (osPriority_t)((HostThread*)thread_id)->priority : osPriorityError;
+}
+
+osThreadState_t osThreadGetState(osThreadId_t thread_id) {
+    return thread_id ? ((HostThread*)thread_id)->state : osThreadError;
+}
+
+/*-------------------------------------------Platform-------------------------------------------------------*/
+DWT_Type host_dwt;
+CoreDebug_Type host_core_debug;
+uint32_t SystemCoreClock = 84000000;
+static uint32_t cycle_offset = 0;
+
+static uint32_t cycles_now(void) {
+    return (uint32_t)(now_ns() * (SystemCoreClock / 1000000) / 1000);
+}
+
+host_cyccnt_t::operator uint32_t() const {
+    return cycles_now() + cycle_offset;
+}
+
+host_cyccnt_t& host_cyccnt_t::operator=(uint32_t value) {
+    cycle_offset = value - cycles_now();
+    return *this;
+}
+
+extern "C" __attribute__((weak)) void mbed_error_hook(const mbed_error_ctx*) {
+}
+
+void host_assert_failed(const char* expr, const char* file, int line) {
+    fprintf(stderr, "\nMbed assertion failed: %s, file: %s, line %d\n", expr, file, line);
+    mbed_error_ctx context = {-1};
+    mbed_error_hook(&context);
+    stop(134);
+}
+
+void error(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    mbed_error_ctx context = {-1};
+    mbed_error_hook(&context);
+    stop(134);
+}
+
+void mbed_error_printf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+bool core_util_is_isr_active(void) {
+    return isr_depth > 0;
+}
+
+uint32_t us_ticker_read(void) {
+    return (uint32_t)now_us();
+}
+
+void wait_us(int us) { //A busy wait on the board: the thread keeps the CPU, only interrupts run meanwhile
+    if (K().virtual_time) {
+        busy_wait((uint64_t)us * 1000);
+        return;
+    }
+    if (current() != nullptr) Lock lock; //but it is a point where a higher priority thread takes over
+    uint64_t end = now_us() + us;
+    if (us >= SPIN_LIMIT_US) std::this_thread::sleep_for(std::chrono::microseconds(us));
+    while (now_us() < end) {
+    }
+}
+
+void wait_ns(unsigned int ns) {
+    if (K().virtual_time) {
+        busy_wait(ns);
+        return;
+    }
+    uint64_t end = now_ns() + ns;
+    while (now_ns() < end) {
+    }
+}
+
+void thread_sleep_for(uint32_t millisec) {
+    ThisThread::sleep_for(millisec);
+}
+
+void rtos_attach_idle_hook(void (*hook)(void)) { //There is no idle thread: the host sleeps when nothing is ready
+    (void)hook;
+}
+
+/*-------------------------------------------RTOS-----------------------------------------------------------*/
+namespace rtos {
+
+void Mutex::lock(void) {
+    trylock_for(Kernel::wait_for_u32_forever);
+}
+
+bool Mutex::trylock(void) {
+    return trylock_for(Kernel::Clock::duration_u32(0));
+}
+
+bool Mutex::trylock_for(Kernel::Clock::duration_u32 rel_time) {
+    Lock lock;
+    HostThread* t = current();
+    if (t == nullptr) return false;
+    if (owner == nullptr) {
+        owner = t;
+        count = 1;
+        return true;
+    }
+    if (owner == t) {
+        count++;
+        return true;
+    }
+    uint64_t deadline = deadline_ms(rel_time.count());
+    if (deadline <= now_us()) return false;
+    if (t->priority > owner->priority) set_priority(owner, t->priority); //priority inheritance
+    return block_on(waiters, deadline); //true: unlock() handed the mutex over
+}
+
+void Mutex::unlock(void) {
+    Lock lock;
+    if (owner == nullptr || owner != current() || --count > 0) return;
+    HostThread* previous = owner;
+    owner = wake_one(waiters);
+    if (owner != nullptr) {
+        count = 1;
+        if (waiters.first != nullptr && waiters.first->priority > owner->priority) {
+            set_priority(owner, waiters.first->priority);
+        }
+    }
+    if (previous->priority != previous->base_priority) set_priority(previous, previous->base_priority);
+}
+
+osThreadId_t Mutex::get_owner(void) {
+    return (osThreadId_t)owner;
+}
+
+void Semaphore::acquire(void) {
+    Lock lock;
+    if (tokens > 0) tokens--;
+    else block_on(waiters, NEVER);
+}
+
+bool Semaphore::try_acquire(void) {
+    Lock lock;
+    if (tokens == 0) return false;
+    tokens--;
+    return true;
+}
+
+bool Semaphore::try_acquire_for(Kernel::Clock::duration_u32 rel_time) {
+    Lock lock;
+    if (tokens > 0) {
+        tokens--;
+        return true;
+    }
+    return block_on(waiters, deadline_ms(rel_time.count())); //true: release() handed its token over
+}
+
+osStatus Semaphore::release(void) {
+    Lock lock;
+    if (wake_one(waiters) != nullptr) return osOK;
+    if (tokens >= max_count) return osErrorResource;
+    tokens++;
+    return osOK;
+}
+
+uint32_t EventFlags::set(uint32_t flags) {
+    Lock lock;
+    this->flags |= flags;
+    uint32_t result = this->flags;
+    HostThread* t = waiters.first;
+    while (t != nullptr) {
+        HostThread* next = t->next_waiter;
+        bool done;
+        uint32_t before = flags_check(&this->flags, t->wait_flags, t->wait_options, &done);
+        if (done) {
+            t->wait_result = before;
+            wake(t, false);
+        }
+        t = next;
+    }
+    return result;
+}
+
+uint32_t EventFlags::clear(uint32_t flags) {
+    Lock lock;
+    uint32_t before = this->flags;
+    this->flags &= ~flags;
+    return before;
+}
+
+uint32_t EventFlags::wait(uint32_t wanted, uint32_t options, uint64_t deadline) {
+    Lock lock;
+    bool done;
+    uint32_t result = flags_check(&flags, wanted, options, &done);
+    if (done) return result;
+    HostThread* t = current();
+    if (t == nullptr) return osFlagsErrorResource;
+    t->wait_flags = wanted;
+    t->wait_options = options;
+    if (!block_on(waiters, deadline)) return osFlagsErrorTimeout;
+    return t->wait_result;
+}
+
+uint32_t EventFlags::wait_all(uint32_t flags, uint32_t millisec, bool clear) {
+    return wait(flags, osFlagsWaitAll | (clear ? 0 : osFlagsNoClear), deadline_ms(millisec));
+}
+
+uint32_t EventFlags::wait_any(uint32_t flags, uint32_t millisec, bool clear) {
+    return wait(flags, osFlagsWaitAny | (clear ? 0 : osFlagsNoClear), deadline_ms(millisec));
+}
+
+uint32_t EventFlags::wait_all_for(uint32_t flags, Kernel::Clock::duration_u32 rel_time, bool clear) {
+    return wait_all(flags, rel_time.count(), clear);
+}
+
+uint32_t EventFlags::wait_any_for(uint32_t flags, Kernel::Clock::duration_u32 rel_time, bool clear) {
+    return wait_any(flags, rel_time.count(), clear);
+}
+
+bool QueueCore::put(void* data, uint64_t deadline) {
+    Lock lock;
+    if (getters.first != nullptr) { //straight to the thread waiting for it
+        getters.first->wait_ptr = data;
+        wake_one(getters);
+        return true;
+    }
+    if (used < size) {
+        slots[(first + used) % size] = data;
+        used++;
+        return true;
+    }
+    HostThread* t = current();
+    if (t == nullptr) return false;
+    t->wait_ptr = data;
+    return block_on(putters, deadline); //true: get() moved the message into the queue
+}
+
+bool QueueCore::get(void** data, uint64_t deadline) {
+    Lock lock;
+    if (used > 0) {
+        *data = slots[first];
+        first = (first + 1) % size;
+        used--;
+        if (putters.first != nullptr) { //the queue was full, the first waiting message takes the free slot
+            slots[(first + used) % size] = putters.first->wait_ptr;
+            used++;
+            wake_one(putters);
+        }
+        return true;
+    }
+    HostThread* t = current();
+    if (t == nullptr || !block_on(getters, deadline)) return false;
+    *data = t->wait_ptr;
+    return true;
+}
+
+PoolCore::PoolCore(void* blocks, size_t block_size, uint32_t count)
+    : blocks((char*)blocks), block_size(block_size), count(count), free_list(nullptr) {
+    for (uint32_t i = count; i > 0; i--) { //first block first
+        void* block = this->blocks + (i - 1) * block_size;
+        *(void**)block = free_list;
+        free_list = block;
+    }
+}
+
+void* PoolCore::alloc(uint64_t deadline) {
+    Lock lock;
+    if (free_list != nullptr) {
+        void* block = free_list;
+        free_list = *(void**)block;
+        return block;
+    }
+    HostThread* t = current();
+    if (t == nullptr || !block_on(waiters, deadline)) return nullptr;
+    return t->wait_ptr;
+}
+
+osStatus PoolCore::free(void* block) {
+    Lock lock;
+    if (block < blocks || block >= blocks + count * block_size) return osErrorParameter;
+    if (waiters.first != nullptr) {
+        waiters.first->wait_ptr = block;
+        wake_one(waiters);
+        return osOK;
+    }
+    *(void**)block = free_list;
+    free_list = block;
+    return osOK;
+}
+
+Thread::Thread(osPriority priority, uint32_t stack_size, unsigned char* stack_mem, const char* name)
+    : thread(nullptr), priority(priority), size(stack_size), name(name) {
+    (void)stack_mem; //each thread gets the stack of a host thread
+}
+
+Thread::~Thread() {
+    if (thread == nullptr) return;
+    Lock lock;
+    if (thread->state == osThreadTerminated) delete thread;
+    else thread->terminating = true; //it ends at its next kernel call, and is left behind
+}
+
+osStatus Thread::start(mbed::Callback<void()> task) {
+    Lock lock;
+    if (thread != nullptr) return osErrorParameter;
+    thread = spawn(name ? name : "application_unnamed_thread", priority, task);
+    return osOK;
+}
+
+osStatus Thread::join(void) {
+    Lock lock;
+    if (thread == nullptr || thread->state == osThreadTerminated) return osOK;
+    if (thread == current()) return osErrorParameter;
+    block_on(thread->joiners, NEVER);
+    return osOK;
+}
+
+osStatus Thread::terminate(void) {
+    Lock lock;
+    if (thread == nullptr || thread->state == osThreadTerminated) return osOK;
+    if (thread == current()) throw ThreadExit();
+    thread->terminating = true;
+    wake(thread, false);
+    host::set_priority(thread, osPriorityISR); //it runs next, only to unwind, so it is gone when this returns
+    return osOK;
+}
+
+osStatus Thread::set_priority(osPriority priority) {
+    Lock lock;
+    this->priority = priority;
+    if (thread == nullptr) return osOK;
+    if (thread->priority == thread->base_priority) host::set_priority(thread, priority); //unless inherited
+    thread->base_priority = priority;
+    return osOK;
+}
+
+osPriority Thread::get_priority(void) const {
+    return thread ? (osPriority)thread->priority : priority;
+}
+
+uint32_t Thread::flags_set(uint32_t flags) {
+    return osThreadFlagsSet(thread, flags);
+}
+
+osThreadState_t Thread::get_state(void) const {
+    return thread ? thread->state : osThreadInactive;
+}
+
+namespace ThisThread {
+
+void sleep_for(uint32_t millisec) {
+    sleep_for(Kernel::Clock::duration_u32(millisec));
+}
+
+void sleep_for(Kernel::Clock::duration_u32 rel_time) {
+    if (current() == nullptr) { //a thread of the hooks file
+        std::this_thread::sleep_for(rel_time);
+        return;
+    }
+    Lock lock;
+    sleep_until_us(deadline_ms(rel_time.count()));
+}
+
+void sleep_until(Kernel::Clock::time_point abs_time) {
+    Lock lock;
+    sleep_until_us((uint64_t)abs_time.time_since_epoch().count() * 1000);
+}
+
+void yield(void) { //Behind the other ready threads of the same priority
+    Lock lock;
+    KernelState& k = K();
+    HostThread* t = current();
+    if (t == nullptr || k.ready.empty() || k.ready.front()->priority < t->priority) return;
+    k.running = nullptr;
+    insert_ready(t, false);
+    dispatch();
+}
+
+osThreadId_t get_id(void) {
+    return osThreadGetId();
+}
+
+const char* get_name(void) {
+    return osThreadGetName(osThreadGetId());
+}
+
+uint32_t flags_get(void) {
+    HostThread* t = current();
+    return t ? t->flags : 0;
+}
+
+uint32_t flags_clear(uint32_t flags) {
+    Lock lock;
+    HostThread* t = current();
+    if (t == nullptr) return osFlagsErrorResource;
+    uint32_t before = t->flags;
+    t->flags &= ~flags;
+    return before;
+}
+
+uint32_t flags_wait_any(uint32_t flags, bool clear) {
+    return flags_wait(flags, osFlagsWaitAny | (clear ? 0 : osFlagsNoClear), NEVER);
+}
+
+uint32_t flags_wait_all(uint32_t flags, bool clear) {
+    return flags_wait(flags, osFlagsWaitAll | (clear ? 0 : osFlagsNoClear), NEVER);
+}
+
+uint32_t flags_wait_any_for(uint32_t flags, Kernel::Clock::duration_u32 rel_time, bool clear) {
+    return flags_wait(flags, osFlagsWaitAny | (clear ? 0 : osFlagsNoClear), deadline_ms(rel_time.count()));
+}
+
+uint32_t flags_wait_all_for(uint32_t flags, Kernel::Clock::duration_u32 rel_time, bool clear) {
+    return flags_wait(flags, osFlagsWaitAll | (clear ? 0 : osFlagsNoClear), deadline_ms(rel_time.count()));
+}
+
+} //namespace ThisThread
+
+} //namespace rtos
+
+/*-------------------------------------------Pins-----------------------------------------------------------*/
+static const struct {
+    PinName pin;
+    const char* name;
+} arduino_names[] = {
+    {D0, "D0"}, {D1, "D1"}, {D2, "D2"}, {D3, "D3"}, {D4, "D4"}, {D5, "D5"}, {D6, "D6"}, {D7, "D7"},
+    {D8, "D8"}, {D9, "D9"}, {D10, "D10"}, {D11, "D11"}, {D12, "D12"}, {D13, "D13"}, {D14, "D14"}, {D15, "D15"},
+    {A0, "A0"}, {A1, "A1"}, {A2, "A2"}, {A3, "A3"}, {A4, "A4"}, {A5, "A5"},
+};
+
+const char* host_pin_name(PinName pin) {
+    static char names[PIN_COUNT][6];
+    if (pin < 0 || pin >= PIN_COUNT) return "NC";
+    for (size_t i = 0; i < sizeof(arduino_names) / sizeof(arduino_names[0]); i++) {
+        if (arduino_names[i].pin == pin) return arduino_names[i].name;
+    }
+    if (names[pin][0] == 0) snprintf(names[pin], sizeof(names[pin]), "P%c_%d", 'A' + pin / 16, pin % 16);
+    return names[pin];
+}
+
+static bool valid(PinName pin) {
+    return pin >= 0 && pin < PIN_COUNT;
+}
+
+static void set_level(PinName pin, int value, bool output) { //Under the lock
+    KernelState& k = K();
+    value = value ? 1 : 0;
+    if (k.level[pin] == value) return;
+    k.level[pin] = value;
+    if (output) {
+        trace("%s = %d", host_pin_name(pin), value);
+        for (auto& observer : k.pin_observers) observer(pin, value);
+    }
+    if (k.irq_pins[pin].empty()) return;
+    isr_depth++;
+    for (mbed::InterruptIn* irq : k.irq_pins[pin]) irq->edge(value);
+    isr_depth--;
+    wake_all(k.wfi);
+}
+
+void host_set_pin(PinName pin, int value) {
+    if (!valid(pin)) return;
+    Lock lock;
+    K().driven[pin] = true;
+    set_level(pin, value, false);
+}
+
+int host_get_pin(PinName pin) {
+    return valid(pin) ? K().level[pin] : 0;
+}
+
+void host_set_analog(PinName pin, float value) {
+    if (!valid(pin)) return;
+    Lock lock;
+    K().analog[pin] = value < 0 ? 0 : value > 1 ? 1 : value;
+}
+
+void host_watch_pins(Callback<void(PinName, int)> observer) {
+    Lock lock;
+    K().pin_observers.push_back(observer);
+}
+
+void host_watch_pwm(Callback<void(PinName, float, float)> observer) {
+    Lock lock;
+    K().pwm_observers.push_back(observer);
+}
+
+static void pull(PinName pin, PinMode mode) { //The pull resistor decides the level until the host drives the pin
+    if (!valid(pin)) return;
+    Lock lock;
+    if (!K().driven[pin]) K().level[pin] = (mode == PullDown) ? 0 : 1;
+}
+
+namespace mbed {
+
+void DigitalOut::write(int value) {
+    if (!valid(pin)) return;
+    Lock lock;
+    set_level(pin, value, true);
+}
+
+int DigitalOut::read(void) {
+    return host_get_pin(pin);
+}
+
+int DigitalIn::read(void) {
+    if (current() != nullptr) Lock lock; //a polling loop is a point where other threads get their turn
+    return host_get_pin(pin);
+}
+
+void DigitalIn::mode(PinMode mode) {
+    pull(pin, mode);
+}
+
+BusIn::BusIn(PinName p0, PinName p1, PinName p2, PinName p3, PinName p4, PinName p5, PinName p6, PinName p7) {
+    PinName list[8] = {p0, p1, p2, p3, p4, p5, p6, p7};
+    memcpy(pins, list, sizeof(pins));
+}
+
+int BusIn::read(void) {
+    if (current() != nullptr) Lock lock;
+    int value = 0;
+    for (int bit = 0; bit < 8; bit++) {
+        if (pins[bit] != NC && host_get_pin(pins[bit])) value |= 1 << bit;
+    }
+    return value;
+}
+
+void BusIn::mode(PinMode mode) {
+    for (int bit = 0; bit < 8; bit++) pull(pins[bit], mode);
+}
+
+InterruptIn::InterruptIn(PinName pin, PinMode mode) : pin(pin), enabled(true) {
+    pull(pin, mode);
+    if (!valid(pin)) return;
+    Lock lock;
+    K().irq_pins[pin].push_back(this);
+}
+
+InterruptIn::~InterruptIn() {
+    if (!valid(pin)) return;
+    Lock lock;
+    std::vector<InterruptIn*>& list = K().irq_pins[pin];
+    list.erase(std::remove(list.begin(), list.end(), this), list.end());
+}
+
+int InterruptIn::read(void) {
+    if (current() != nullptr) Lock lock;
+    return host_get_pin(pin);
+}
+
+void InterruptIn::mode(PinMode mode) {
+    pull(pin, mode);
+}
+
+void InterruptIn::rise(Callback<void()> handler) {
+    Lock lock;
+    rise_handler = handler;
+}
+
+void InterruptIn::fall(Callback<void()> handler) {
+    Lock lock;
+    fall_handler = handler;
+}
+
+float AnalogIn::read(void) {
+    if (current() != nullptr) Lock lock;
+    return valid(pin) ? K().analog[pin] : 0;
+}
+
+unsigned short AnalogIn::read_u16(void) {
+    return (unsigned short)(read() * 65535.0f + 0.5f);
+}
+
+void PwmOut::update(void) {
+    if (!valid(pin)) return;
+    Lock lock;
+    float level = suspended ? 0 : duty;
+    trace("%s PWM %.1f Hz, duty %.3f", host_pin_name(pin), period_s > 0 ? 1 / period_s : 0, level);
+    for (auto& observer : K().pwm_observers) observer(pin, period_s, level);
+}
+
+void PwmOut::write(float value) {
+    duty = value < 0 ? 0 : value > 1 ? 1 : value;
+    update();
+}
+
+void PwmOut::period(float seconds) {
+    period_s = seconds;
+    update();
+}
+
+void PwmOut::suspend(void) {
+    suspended = true;
+    update();
+}
+
+void PwmOut::resume(void) {
+    suspended = false;
+    update();
+}
+
+} //namespace mbed
+
+/*-------------------------------------------LCD------------------------------------------------------------*/
+static const uint8_t lcd_row_address[4] = {0x00, 0x40, 0x14, 0x54};
+
+const char* host_lcd_row(int row) {
+    static char text[4][21];
+    if (row < 0 || row > 3) return "";
+    Lock lock;
+    for (int col = 0; col < 20; col++) {
+        uint8_t c = K().lcd.ddram[lcd_row_address[row] + col];
+        text[row][col] = (c >= 0x20 && c < 0x7F) ? c : '?';
+    }
+    text[row][20] = 0;
+    return text[row];
+}
+
+static void lcd_dump(void) { //Prints the display if it changed since the last time
+    Lcd& lcd = K().lcd;
+    char rows[4][21];
+    for (int row = 0; row < 4; row++) memcpy(rows[row], host_lcd_row(row), 21);
+    if (memcmp(rows, lcd.printed, sizeof(rows)) == 0) return;
+    memcpy(lcd.printed, rows, sizeof(rows));
+    if (!K().show_lcd) return;
+    fprintf(stderr, "LCD at %.3f s\n+--------------------+\n|%s|\n|%s|\n|%s|\n|%s|\n+--------------------+\n",
+            now_us() / 1e6, rows[0], rows[1], rows[2], rows[3]);
+}
+
+static void lcd_changed(void) { //Printed once the writes stop for 20 ms, or after 100 ms of constant writes
+    Lcd& lcd = K().lcd;
+    uint64_t now = now_us();
+    if (!lcd.dump_timer.armed) lcd.first_change = now;
+    lcd.dump_timer.action = lcd_dump;
+    lcd.dump_timer.period = 0;
+    timer_arm(&lcd.dump_timer, std::min(now + LCD_DUMP_US, lcd.first_change + LCD_DUMP_MAX_US));
+}
+
+static void lcd_byte(uint8_t byte) { //In 2-line mode each line holds 40 characters, 0x00-0x27 and 0x40-0x67
+    Lcd& lcd = K().lcd;
+    lcd.ddram[lcd.addr] = byte;
+    lcd.addr++;
+    if (lcd.addr == 0x28) lcd.addr = 0x40;
+    if (lcd.addr == 0x68) lcd.addr = 0x00;
+    lcd_changed();
+}
+
+static void lcd_command(uint8_t command) {
+    Lcd& lcd = K().lcd;
+    if (command == 0x01) { //clear
+        memset(lcd.ddram, ' ', sizeof(lcd.ddram));
+        lcd.addr = 0;
+        lcd_changed();
+    } else if (command & 0x80) { //set DDRAM address
+        lcd.addr = command & 0x7F;
+    } else if ((command & 0xFE) == 0x02) { //return home
+        lcd.addr = 0;
+    }
+}
+
+static int lcd_spi(int value) { //The nibble on D7-D4 and RS are latched when E falls
+    Lcd& lcd = K().lcd;
+    uint8_t byte = (uint8_t)value;
+    if ((lcd.last_byte & 0x08) && !(byte & 0x08)) {
+        uint8_t nibble = lcd.last_byte >> 4;
+        if (!lcd.second_nibble) {
+            lcd.first_nibble = nibble;
+        } else if (lcd.last_byte & 0x04) {
+            lcd_byte((uint8_t)(lcd.first_nibble << 4 | nibble));
+        } else {
+            lcd_command((uint8_t)(lcd.first_nibble << 4 | nibble));
+        }
+        lcd.second_nibble = !lcd.second_nibble;
+    }
+    lcd.last_byte = byte;
+    return 0;
+}
+
+void host_set_spi_device(Callback<int(int)> device) {
+    Lock lock;
+    K().spi_device = device;
+}
+
+namespace mbed {
+
+int SPI::write(int value) {
+    Lock lock;
+    KernelState& k = K();
+    return k.spi_device ? k.spi_device(value) : lcd_spi(value);
+}
+
+int SPI::write(const char* tx_buffer, int tx_length, char* rx_buffer, int rx_length) {
+    int length = std::max(tx_length, rx_length);
+    for (int i = 0; i < length; i++) {
+        int received = write(i < tx_length ? tx_buffer[i] : 0xFF);
+        if (i < rx_length) rx_buffer[i] = (char)received;
+    }
+    return length;
+}
+
+int I2C::read(int address, char* data, int length, bool repeated) {
+    (void)repeated;
+    memset(data, 0, length);
+    trace("I2C read 0x%02X, %d bytes", address, length);
+    return 0;
+}
+
+int I2C::write(int address, const char* data, int length, bool repeated) {
+    (void)repeated;
+    char bytes[64] = "";
+    for (int i = 0, len = 0; i < length && len < (int)sizeof(bytes) - 4; i++) {
+        len += snprintf(bytes + len, sizeof(bytes) - len, " %02X", (uint8_t)data[i]);
+    }
+    trace("I2C write 0x%02X:%s", address, bytes);
+    return 0;
+}
+
+} //namespace mbed
+
+/*-------------------------------------------Console--------------------------------------------------------*/
+static void console_rx(const char* data, size_t length) { //The UART receive interrupt
+    Lock lock;
+    KernelState& k = K();
+    for (size_t i = 0; i < length && k.rx_used < CONSOLE_RX_SIZE; i++) {
+        k.rx[(k.rx_first + k.rx_used) % CONSOLE_RX_SIZE] = data[i];
+        k.rx_used++;
+    }
+    wake_all(k.rx_waiters);
+    run_isr(k.rx_sigio);
+}
+
+void host_serial_input(const char* data, size_t length) {
+    console_rx(data, length);
+}
+
+static void restore_terminal(int signal) {
+    (void)signal;
+    stop(130);
+}
+
+static void console_reader(void) {
+    char buffer[64];
+    ssize_t length;
+    while ((length = read(STDIN_FILENO, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t i = 0; i < length; i++) {
+            if (buffer[i] == '\n') buffer[i] = '\r'; //Enter sends a carriage return, as in a serial terminal
+        }
+        console_rx(buffer, length);
+    }
+}
+
+static void start_console_input(void) { //Keys go to the program one by one, without echo
+    Lock lock;
+    KernelState& k = K();
+    if (k.console_input) return;
+    k.console_input = true;
+    if (isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &k.saved_terminal) == 0) {
+        struct termios raw = k.saved_terminal;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+        k.raw_terminal = true;
+        signal(SIGINT, restore_terminal);
+        signal(SIGTERM, restore_terminal);
+    }
+    std::thread(console_reader).detach();
+}
+
+static ssize_t console_read(void* buffer, size_t size, bool blocking) {
+    start_console_input();
+    Lock lock;
+    KernelState& k = K();
+    while (k.rx_used == 0) {
+        if (!blocking || current() == nullptr) return -EAGAIN;
+        block_on(k.rx_waiters, NEVER);
+    }
+    size_t length = 0;
+    while (length < size && k.rx_used > 0) {
+        ((char*)buffer)[length++] = k.rx[k.rx_first];
+        k.rx_first = (k.rx_first + 1) % CONSOLE_RX_SIZE;
+        k.rx_used--;
+    }
+    return length;
+}
+
+static ssize_t console_write(const void* buffer, size_t size) {
+    if (current() != nullptr) Lock lock;
+    fwrite(buffer, 1, size, stdout);
+    fflush(stdout);
+    return size;
+}
+
+namespace mbed {
+
+BufferedSerial::BufferedSerial(PinName tx, PinName rx, int baud) : blocking(true) {
+    (void)tx;
+    (void)rx;
+    (void)baud;
+    start_console_input();
+}
+
+BufferedSerial::~BufferedSerial() {
+}
+
+ssize_t BufferedSerial::read(void* buffer, size_t size) {
+    return console_read(buffer, size, blocking);
+}
+
+ssize_t BufferedSerial::write(const void* buffer, size_t size) {
+    return console_write(buffer, size);
+}
+
+bool BufferedSerial::readable() const {
+    Lock lock;
+    return K().rx_used > 0;
+}
+
+void BufferedSerial::sigio(Callback<void()> func) {
+    Lock lock;
+    K().rx_sigio = func;
+}
+
+//stdin/stdout/stderr of the program: the same UART, as on the board
+class ConsoleHandle : public FileHandle {
+public:
+    ssize_t read(void* buffer, size_t size) override { return console_read(buffer, size, true); }
+    ssize_t write(const void* buffer, size_t size) override { return console_write(buffer, size); }
+    bool readable() const override {
+        start_console_input();
+        Lock lock;
+        return K().rx_used > 0;
+    }
+};
+
+__attribute__((weak)) FileHandle* mbed_override_console(int fd) {
+    (void)fd;
+    return nullptr;
+}
+
+FileHandle* mbed_file_handle(int fd) {
+    static ConsoleHandle console;
+    FileHandle* handle = mbed_override_console(fd);
+    return handle ? handle : &console;
+}
+
+void Timer::start(void) {
+    if (running) return;
+    start_us = now_us();
+    running = true;
+}
+
+void Timer::stop(void) {
+    if (!running) return;
+    total_us += now_us() - start_us;
+    running = false;
+}
+
+void Timer::reset(void) {
+    total_us = 0;
+    start_us = now_us();
+}
+
+std::chrono::microseconds Timer::elapsed_time(void) const {
+    return std::chrono::microseconds(total_us + (running ? now_us() - start_us : 0));
+}
+
+} //namespace mbed
+
+/*-------------------------------------------Events---------------------------------------------------------*/
+//A fixed table of pending calls, like the buffer of the real EventQueue: the dispatcher takes the earliest due call,
+//runs it outside the kernel lock, and otherwise sleeps until the next one is due or a new one is posted
+namespace events {
+
+struct EventQueue::Entry {
+    int id;                                            //0: free
+    uint64_t due;                                      //us
+    uint64_t period;                                   //us, 0: once
+    uint32_t seq;
+    Callback<void()> f;
+};
+
+EventQueue::EventQueue(unsigned size, unsigned char*)
+    : capacity(size / EVENTS_EVENT_SIZE), next_id(1), sequence(0), broken(false) {
+    if (capacity == 0) capacity = 1;
+    entries = new Entry[capacity]();
+}
+
+EventQueue::~EventQueue() {
+    delete[] entries;
+}
+
+int EventQueue::post(Callback<void()> f, uint64_t delay_ms, uint64_t period_ms) {
+    Lock lock;
+    for (unsigned i = 0; i < capacity; i++) {
+        Entry& e = entries[i];
+        if (e.id != 0) continue;
+        e.id = next_id++;
+        if (next_id <= 0) next_id = 1;
+        e.due = now_us() + delay_ms * 1000;
+        e.period = period_ms * 1000;
+        e.seq = sequence++;
+        e.f = f;
+        wake_all(dispatchers);
+        return e.id;
+    }
+    return 0;
+}
+
+bool EventQueue::cancel(int id) {
+    Lock lock;
+    for (unsigned i = 0; i < capacity; i++) {
+        if (id != 0 && entries[i].id == id) {
+            entries[i].id = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+void EventQueue::break_dispatch(void) {
+    Lock lock;
+    broken = true;
+    wake_all(dispatchers);
+}
+
+void EventQueue::dispatch(uint64_t end_us) {
+    while (1) {
+        Callback<void()> f;
+        {
+            Lock lock;
+            if (broken) {
+                broken = false;
+                return;
+            }
+            Entry* first = nullptr;
+            for (unsigned i = 0; i < capacity; i++) {
+                Entry& e = entries[i];
+                if (e.id == 0) continue;
+                if (first == nullptr || e.due < first->due || (e.due == first->due && e.seq < first->seq)) first = &e;
+            }
+            uint64_t now = now_us();
+            if (first == nullptr || first->due > now) {
+                if (now >= end_us) return;
+                uint64_t wake = first ? std::min(end_us, first->due) : end_us;
+                block_on(dispatchers, wake);
+                continue;
+            }
+            f = first->f;
+            if (first->period) {
+                first->due += first->period;
+                first->seq = sequence++;
+            } else {
+                first->id = 0;
+            }
+        }
+        f();
+    }
+}
+
+void EventQueue::dispatch_forever(void) {
+    dispatch(NEVER);
+}
+
+void EventQueue::dispatch_for(std::chrono::milliseconds ms) {
+    uint64_t end;
+    {
+        Lock lock;
+        end = now_us() + (uint64_t)ms.count() * 1000;
+    }
+    dispatch(end);
+}
+
+} //namespace events
+
+/*-------------------------------------------Hooks----------------------------------------------------------*/
+void host_at(uint32_t ms, Callback<void()> action) {
+    host_at_us((uint64_t)ms * 1000, action);
+}
+
+void host_at_us(uint64_t us, Callback<void()> action) {
+    Lock lock;
+    TimerEvent* event = timer_new();
+    event->action = action;
+    event->period = 0;
+    event->kernel_owned = true;
+    timer_arm(event, us);
+}
+
+uint64_t host_time_us(void) {
+    return now_us();
+}
+
+void host_stop(int code) {
+    stop(code);
+}
+
+void host_check(bool ok, const char* what) {
+    if (ok) return;
+    Lock lock;
+    K().failed_checks++;
+    fprintf(stderr, "[%12.6f] CHECK FAILED: %s\n", now_us() / 1e6, what);
+}
+
+__attribute__((weak)) void host_setup(void) {
+}
+
+int main(void) {
+    K().lock.lock();
+    lock_depth = 1;
+    const char* scenario = getenv("HOST_SCENARIO");
+    if (scenario && !host_load_scenario(scenario)) _exit(2);
+    host_setup();
+    spawn("main", osPriorityNormal, []() { mbed_app_main(); });
+    lock_depth = 0;
+    K().lock.unlock();
+    interrupt_loop();
+}
@@ -0,0 +1,136 @@
+/*Scenario files: the inputs of a run and the expected outputs, written as a list of timed steps instead of a hooks
+file, so the same test can be replayed on any project without compiling anything. One step per line:
+    <time> <action> <arguments>          # comment
+Times and durations are in seconds, or with a unit: 3.2, 3200ms, 500us. The actions:
+    pin P v                     drives input P (D3, A0, BUTTON1, PC_13...) to 0 or 1
+    press P duration            P to 0 (a button with pull-up), and back to 1 after duration
+    bounce P final n interval   n edges, interval apart, the last one leaves P at final: a bouncing contact
+    analog P v                  what AnalogIn P reads, 0.0 to 1.0
+    serial text                 bytes typed on the terminal, \n and \r are escapes
+    lcd                         prints the LCD
+    expect P v                  checks the level of any pin
+    expect_lcd row text         checks that the row of the LCD starts with text
+    stop                        ends the run, with exit code 1 if a check failed
+Every step runs as an interrupt at its time, after the steps before it in the file. Meant for HOST_VIRTUAL=1, e.g.:
+    HOST_VIRTUAL=1 HOST_SCENARIO=examples/lse_competition.txt ./build/00-Playground-LSE */
+
+#include "mbed.h"
+#include "host_hooks.h"
+#include <stdlib.h>
+#include <string>
+
+//Function Prototypes
+static bool parse_time(const char* text, uint64_t* us);
+static bool parse_pin(const char* text, PinName* pin);
+static std::string unescape(const char* text);
+static void print_lcd(void);
+
+bool host_load_scenario(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (file == nullptr) {
+        fprintf(stderr, "%s: cannot open\n", path);
+        return false;
+    }
+    char line[256];
+    int number = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file)) {
+        number++;
+        char* comment = strchr(line, '#');
+        if (comment) *comment = 0;
+        line[strcspn(line, "\r\n")] = 0;
+
+        char time_text[32], action[32];
+        int used = 0;
+        if (sscanf(line, " %31s %31s %n", time_text, action, &used) < 2) continue; //empty line
+        const char* args = line + used;
+        std::string step = std::string(time_text) + " " + action + " " + args;
+
+        uint64_t at, duration, interval;
+        PinName pin;
+        char pin_text[16], text[128];
+        int value, edges, row;
+        float analog;
+        if (!parse_time(time_text, &at)) {
+            ok = false;
+        } else if (!strcmp(action, "pin") && sscanf(args, "%15s %d", pin_text, &value) == 2 &&
+                   parse_pin(pin_text, &pin)) {
+            host_at_us(at, [pin, value] { host_set_pin(pin, value); });
+        } else if (!strcmp(action, "press") && sscanf(args, "%15s %127s", pin_text, text) == 2 &&
+                   parse_pin(pin_text, &pin) && parse_time(text, &duration)) {
+            host_at_us(at, [pin] { host_set_pin(pin, 0); });
+            host_at_us(at + duration, [pin] { host_set_pin(pin, 1); });
+        } else if (!strcmp(action, "bounce") && sscanf(args, "%15s %d %d %127s", pin_text, &value, &edges, text) == 4 &&
+                   parse_pin(pin_text, &pin) && parse_time(text, &interval) && edges > 0) {
+            for (int i = 0; i < edges; i++) {
+                int level = ((edges - 1 - i) % 2 == 0) ? value : !value;
+                host_at_us(at + i * interval, [pin, level] { host_set_pin(pin, level); });
+            }
+        } else if (!strcmp(action, "analog") && sscanf(args, "%15s %f", pin_text, &analog) == 2 &&
+                   parse_pin(pin_text, &pin)) {
+            host_at_us(at, [pin, analog] { host_set_analog(pin, analog); });
+        } else if (!strcmp(action, "serial") && *args) {
+            std::string bytes = unescape(args);
+            host_at_us(at, [bytes] { host_serial_input(bytes.data(), bytes.size()); });
+        } else if (!strcmp(action, "lcd")) {
+            host_at_us(at, [] { print_lcd(); });
+        } else if (!strcmp(action, "expect") && sscanf(args, "%15s %d", pin_text, &value) == 2 &&
+                   parse_pin(pin_text, &pin)) {
+            host_at_us(at, [pin, value, step] { host_check(host_get_pin(pin) == value, step.c_str()); });
+        } else if (!strcmp(action, "expect_lcd") && sscanf(args, "%d %n", &row, &used) == 1 && row >= 0 && row < 4) {
+            std::string expected = args + used;
+            host_at_us(at, [row, expected, step] {
+                host_check(!strncmp(host_lcd_row(row), expected.c_str(), expected.size()), step.c_str());
+            });
+        } else if (!strcmp(action, "stop")) {
+            host_at_us(at, [] { host_stop(0); });
+        } else {
+            ok = false;
+        }
+        if (!ok) fprintf(stderr, "%s:%d: cannot read \"%s\"\n", path, number, step.c_str());
+    }
+    fclose(file);
+    return ok;
+}
+
+static bool parse_time(const char* text, uint64_t* us) { //"3.2", "3.2s", "3200ms" or "500us"
+    char* unit;
+    double value = strtod(text, &unit);
+    if (unit == text || value < 0) return false;
+    double scale = 1e6;
+    if (!strcmp(unit, "ms")) scale = 1e3;
+    else if (!strcmp(unit, "us")) scale = 1;
+    else if (*unit && strcmp(unit, "s")) return false;
+    *us = (uint64_t)(value * scale + 0.5);
+    return true;
+}
+
+static bool parse_pin(const char* text, PinName* pin) { //The names of host_pin_name(), and the board aliases
+    if (!strcmp(text, "LED1")) *pin = LED1;
+    else if (!strcmp(text, "BUTTON1")) *pin = BUTTON1;
+    else {
+        for (int p = 0; p < PIN_COUNT; p++) {
+            if (!strcmp(host_pin_name((PinName)p), text)) {
+                *pin = (PinName)p;
+                return true;
+            }
+        }
+        return false;
+    }
+    return true;
+}
+
+static std::string unescape(const char* text) {
+    std::string bytes;
+    for (; *text; text++) {
+        if (text[0] == '\\' && text[1] == 'n') bytes += '\n', text++;
+        else if (text[0] == '\\' && text[1] == 'r') bytes += '\r', text++;
+        else bytes += *text;
+    }
+    return bytes;
+}
+
+static void print_lcd(void) {
+    fprintf(stderr, "[%12.6f] LCD\n", host_time_us() / 1e6);
+    for (int row = 0; row < 4; row++) fprintf(stderr, "    |%s|\n", host_lcd_row(row));
+}